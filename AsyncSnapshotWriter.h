@@ -0,0 +1,661 @@
+#pragma once
+#include "TreeMap.h"	// TreeMap
+
+#include <vector>		// std::vector
+#include <string>		// std::string
+#include <fstream>		// std::ifstream
+#include <thread>		// std::thread
+#include <mutex>		// std::mutex, std::unique_lock, std::lock_guard
+#include <condition_variable>	// std::condition_variable
+#include <deque>		// std::deque
+#include <atomic>		// std::atomic
+#include <exception>	// std::exception_ptr, std::current_exception
+#include <stdexcept>	// std::runtime_error
+#include <type_traits>	// std::is_trivially_copyable
+#include <cstring>		// std::memcpy, std::memcmp, std::memset, std::strerror
+#include <cstdint>		// uint64_t
+#include <climits>		// UINT_MAX
+#include <cerrno>		// errno, EINTR, EAGAIN, EIO
+
+#include <fcntl.h>		// open, O_WRONLY, O_CREAT, O_TRUNC
+#include <unistd.h>		// pwrite, close, fdatasync
+#include <sys/uio.h>	// iovec
+
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>	// io_uring_params, io_uring_sqe, io_uring_cqe
+#include <sys/mman.h>		// mmap, munmap
+#include <sys/syscall.h>	// SYS_io_uring_setup, SYS_io_uring_enter
+#if defined(SYS_io_uring_setup) && defined(SYS_io_uring_enter)
+#define SNAPSHOT_IO_URING 1
+#endif
+#endif
+#endif
+
+using std::vector;
+
+// AsyncSnapshotWriter saves a TreeMap to a file without blocking the
+// thread which asked for it. A worker thread walks the map and copies
+// its pairs into a ring of large buffers. Each full buffer is handed
+// to the kernel through io_uring while the worker carries on filling
+// the next, so serialization overlaps the disk writes and only waits
+// when every buffer is still being written. Where io_uring is missing
+// or not permitted, a second thread takes the buffers and writes them
+// with pwrite instead. readSnapshot loads such a file back into a map.
+
+// Usage Notes Concerning AsyncSnapshotWriter:
+
+// 1. K and V must be trivially copyable, as pairs are written byte for
+// byte, and a snapshot can only be read on a machine with the same
+// byte order and the same K and V
+
+// 2. the map must be neither modified nor destroyed until wait() has
+// returned, since the worker reads it throughout
+
+// 3. the file is complete, and flushed to the disk, only once wait()
+// has returned without throwing
+
+// SnapshotWriteQueue carries out positioned writes of caller buffers
+// asynchronously, through io_uring if the kernel allows it, else on a
+// thread of its own with pwrite. Each write is named by a tag below
+// the queue's depth, and short writes are resumed until done. A write
+// which the kernel has no room to take is done with pwrite on the spot.
+class SnapshotWriteQueue {
+public:
+	// parameters:
+	// fd- file to write to, which must outlive the queue
+	// depth- most writes which may be in flight at once
+	// constructs queue with no writes in flight
+	SnapshotWriteQueue(int fd, unsigned int depth);
+
+	// waits for every write in flight, ignoring their failures
+	~SnapshotWriteQueue();
+
+	SnapshotWriteQueue(const SnapshotWriteQueue&) = delete;
+	SnapshotWriteQueue& operator=(const SnapshotWriteQueue&) = delete;
+
+	// parameters:
+	// tag- name of the write, which mustn't already be in flight
+	// data- bytes to write, which must stay put until tag is reaped
+	// bytes- number of bytes
+	// offset- position in the file at which to write them
+	// modifies:
+	// queue to start writing data
+	// throws:
+	// runtime error if the write cannot be submitted
+	void submit(unsigned int tag, const char* data, size_t bytes, uint64_t offset);
+
+	// returns:
+	// tag of a write which has completed, waiting for one if need be
+	// throws:
+	// runtime error if that write failed
+	unsigned int reap();
+
+	// returns:
+	// number of writes submitted but not yet reaped
+	unsigned int inFlight() const { return inFlight_; };
+
+	// returns:
+	// true iff writes go through io_uring rather than pwrite
+	bool usesIoUring() const { return ringFd_ >= 0; };
+
+private:
+	// what is left of one submitted write
+	typedef struct PendingWrite {
+		const char* data;
+		size_t remaining;
+		uint64_t offset;
+		// what io_uring is pointed at, so it must live as long
+		iovec segment;
+		// errno of a failed pwrite, or 0
+		int error;
+	} SnapshotWrite;
+
+	int fd_;
+	vector<SnapshotWrite> pending_;
+	unsigned int inFlight_;
+
+	// io_uring state, ringFd_ being -1 when the fallback is used
+	int ringFd_;
+	void* sqRing_;
+	void* cqRing_;
+	size_t sqRingBytes_;
+	size_t cqRingBytes_;
+#ifdef SNAPSHOT_IO_URING
+	io_uring_sqe* sqes_;
+	size_t sqesBytes_;
+	unsigned int* sqTail_;
+	unsigned int sqMask_;
+	unsigned int* sqArray_;
+	unsigned int* cqHead_;
+	unsigned int* cqTail_;
+	unsigned int cqMask_;
+	io_uring_cqe* cqes_;
+#endif
+
+	// fallback state, guarded by mutex_
+	std::mutex mutex_;
+	// signalled when a write is queued or the queue is destroyed
+	std::condition_variable workAvailable_;
+	// signalled whenever a write completes
+	std::condition_variable workDone_;
+	std::deque<unsigned int> queued_;
+	// writes done with pwrite, which with io_uring are only those the
+	// kernel had no room for
+	std::deque<unsigned int> finished_;
+	bool stopping_;
+	std::thread writer_;
+
+	// returns:
+	// true iff an io_uring could be set up, with its rings mapped
+	bool setUpRing(unsigned int depth);
+
+	// modifies:
+	// queue to drop its io_uring, if it has one
+	void tearDownRing();
+
+	// parameters:
+	// tag- write which is to be handed to the kernel
+	// modifies:
+	// io_uring to hold a submission for what is left of tag. if the
+	// kernel is out of room for it, writes it with pwrite instead and
+	// adds it to finished_
+	// throws:
+	// runtime error if io_uring rejects the submission
+	void submitToRing(unsigned int tag);
+
+	// parameters:
+	// tag- write which is to be performed
+	// modifies:
+	// file to hold what is left of tag, written with pwrite, or tag's
+	// error to be the errno of the write which failed
+	void writeDirectly(unsigned int tag);
+
+	// parameters:
+	// tag- write which some bytes of have landed
+	// written- bytes written, or a negated errno
+	// returns:
+	// true iff tag is finished
+	// throws:
+	// runtime error if the write failed
+	bool advance(unsigned int tag, long written);
+
+	// modifies:
+	// nothing. runs the fallback thread, which performs queued writes
+	// with pwrite until the queue is destroyed
+	void writerLoop();
+};  // end class SnapshotWriteQueue
+
+template<class K, class V> class AsyncSnapshotWriter {
+	static_assert(std::is_trivially_copyable<K>::value
+		&& std::is_trivially_copyable<V>::value,
+		"AsyncSnapshotWriter writes keys and values byte for byte");
+
+public:
+	// bytes in each buffer of the ring
+	static const size_t BUFFER_BYTES = 1 << 20;
+	// number of buffers in the ring, and so most writes in flight
+	static const unsigned int RING_BUFFERS = 8;
+
+	// parameters:
+	// map- map which is to be saved
+	// path- file to save it to, which is replaced if it exists
+	// constructs writer which starts saving map in the background
+	// throws:
+	// runtime error if path cannot be opened for writing
+	AsyncSnapshotWriter(const TreeMap<K, V>& map, const std::string& path);
+
+	// waits for the snapshot to be written, ignoring any failure
+	~AsyncSnapshotWriter();
+
+	AsyncSnapshotWriter(const AsyncSnapshotWriter&) = delete;
+	AsyncSnapshotWriter& operator=(const AsyncSnapshotWriter&) = delete;
+
+	// modifies:
+	// nothing. returns once the whole snapshot is on disk
+	// throws:
+	// runtime error if it could not be written
+	void wait();
+
+	// returns:
+	// true iff the snapshot has been written, or has failed
+	bool isDone() const { return done_; };
+
+	// returns:
+	// true iff buffers are written through io_uring rather than pwrite
+	bool usesIoUring() const { return queue_->usesIoUring(); };
+
+private:
+	const TreeMap<K, V>* map_;
+	int fd_;
+	SnapshotWriteQueue* queue_;
+	vector<vector<char>> buffers_;
+	std::thread worker_;
+	// what went wrong on the worker, if anything
+	std::exception_ptr failure_;
+	std::atomic<bool> done_;
+
+	// modifies:
+	// nothing. runs the worker, which serializes the map into the
+	// buffers, writes them, and flushes the file
+	void serialize();
+};  // end class AsyncSnapshotWriter
+
+// marks the start of a snapshot file, and its format version
+const char TREE_SNAPSHOT_MAGIC[8] = { 'T', 'M', 'S', 'N', 'A', 'P', '0', '1' };
+
+inline SnapshotWriteQueue::SnapshotWriteQueue(int fd, unsigned int depth)
+	: fd_(fd), pending_(depth), inFlight_(0), ringFd_(-1), sqRing_(nullptr),
+	cqRing_(nullptr), sqRingBytes_(0), cqRingBytes_(0), stopping_(false) {
+	if (!setUpRing(depth)) {
+		writer_ = std::thread(&SnapshotWriteQueue::writerLoop, this);
+	}
+}
+
+inline SnapshotWriteQueue::~SnapshotWriteQueue() {
+	// the kernel or the writer may still be reading the buffers
+	while (inFlight_ > 0) {
+		try {
+			reap();
+		}
+		catch (std::runtime_error&) {}
+	}
+	if (writer_.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(mutex_);
+			stopping_ = true;
+		}
+		workAvailable_.notify_all();
+		writer_.join();
+	}
+	tearDownRing();
+}
+
+inline bool SnapshotWriteQueue::setUpRing(unsigned int depth) {
+#ifdef SNAPSHOT_IO_URING
+	io_uring_params params;
+	std::memset(&params, 0, sizeof(params));
+	int ringFd = static_cast<int>(syscall(SYS_io_uring_setup, depth, &params));
+	if (ringFd < 0) {
+		// an old kernel, or one which forbids io_uring
+		return false;
+	}
+	ringFd_ = ringFd;
+	sqRingBytes_ = params.sq_off.array + params.sq_entries * sizeof(unsigned int);
+	cqRingBytes_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+	bool singleMap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+	if (singleMap) {
+		// one mapping serves both rings
+		if (cqRingBytes_ > sqRingBytes_) {
+			sqRingBytes_ = cqRingBytes_;
+		}
+		cqRingBytes_ = 0;
+	}
+	sqesBytes_ = params.sq_entries * sizeof(io_uring_sqe);
+	sqes_ = nullptr;
+	sqRing_ = mmap(nullptr, sqRingBytes_, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+	if (sqRing_ == MAP_FAILED) {
+		sqRing_ = nullptr;
+		tearDownRing();
+		return false;
+	}
+	cqRing_ = singleMap ? sqRing_ : mmap(nullptr, cqRingBytes_,
+		PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_,
+		IORING_OFF_CQ_RING);
+	void* sqes = mmap(nullptr, sqesBytes_, PROT_READ | PROT_WRITE,
+		MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+	if (cqRing_ == MAP_FAILED || sqes == MAP_FAILED) {
+		if (cqRing_ == MAP_FAILED) {
+			cqRing_ = nullptr;
+		}
+		if (sqes != MAP_FAILED) {
+			munmap(sqes, sqesBytes_);
+		}
+		tearDownRing();
+		return false;
+	}
+	sqes_ = static_cast<io_uring_sqe*>(sqes);
+	char* sq = static_cast<char*>(sqRing_);
+	char* cq = static_cast<char*>(cqRing_);
+	sqTail_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.tail);
+	sqMask_ = *reinterpret_cast<unsigned int*>(sq + params.sq_off.ring_mask);
+	sqArray_ = reinterpret_cast<unsigned int*>(sq + params.sq_off.array);
+	cqHead_ = reinterpret_cast<unsigned int*>(cq + params.cq_off.head);
+	cqTail_ = reinterpret_cast<unsigned int*>(cq + params.cq_off.tail);
+	cqMask_ = *reinterpret_cast<unsigned int*>(cq + params.cq_off.ring_mask);
+	cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+	return true;
+#else
+	(void)depth;
+	return false;
+#endif
+}
+
+inline void SnapshotWriteQueue::tearDownRing() {
+#ifdef SNAPSHOT_IO_URING
+	if (ringFd_ < 0) {
+		return;
+	}
+	if (sqes_ != nullptr) {
+		munmap(sqes_, sqesBytes_);
+	}
+	if (cqRing_ != nullptr && cqRing_ != sqRing_) {
+		munmap(cqRing_, cqRingBytes_);
+	}
+	if (sqRing_ != nullptr) {
+		munmap(sqRing_, sqRingBytes_);
+	}
+	close(ringFd_);
+	ringFd_ = -1;
+#endif
+}
+
+inline void SnapshotWriteQueue::submit(unsigned int tag, const char* data,
+	size_t bytes, uint64_t offset) {
+	pending_[tag] = SnapshotWrite{ data, bytes, offset, iovec(), 0 };
+	if (usesIoUring()) {
+		submitToRing(tag);
+		inFlight_++;
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		queued_.push_back(tag);
+	}
+	inFlight_++;
+	workAvailable_.notify_one();
+}
+
+inline void SnapshotWriteQueue::submitToRing(unsigned int tag) {
+#ifdef SNAPSHOT_IO_URING
+	SnapshotWrite& write = pending_[tag];
+	write.segment.iov_base = const_cast<char*>(write.data);
+	write.segment.iov_len = write.remaining;
+	// no more writes are ever in flight than the ring has entries,
+	// so there is always room
+	unsigned int tail = *sqTail_;
+	unsigned int index = tail & sqMask_;
+	io_uring_sqe* sqe = &sqes_[index];
+	std::memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = IORING_OP_WRITEV;
+	sqe->fd = fd_;
+	sqe->off = write.offset;
+	sqe->addr = reinterpret_cast<uint64_t>(&write.segment);
+	sqe->len = 1;
+	sqe->user_data = tag;
+	sqArray_[index] = index;
+	// the kernel must see the entry before the new tail
+	__atomic_store_n(sqTail_, tail + 1, __ATOMIC_RELEASE);
+	while (true) {
+		long submitted = syscall(SYS_io_uring_enter, ringFd_, 1, 0, 0, nullptr, 0);
+		if (submitted == 1) {
+			return;
+		}
+		if (submitted < 0 && errno == EAGAIN) {
+			// the kernel is short of memory for requests and may stay so
+			// for a while. it has not consumed the entry, so take it back
+			// and write here rather than spin
+			__atomic_store_n(sqTail_, tail, __ATOMIC_RELEASE);
+			writeDirectly(tag);
+			std::lock_guard<std::mutex> lock(mutex_);
+			finished_.push_back(tag);
+			return;
+		}
+		if (submitted < 0 && errno != EINTR) {
+			throw std::runtime_error(std::string("Could not submit snapshot write: ")
+				+ std::strerror(errno));
+		}
+		// interrupted, or nothing consumed, so the entry is still queued
+	}
+#else
+	(void)tag;
+#endif
+}
+
+inline unsigned int SnapshotWriteQueue::reap() {
+#ifdef SNAPSHOT_IO_URING
+	while (usesIoUring()) {
+		{
+			// a write done with pwrite is reaped below, like the fallback's
+			std::lock_guard<std::mutex> lock(mutex_);
+			if (!finished_.empty()) {
+				break;
+			}
+		}
+		unsigned int head = *cqHead_;
+		if (head == __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE)) {
+			if (syscall(SYS_io_uring_enter, ringFd_, 0, 1, IORING_ENTER_GETEVENTS,
+				nullptr, 0) < 0 && errno != EINTR) {
+				throw std::runtime_error(std::string("Could not wait for snapshot write: ")
+					+ std::strerror(errno));
+			}
+			continue;
+		}
+		const io_uring_cqe& completion = cqes_[head & cqMask_];
+		unsigned int tag = static_cast<unsigned int>(completion.user_data);
+		long written = completion.res;
+		__atomic_store_n(cqHead_, head + 1, __ATOMIC_RELEASE);
+		bool finished;
+		try {
+			finished = advance(tag, written);
+		}
+		catch (std::runtime_error&) {
+			inFlight_--;
+			throw;
+		}
+		if (finished) {
+			inFlight_--;
+			return tag;
+		}
+		// a short write, so hand in the rest
+		try {
+			submitToRing(tag);
+		}
+		catch (std::runtime_error&) {
+			inFlight_--;
+			throw;
+		}
+	}
+#endif
+	std::unique_lock<std::mutex> lock(mutex_);
+	workDone_.wait(lock, [this]() { return !finished_.empty(); });
+	unsigned int tag = finished_.front();
+	finished_.pop_front();
+	inFlight_--;
+	if (pending_[tag].error != 0) {
+		throw std::runtime_error(std::string("Could not write snapshot: ")
+			+ std::strerror(pending_[tag].error));
+	}
+	return tag;
+}
+
+inline bool SnapshotWriteQueue::advance(unsigned int tag, long written) {
+	SnapshotWrite& write = pending_[tag];
+	if (written <= 0) {
+		// nothing written at all can only mean the device is full
+		throw std::runtime_error(std::string("Could not write snapshot: ")
+			+ std::strerror(written < 0 ? static_cast<int>(-written) : EIO));
+	}
+	write.data += written;
+	write.remaining -= static_cast<size_t>(written);
+	write.offset += static_cast<uint64_t>(written);
+	return write.remaining == 0;
+}
+
+inline void SnapshotWriteQueue::writeDirectly(unsigned int tag) {
+	SnapshotWrite& write = pending_[tag];
+	while (write.remaining > 0) {
+		ssize_t written = pwrite(fd_, write.data, write.remaining,
+			static_cast<off_t>(write.offset));
+		if (written < 0 && errno == EINTR) {
+			continue;
+		}
+		if (written <= 0) {
+			write.error = written < 0 ? errno : EIO;
+			return;
+		}
+		write.data += written;
+		write.remaining -= static_cast<size_t>(written);
+		write.offset += static_cast<uint64_t>(written);
+	}
+}
+
+inline void SnapshotWriteQueue::writerLoop() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true) {
+		workAvailable_.wait(lock, [this]() { return stopping_ || !queued_.empty(); });
+		if (queued_.empty()) {
+			return;
+		}
+		unsigned int tag = queued_.front();
+		queued_.pop_front();
+		lock.unlock();
+		// only this thread touches a queued write until it is finished
+		writeDirectly(tag);
+		lock.lock();
+		finished_.push_back(tag);
+		workDone_.notify_all();
+	}
+}
+
+template<class K, class V>
+AsyncSnapshotWriter<K, V>::AsyncSnapshotWriter(const TreeMap<K, V>& map,
+	const std::string& path)
+	: map_(&map), fd_(-1), queue_(nullptr), done_(false) {
+	fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd_ < 0) {
+		throw std::runtime_error("Could not open snapshot file " + path + ".");
+	}
+	try {
+		buffers_.resize(RING_BUFFERS);
+		queue_ = new SnapshotWriteQueue(fd_, RING_BUFFERS);
+		worker_ = std::thread(&AsyncSnapshotWriter::serialize, this);
+	}
+	catch (...) {
+		delete queue_;
+		close(fd_);
+		throw;
+	}
+}
+
+template<class K, class V>
+AsyncSnapshotWriter<K, V>::~AsyncSnapshotWriter() {
+	if (worker_.joinable()) {
+		worker_.join();
+	}
+	delete queue_;
+	close(fd_);
+}
+
+template<class K, class V>
+void AsyncSnapshotWriter<K, V>::wait() {
+	if (worker_.joinable()) {
+		worker_.join();
+	}
+	if (failure_) {
+		std::rethrow_exception(failure_);
+	}
+}
+
+// file layout: the magic bytes, then the number of pairs, sizeof(K),
+// and sizeof(V) as uint64_t, then every key followed by its value, in
+// ascending order of key
+template<class K, class V>
+void AsyncSnapshotWriter<K, V>::serialize() {
+	try {
+		vector<unsigned int> idle;
+		for (unsigned int i = 0; i < RING_BUFFERS; i++) {
+			buffers_[i].resize(BUFFER_BYTES);
+			idle.push_back(i);
+		}
+		uint64_t offset = 0;
+		unsigned int current = idle.back();
+		idle.pop_back();
+		char* out = buffers_[current].data();
+		uint64_t header[3] = { map_->size(), sizeof(K), sizeof(V) };
+		std::memcpy(out, TREE_SNAPSHOT_MAGIC, sizeof(TREE_SNAPSHOT_MAGIC));
+		std::memcpy(out + sizeof(TREE_SNAPSHOT_MAGIC), header, sizeof(header));
+		size_t used = sizeof(TREE_SNAPSHOT_MAGIC) + sizeof(header);
+		for (auto it = map_->begin(); it != map_->end(); ++it) {
+			if (used + sizeof(K) + sizeof(V) > BUFFER_BYTES) {
+				queue_->submit(current, buffers_[current].data(), used, offset);
+				offset += used;
+				// take an idle buffer, or else the first to be written
+				if (idle.empty()) {
+					current = queue_->reap();
+				}
+				else {
+					current = idle.back();
+					idle.pop_back();
+				}
+				out = buffers_[current].data();
+				used = 0;
+			}
+			std::memcpy(out + used, &it->first, sizeof(K));
+			std::memcpy(out + used + sizeof(K), &it->second, sizeof(V));
+			used += sizeof(K) + sizeof(V);
+		}
+		queue_->submit(current, buffers_[current].data(), used, offset);
+		while (queue_->inFlight() > 0) {
+			queue_->reap();
+		}
+		if (fdatasync(fd_) != 0) {
+			throw std::runtime_error(std::string("Could not flush snapshot: ")
+				+ std::strerror(errno));
+		}
+	}
+	catch (...) {
+		failure_ = std::current_exception();
+	}
+	done_ = true;
+}
+
+// parameters:
+// path- file written by an AsyncSnapshotWriter<K, V>
+// map- map which is to be loaded
+// modifies:
+// map to hold exactly the pairs in the file, bulk built by importColumns
+// throws:
+// runtime error if the file cannot be read or is not such a snapshot,
+// or bad_alloc if memory runs out, either leaving map unchanged
+template<class K, class V>
+void readSnapshot(const std::string& path, TreeMap<K, V>* map) {
+	static_assert(std::is_trivially_copyable<K>::value
+		&& std::is_trivially_copyable<V>::value,
+		"readSnapshot reads keys and values byte for byte");
+	std::ifstream in(path, std::ios::binary);
+	char magic[sizeof(TREE_SNAPSHOT_MAGIC)];
+	uint64_t header[3];
+	in.read(magic, sizeof(magic));
+	in.read(reinterpret_cast<char*>(header), sizeof(header));
+	if (!in || std::memcmp(magic, TREE_SNAPSHOT_MAGIC, sizeof(magic)) != 0
+		|| header[0] > UINT_MAX || header[1] != sizeof(K) || header[2] != sizeof(V)) {
+		throw std::runtime_error("Could not read snapshot file " + path + ".");
+	}
+	vector<K> keys(header[0]);
+	vector<V> values(header[0]);
+	const size_t PAIRS_PER_READ = AsyncSnapshotWriter<K, V>::BUFFER_BYTES
+		/ (sizeof(K) + sizeof(V));
+	vector<char> buffer(PAIRS_PER_READ * (sizeof(K) + sizeof(V)));
+	for (size_t first = 0; first < keys.size(); first += PAIRS_PER_READ) {
+		size_t count = keys.size() - first < PAIRS_PER_READ ? keys.size() - first
+			: PAIRS_PER_READ;
+		in.read(buffer.data(), count * (sizeof(K) + sizeof(V)));
+		if (!in) {
+			throw std::runtime_error("Could not read snapshot file " + path + ".");
+		}
+		const char* pairs = buffer.data();
+		for (size_t i = first; i < first + count; i++) {
+			std::memcpy(&keys[i], pairs, sizeof(K));
+			std::memcpy(&values[i], pairs + sizeof(K), sizeof(V));
+			pairs += sizeof(K) + sizeof(V);
+		}
+	}
+	try {
+		map->importColumns(keys, values);
+	}
+	catch (std::invalid_argument&) {
+		throw std::runtime_error("Could not read snapshot file " + path + ".");
+	}
+}
@@ -0,0 +1,788 @@
+#pragma once
+#include "MemoryUsage.h"	// MemoryUsage, CountingAllocator
+#include <map>			// std::map
+#include <vector>		// std::vector
+#include <utility>		// std::pair
+#include <algorithm>	// std::upper_bound, std::lower_bound
+#include <iterator>		// std::iterator, std::input_iterator_tag
+#include <stdexcept>	// std::out_of_range
+#include <memory>		// std::shared_ptr, std::make_shared
+#include <atomic>		// std::atomic
+
+using std::pair;
+using std::vector;
+using std::map;
+
+// BufferedTreeMap represents a write-optimized map in the style of a
+// B-epsilon tree. Internal nodes hold a buffer of pending inserts and
+// deletes ("messages") which are only pushed down to their children in
+// batches once the buffer fills up, so a random insert costs a fraction
+// of a root-to-leaf descent when amortized over the batch it is flushed
+// with. Lookups consult the buffers along their search path and
+// iteration merges any buffered messages into the leaves it walks.
+
+// Usage Notes Concerning BufferedTreeMap and BufferedIterator:
+
+// 1. class K must support the <, >, and == operators,
+// and class V must be default constructible
+
+// 2. user retains responsibility for freeing keys and values
+// if either K or V is a pointer type
+
+// 3. if any key is altered after it is inserted into the
+// tree, all behavior guarantees are immediately
+// and permanently nullified
+
+// 4. if the tree is modified after an iterator is constructed,
+// said iterator is invalid and its behavior is not guaranteed.
+// the same holds for references returned by at()
+
+// 5. put() and erase() are blind writes: they never look the key up,
+// which is what makes them cheap. add() and remove() keep TreeMap's
+// checked semantics and so pay for one lookup each.
+
+template<class K, class V> class BufferedTreeMap {
+	// a pending insert or delete waiting in an internal node's buffer
+	typedef struct Message {
+		bool isDelete;
+		V value;
+	} BufferedMessage;
+
+	// struct representing a node in the tree. internal nodes route
+	// keys to children[i] where i is the number of pivots <= key,
+	// leaves hold their key-value pairs in sorted order
+	typedef struct Node {
+		vector<K> pivots;
+		vector<Node*> children;  // empty iff node is a leaf
+		map<K, BufferedMessage> buffer;  // unused by leaves
+		vector<pair<K, V>> entries;  // unused by internal nodes
+	} BufferedNode;
+
+	// a lazy input_iterator for BufferedTreeMap which walks the leaves
+	// in order, merging into each the messages still buffered above it
+	class BufferedIterator :
+		public std::iterator<std::input_iterator_tag, pair<K, V>> {
+
+		// storage charged to the map's iterator tally
+		typedef vector<pair<BufferedNode*, size_t>,
+			CountingAllocator<pair<BufferedNode*, size_t>>> NodePath;
+		typedef vector<pair<K, V>, CountingAllocator<pair<K, V>>> MergedEntries;
+
+	public:
+		// constructs iterator of the tree for which root is the root,
+		// whose memory is added to tally
+		BufferedIterator(BufferedNode* root,
+			const shared_ptr<std::atomic<size_t>>& tally);
+
+		// constructor for past-the-end iterator
+		BufferedIterator() : leaf_(nullptr), position_(0) {};
+
+		// comparison operators.
+		// two iterators are equal if they are at an identical
+		// position in the same instance of a BufferedTreeMap
+		// or if they are both past-the-end
+		bool operator==(const BufferedIterator& rhs) const;
+		bool operator!=(const BufferedIterator& rhs) const;
+
+		// basic accessors, rvalues only
+		// each throws out of range exception if
+		// called when iterator is past-the-end
+		const pair<K, V>& operator*() const;
+		pair<K, V> const* operator->() const;
+
+		// pre and postfix incrementers
+		// each throws out of range exception if
+		// called when iterator is past-the-end
+		BufferedIterator& operator++();
+		BufferedIterator operator++(int);
+
+		// returns:
+		// true iff iterator is in legal state to be dereferenced
+		bool isLegal() const { return leaf_ != nullptr; };
+
+	private:
+		// internal nodes from the root down to the current leaf,
+		// each paired with the index of the child that was taken
+		NodePath path_;
+		BufferedNode* leaf_;
+		// current leaf's entries with buffered messages applied
+		MergedEntries merged_;
+		size_t position_;
+
+		// parameters:
+		// current- node whose leftmost leaf is to be visited
+		// modifies:
+		// iterator to rest on that leaf, which may merge to nothing
+		void descendToLeaf(BufferedNode* current);
+
+		// modifies:
+		// iterator to rest on the next non-empty merged leaf,
+		// or to be past-the-end if there is none
+		void advanceLeaf();
+
+		// modifies:
+		// merged_ to hold leaf_'s entries with every message buffered
+		// in an ancestor and routed towards leaf_ applied to them
+		void mergeLeaf();
+	};  // end class BufferedIterator
+
+public:
+	// maximum number of children of an internal node
+	static const size_t FANOUT = 16;
+	// number of messages an internal node buffers before flushing
+	static const size_t BUFFER_CAPACITY = 128;
+	// number of entries a leaf holds before it is split
+	static const size_t LEAF_CAPACITY = 64;
+
+	// constructs empty BufferedTreeMap
+	BufferedTreeMap();
+	~BufferedTreeMap();
+
+	BufferedTreeMap(const BufferedTreeMap&) = delete;
+	BufferedTreeMap& operator=(const BufferedTreeMap&) = delete;
+
+	// parameters:
+	// key- represents the key in this pair
+	// value- represents the value paired with key
+	// modifies:
+	// map to associate value with key, replacing any earlier value.
+	// the write is buffered at the root and costs no lookup
+	void put(const K& key, const V& value);
+
+	// parameters:
+	// key- key of key-value pair which is to be removed
+	// modifies:
+	// map to no longer contain key, if it did. the delete is buffered
+	// at the root and costs no lookup
+	void erase(const K& key);
+
+	// parameters:
+	// key- represents the key in this pair
+	// value- represents the value paired with key
+	// returns:
+	// true iff this key is not equivalent to one in this tree already
+	// modifies:
+	// map to contain given key-value pair if equal key is not present
+	// if equivalent key is present, nothing is modified
+	bool add(const K& key, const V& value);
+
+	// parameters:
+	// key- key of key-value pair which is to be retrieved
+	// returns:
+	// value corresponding to given key, which may still be sitting
+	// in a buffer on the search path
+	// throws:
+	// out of range exception if no key in map is equivalent to given key
+	V& at(const K& key) const;
+
+	// parameters:
+	// key- key of key-value pair which is to be removed
+	// returns:
+	// value corresponding to given key
+	// modifies:
+	// map to no longer contain key-value pair
+	// throws:
+	// out of range exception if no key in map is equal to given key
+	V remove(const K& key);
+
+	// returns:
+	// number of key-value pairs in map. this is O(1) unless blind
+	// writes have been made since it was last known, in which case
+	// the pending messages are resolved with one merged traversal
+	unsigned int size() const;
+
+	// returns:
+	// breakdown of the memory this map holds, with nodes, their pivots
+	// and child links, leaf entries and buffered messages reported as
+	// separate node types. O(1), as every figure is kept up to date
+	// as the map and its iterators change
+	MemoryUsage memoryUsage() const;
+
+	// returns:
+	// iterator to beginning of tree, which performs in-order traversal
+	BufferedIterator begin() const { return BufferedIterator(root_, iteratorBytes_); }
+
+	// returns:
+	// past-the-end iterator for use in comparison
+	BufferedIterator end() const { return BufferedIterator(); };
+
+private:
+	mutable unsigned int size_;
+	// false once a blind write has made size_ stale
+	mutable bool sizeKnown_;
+	BufferedNode* root_;
+	// what every node holds, summed for memoryUsage()
+	size_t nodeCount_;
+	size_t pivotCount_;
+	size_t childLinkCount_;
+	size_t entryCount_;
+	size_t messageCount_;
+	size_t slackBytes_;
+	// bytes held by live iterators, shared with each of them
+	shared_ptr<std::atomic<size_t>> iteratorBytes_;
+
+	// parameters:
+	// node- node which has just been created or changed
+	// modifies:
+	// memory totals to include what node holds
+	void countNode(const BufferedNode* node);
+
+	// parameters:
+	// node- node which is about to be changed or deleted
+	// modifies:
+	// memory totals to no longer include what node holds
+	void uncountNode(const BufferedNode* node);
+
+	// parameters:
+	// node- node which is measured
+	// returns:
+	// bytes the allocator holds for node beyond what its struct and
+	// elements need: malloc rounding, and unused vector capacity
+	static size_t slackOf(const BufferedNode* node);
+
+	// parameters:
+	// current- root of tree which is to be deleted
+	// modifies:
+	// tree to not contain any nodes
+	void deleteTreeHelper(BufferedNode* current);
+
+	// parameters:
+	// key- key of the message
+	// message- insert or delete to be applied
+	// modifies:
+	// map to have message buffered at the root (or applied directly
+	// when the root is a leaf), flushing and splitting as needed
+	void enqueue(const K& key, const BufferedMessage& message);
+
+	// parameters:
+	// key- key which is to be looked up
+	// returns:
+	// pointer to the newest value associated with key,
+	// or nullptr if key is absent or its newest message is a delete
+	V* findHelper(const K& key) const;
+
+	// parameters:
+	// current- internal node whose buffer is over capacity
+	// modifies:
+	// moves the messages bound for current's busiest child into that
+	// child, splitting or dropping children of current as required
+	void flush(BufferedNode* current);
+
+	// parameters:
+	// leaf- leaf to which messages are applied
+	// first, last- sorted range of messages to be applied
+	// modifies:
+	// leaf's entries to reflect the messages
+	template<class MessageIt>
+	void applyToLeaf(BufferedNode* leaf, MessageIt first, MessageIt last);
+
+	// parameters:
+	// parent- internal node
+	// index- index of parent's child which holds too many entries
+	// or children
+	// modifies:
+	// parent to hold the child's upper half as a new sibling
+	// immediately after it
+	void splitChild(BufferedNode* parent, size_t index);
+
+	// parameters:
+	// parent- internal node
+	// index- index of parent's child which may be overfull
+	// modifies:
+	// parent to have that child split as many times as needed for it
+	// and each of its new siblings to be within capacity
+	void splitOverfull(BufferedNode* parent, size_t index);
+
+	// modifies:
+	// tree to gain a new root if the old one has overflowed
+	void growRootIfNeeded();
+
+	// parameters:
+	// node- internal node
+	// key- key which is to be routed
+	// returns:
+	// index of node's child whose subtree key belongs to
+	static size_t route(const BufferedNode* node, const K& key);
+
+	// parameters:
+	// node- node which is checked
+	// returns:
+	// true iff node holds more entries or children than allowed
+	static bool isOverfull(const BufferedNode* node);
+};  // end class BufferedTreeMap
+
+template<class K, class V>
+BufferedTreeMap<K, V>::BufferedTreeMap()
+	: size_(0), sizeKnown_(true), root_(new BufferedNode()), nodeCount_(0),
+	pivotCount_(0), childLinkCount_(0), entryCount_(0), messageCount_(0),
+	slackBytes_(0), iteratorBytes_(std::make_shared<std::atomic<size_t>>(0)) {
+	countNode(root_);
+}
+
+template<class K, class V>
+BufferedTreeMap<K, V>::~BufferedTreeMap() {
+	deleteTreeHelper(root_);
+};
+
+template<class K, class V>
+void BufferedTreeMap<K, V>::deleteTreeHelper(BufferedNode* current) {
+	for (BufferedNode* child : current->children) {
+		deleteTreeHelper(child);
+	}
+	delete current;
+};
+
+template<class K, class V>
+MemoryUsage BufferedTreeMap<K, V>::memoryUsage() const {
+	MemoryUsage usage = MemoryUsage();
+	usage.nodeTypes.push_back(MemoryUsage::NodeTypeUsage{ "BufferedNode",
+		nodeCount_, nodeCount_ * sizeof(BufferedNode) });
+	usage.nodeTypes.push_back(MemoryUsage::NodeTypeUsage{ "pivot",
+		pivotCount_, pivotCount_ * sizeof(K) });
+	usage.nodeTypes.push_back(MemoryUsage::NodeTypeUsage{ "child link",
+		childLinkCount_, childLinkCount_ * sizeof(BufferedNode*) });
+	usage.nodeTypes.push_back(MemoryUsage::NodeTypeUsage{ "leaf entry",
+		entryCount_, entryCount_ * sizeof(pair<K, V>) });
+	usage.nodeTypes.push_back(MemoryUsage::NodeTypeUsage{ "buffered message",
+		messageCount_, messageCount_ * sizeof(pair<const K, BufferedMessage>) });
+	usage.nodeBytes = 0;
+	for (const MemoryUsage::NodeTypeUsage& type : usage.nodeTypes) {
+		usage.nodeBytes += type.bytes;
+	}
+	usage.slackBytes = slackBytes_;
+	usage.iteratorBytes = iteratorBytes_->load(std::memory_order_relaxed);
+	usage.auxiliaryBytes = 0;
+	return usage;
+}
+
+template<class K, class V>
+void BufferedTreeMap<K, V>::countNode(const BufferedNode* node) {
+	nodeCount_++;
+	pivotCount_ += node->pivots.size();
+	childLinkCount_ += node->children.size();
+	entryCount_ += node->entries.size();
+	messageCount_ += node->buffer.size();
+	slackBytes_ += slackOf(node);
+}
+
+template<class K, class V>
+void BufferedTreeMap<K, V>::uncountNode(const BufferedNode* node) {
+	nodeCount_--;
+	pivotCount_ -= node->pivots.size();
+	childLinkCount_ -= node->children.size();
+	entryCount_ -= node->entries.size();
+	messageCount_ -= node->buffer.size();
+	slackBytes_ -= slackOf(node);
+}
+
+template<class K, class V>
+size_t BufferedTreeMap<K, V>::slackOf(const BufferedNode* node) {
+	// an empty vector holds no block at all
+	auto vectorSlack = [](size_t count, size_t capacity, size_t elementBytes) {
+		return capacity == 0 ? 0
+			: MemoryUsage::heapBlockSize(capacity * elementBytes) - count * elementBytes;
+	};
+	size_t messageBytes = sizeof(pair<const K, BufferedMessage>);
+	return MemoryUsage::heapBlockSize(sizeof(BufferedNode)) - sizeof(BufferedNode)
+		+ vectorSlack(node->pivots.size(), node->pivots.capacity(), sizeof(K))
+		+ vectorSlack(node->children.size(), node->children.capacity(),
+			sizeof(BufferedNode*))
+		+ vectorSlack(node->entries.size(), node->entries.capacity(),
+			sizeof(pair<K, V>))
+		+ node->buffer.size() * (MemoryUsage::heapBlockSize(
+			MemoryUsage::mapNodeSize(messageBytes)) - messageBytes);
+}
+
+template<class K, class V>
+size_t BufferedTreeMap<K, V>::route(const BufferedNode* node, const K& key) {
+	return std::upper_bound(node->pivots.begin(), node->pivots.end(), key)
+		- node->pivots.begin();
+}
+
+template<class K, class V>
+bool BufferedTreeMap<K, V>::isOverfull(const BufferedNode* node) {
+	return node->children.empty() ? node->entries.size() > LEAF_CAPACITY
+		: node->children.size() > FANOUT;
+}
+
+template<class K, class V>
+void BufferedTreeMap<K, V>::put(const K& key, const V& value) {
+	enqueue(key, BufferedMessage{ false, value });
+	sizeKnown_ = false;
+}
+
+template<class K, class V>
+void BufferedTreeMap<K, V>::erase(const K& key) {
+	enqueue(key, BufferedMessage{ true, V() });
+	sizeKnown_ = false;
+}
+
+template<class K, class V>
+bool BufferedTreeMap<K, V>::add(const K& key, const V& value) {
+	if (findHelper(key) != nullptr) {  // key collision, nothing is altered
+		return false;
+	}
+	enqueue(key, BufferedMessage{ false, value });
+	size_++;
+	return true;
+}
+
+template<class K, class V>
+V BufferedTreeMap<K, V>::remove(const K& key) {
+	V* found = findHelper(key);
+	if (found == nullptr) {
+		throw std::out_of_range("No such key exists in this tree.");
+	}
+	V retVal = *found;
+	enqueue(key, BufferedMessage{ true, V() });
+	size_--;
+	return retVal;
+}
+
+template<class K, class V>
+V& BufferedTreeMap<K, V>::at(const K& key) const {
+	V* found = findHelper(key);
+	if (found == nullptr) {
+		throw std::out_of_range("No such key exists in this tree.");
+	}
+	return *found;
+}
+
+template<class K, class V>
+unsigned int BufferedTreeMap<K, V>::size() const {
+	if (!sizeKnown_) {
+		unsigned int count = 0;
+		for (auto it = begin(); it != end(); ++it) {
+			count++;
+		}
+		size_ = count;
+		sizeKnown_ = true;
+	}
+	return size_;
+}
+
+template<class K, class V>
+V* BufferedTreeMap<K, V>::findHelper(const K& key) const {
+	BufferedNode* current = root_;
+	// buffers nearer the root hold newer messages, so the first
+	// message found on the way down is the one that counts
+	while (!current->children.empty()) {
+		auto found = current->buffer.find(key);
+		if (found != current->buffer.end()) {
+			return found->second.isDelete ? nullptr : &found->second.value;
+		}
+		current = current->children[route(current, key)];
+	}
+	auto pos = std::lower_bound(current->entries.begin(), current->entries.end(),
+		key, [](const pair<K, V>& entry, const K& k) { return entry.first < k; });
+	if (pos != current->entries.end() && pos->first == key) {
+		return &pos->second;
+	}
+	return nullptr;
+}
+
+template<class K, class V>
+void BufferedTreeMap<K, V>::enqueue(const K& key, const BufferedMessage& message) {
+	if (root_->children.empty()) {  // small tree, no buffers yet
+		pair<const K, BufferedMessage> single(key, message);
+		applyToLeaf(root_, &single, &single + 1);
+	}
+	else {
+		uncountNode(root_);
+		auto inserted = root_->buffer.insert(std::make_pair(key, message));
+		if (!inserted.second) {  // newer message supersedes older one
+			inserted.first->second = message;
+		}
+		countNode(root_);
+		while (root_->buffer.size() > BUFFER_CAPACITY) {
+			flush(root_);
+		}
+	}
+	growRootIfNeeded();
+}
+
+template<class K, class V>
+void BufferedTreeMap<K, V>::growRootIfNeeded() {
+	while (isOverfull(root_)) {
+		BufferedNode* newRoot = new BufferedNode();
+		newRoot->children.push_back(root_);
+		countNode(newRoot);
+		root_ = newRoot;
+		splitOverfull(root_, 0);
+	}
+}
+
+template<class K, class V>
+void BufferedTreeMap<K, V>::flush(BufferedNode* current) {
+	// find the child with the most pending messages; sending the
+	// biggest batch is what makes each flush pay for itself
+	size_t busiest = 0;
+	size_t busiestCount = 0;
+	size_t child = 0;
+	size_t count = 0;
+	for (auto it = current->buffer.begin(); it != current->buffer.end(); ++it) {
+		while (child < current->pivots.size()
+			&& !(it->first < current->pivots[child])) {
+			child++;
+			count = 0;
+		}
+		if (++count > busiestCount) {
+			busiest = child;
+			busiestCount = count;
+		}
+	}
+
+	auto first = busiest == 0 ? current->buffer.begin()
+		: current->buffer.lower_bound(current->pivots[busiest - 1]);
+	auto last = busiest == current->pivots.size() ? current->buffer.end()
+		: current->buffer.lower_bound(current->pivots[busiest]);
+	BufferedNode* target = current->children[busiest];
+
+	if (target->children.empty()) {
+		applyToLeaf(target, first, last);
+	}
+	else {
+		uncountNode(target);
+		for (auto it = first; it != last; ++it) {
+			// messages arriving from above are newer than any
+			// already buffered in target for the same key
+			auto inserted = target->buffer.insert(*it);
+			if (!inserted.second) {
+				inserted.first->second = it->second;
+			}
+		}
+		countNode(target);
+		while (target->buffer.size() > BUFFER_CAPACITY) {
+			flush(target);
+		}
+	}
+	uncountNode(current);
+	current->buffer.erase(first, last);
+
+	if (target->children.empty() && target->entries.empty()
+		&& current->children.size() > 1) {
+		// drop the emptied leaf; its range is absorbed by a neighbour
+		// which is safe since no messages for it remain in current
+		current->pivots.erase(current->pivots.begin()
+			+ (busiest == 0 ? 0 : busiest - 1));
+		current->children.erase(current->children.begin() + busiest);
+		countNode(current);
+		uncountNode(target);
+		delete target;
+	}
+	else {
+		countNode(current);
+		splitOverfull(current, busiest);
+	}
+}
+
+template<class K, class V>
+template<class MessageIt>
+void BufferedTreeMap<K, V>::applyToLeaf(BufferedNode* leaf,
+	MessageIt first, MessageIt last) {
+	uncountNode(leaf);
+	vector<pair<K, V>> merged;
+	merged.reserve(leaf->entries.size() + std::distance(first, last));
+	auto entry = leaf->entries.begin();
+	while (entry != leaf->entries.end() || first != last) {
+		if (first == last
+			|| (entry != leaf->entries.end() && entry->first < first->first)) {
+			merged.push_back(*entry);
+			++entry;
+			continue;
+		}
+		if (entry != leaf->entries.end() && entry->first == first->first) {
+			++entry;  // message overrides the stored entry
+		}
+		if (!first->second.isDelete) {
+			merged.push_back(pair<K, V>(first->first, first->second.value));
+		}
+		++first;
+	}
+	leaf->entries.swap(merged);
+	countNode(leaf);
+}
+
+template<class K, class V>
+void BufferedTreeMap<K, V>::splitChild(BufferedNode* parent, size_t index) {
+	BufferedNode* child = parent->children[index];
+	BufferedNode* sibling = new BufferedNode();
+	uncountNode(parent);
+	uncountNode(child);
+	if (child->children.empty()) {
+		size_t mid = child->entries.size() / 2;
+		parent->pivots.insert(parent->pivots.begin() + index,
+			child->entries[mid].first);
+		sibling->entries.assign(child->entries.begin() + mid,
+			child->entries.end());
+		child->entries.resize(mid);
+	}
+	else {
+		// pivots[mid - 1] moves up to become the separator
+		size_t mid = child->children.size() / 2;
+		parent->pivots.insert(parent->pivots.begin() + index,
+			child->pivots[mid - 1]);
+		sibling->pivots.assign(child->pivots.begin() + mid,
+			child->pivots.end());
+		sibling->children.assign(child->children.begin() + mid,
+			child->children.end());
+		child->pivots.resize(mid - 1);
+		child->children.resize(mid);
+		auto upper = child->buffer.lower_bound(parent->pivots[index]);
+		sibling->buffer.insert(upper, child->buffer.end());
+		child->buffer.erase(upper, child->buffer.end());
+	}
+	parent->children.insert(parent->children.begin() + index + 1, sibling);
+	countNode(parent);
+	countNode(child);
+	countNode(sibling);
+}
+
+template<class K, class V>
+void BufferedTreeMap<K, V>::splitOverfull(BufferedNode* parent, size_t index) {
+	// a big flush can leave a child several times over capacity, and
+	// each half of a split may itself still need splitting
+	size_t last = index + 1;
+	while (index < last) {
+		if (isOverfull(parent->children[index])) {
+			splitChild(parent, index);
+			last++;
+		}
+		else {
+			index++;
+		}
+	}
+}
+
+template<class K, class V>
+BufferedTreeMap<K, V>::BufferedIterator::BufferedIterator(BufferedNode* root,
+	const shared_ptr<std::atomic<size_t>>& tally)
+	: path_(CountingAllocator<pair<BufferedNode*, size_t>>(tally)), leaf_(nullptr),
+	merged_(CountingAllocator<pair<K, V>>(tally)), position_(0) {
+	descendToLeaf(root);
+	if (merged_.empty()) {  // everything here was deleted upstream
+		advanceLeaf();
+	}
+}
+
+template<class K, class V>
+void BufferedTreeMap<K, V>::BufferedIterator::descendToLeaf(BufferedNode* current) {
+	while (!current->children.empty()) {
+		path_.push_back(std::make_pair(current, size_t(0)));
+		current = current->children[0];
+	}
+	leaf_ = current;
+	position_ = 0;
+	mergeLeaf();
+}
+
+template<class K, class V>
+void BufferedTreeMap<K, V>::BufferedIterator::advanceLeaf() {
+	while (!path_.empty()) {
+		pair<BufferedNode*, size_t>& frame = path_.back();
+		if (++frame.second < frame.first->children.size()) {
+			descendToLeaf(frame.first->children[frame.second]);
+			if (!merged_.empty()) {
+				return;
+			}
+		}
+		else {
+			path_.pop_back();
+		}
+	}
+	leaf_ = nullptr;
+	merged_.clear();
+	position_ = 0;
+}
+
+template<class K, class V>
+void BufferedTreeMap<K, V>::BufferedIterator::mergeLeaf() {
+	merged_.assign(leaf_->entries.begin(), leaf_->entries.end());
+	// the leaf's key range is bounded by the tightest pivots on the path
+	const K* lower = nullptr;
+	const K* upper = nullptr;
+	for (auto frame = path_.begin(); frame != path_.end(); ++frame) {
+		if (frame->second > 0) {
+			lower = &frame->first->pivots[frame->second - 1];
+		}
+		if (frame->second < frame->first->pivots.size()) {
+			upper = &frame->first->pivots[frame->second];
+		}
+	}
+	// apply buffers from the deepest (oldest) to the root (newest)
+	for (auto frame = path_.rbegin(); frame != path_.rend(); ++frame) {
+		auto& buffer = frame->first->buffer;
+		auto first = lower == nullptr ? buffer.begin() : buffer.lower_bound(*lower);
+		auto last = upper == nullptr ? buffer.end() : buffer.lower_bound(*upper);
+		if (first == last) {
+			continue;
+		}
+		MergedEntries next(merged_.get_allocator());
+		next.reserve(merged_.size() + std::distance(first, last));
+		auto entry = merged_.begin();
+		while (entry != merged_.end() || first != last) {
+			if (first == last
+				|| (entry != merged_.end() && entry->first < first->first)) {
+				next.push_back(*entry);
+				++entry;
+				continue;
+			}
+			if (entry != merged_.end() && entry->first == first->first) {
+				++entry;
+			}
+			if (!first->second.isDelete) {
+				next.push_back(pair<K, V>(first->first, first->second.value));
+			}
+			++first;
+		}
+		merged_.swap(next);
+	}
+}
+
+template<class K, class V>
+bool BufferedTreeMap<K, V>::BufferedIterator::operator==
+(const BufferedIterator& rhs) const {
+	return leaf_ == rhs.leaf_ && position_ == rhs.position_;
+}
+
+template<class K, class V>
+bool BufferedTreeMap<K, V>::BufferedIterator::operator!=
+(const BufferedIterator& rhs) const {
+	return !(*this == rhs);
+}
+
+template<class K, class V>
+typename BufferedTreeMap<K, V>::BufferedIterator&
+BufferedTreeMap<K, V>::BufferedIterator::operator++() {
+	if (!isLegal()) {
+		throw std::out_of_range("This iterator is past its end.");
+	}
+	if (++position_ == merged_.size()) {
+		advanceLeaf();
+	}
+	return *this;
+}
+
+template<class K, class V>
+typename BufferedTreeMap<K, V>::BufferedIterator
+BufferedTreeMap<K, V>::BufferedIterator::operator++(int) {
+	BufferedIterator tmp(*this);
+	operator++();
+	return tmp;
+}
+
+template<class K, class V>
+const pair<K, V>& BufferedTreeMap<K, V>::BufferedIterator::operator*() const {
+	if (!isLegal()) {
+		throw std::out_of_range("This iterator is past its end.");
+	}
+	return merged_[position_];
+}
+
+template<class K, class V>
+pair<K, V> const* BufferedTreeMap<K, V>::BufferedIterator::operator->() const {
+	if (!isLegal()) {
+		throw std::out_of_range("This iterator is past its end.");
+	}
+	return &merged_[position_];
+}
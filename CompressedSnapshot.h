@@ -0,0 +1,405 @@
+#pragma once
+#include "TreeMap.h"		// TreeMap
+#include "MemoryUsage.h"	// MemoryUsage
+
+#include <vector>		// std::vector
+#include <algorithm>	// std::upper_bound, std::lower_bound
+#include <iostream>		// std::istream, std::ostream
+#include <stdexcept>	// std::out_of_range, std::runtime_error
+#include <type_traits>	// std::is_trivially_copyable
+#include <cstring>		// std::memcmp
+#include <cstdint>		// uint64_t
+#include <climits>		// UINT_MAX
+
+#if defined(__SSE2__)
+#include <emmintrin.h>	// _mm_loadu_si128, _mm_unpacklo_epi8, _mm_add_epi64
+#endif
+
+using std::vector;
+
+// CompressedSnapshot represents a frozen, read-only snapshot of a
+// TreeMap<uint64_t, V> which stores its keys compressed, and which can
+// be saved to and loaded from a stream. The sorted keys are cut into
+// blocks of BLOCK_KEYS, and each block is stored as its first key plus
+// every key's offset from it (frame of reference), all offsets in a
+// block taking the same 1, 2, 4, or 8 bytes, whichever the block's range
+// of keys needs. Keys which sit close together thus take a byte or two
+// each rather than eight. The first keys of the blocks double as an
+// index, so a lookup binary searches them and then decodes a single
+// block, widening its offsets with SSE2 where available. Values are
+// kept uncompressed, in key order.
+
+// Usage Notes Concerning CompressedSnapshot:
+
+// 1. V must be trivially copyable, as values are saved byte for byte
+
+// 2. a saved snapshot can only be loaded on a machine with the same
+// byte order and the same V
+
+// 3. the snapshot is independent of the map it was built from, and
+// does not see later changes to it
+
+template<class V> class CompressedSnapshot {
+	static_assert(std::is_trivially_copyable<V>::value,
+		"CompressedSnapshot saves values byte for byte");
+
+public:
+	// number of keys in every block but the last
+	static const unsigned int BLOCK_KEYS = 128;
+
+	// parameters:
+	// map- map whose contents are to be frozen
+	// constructs snapshot of map's current contents
+	// throws:
+	// bad_alloc if memory for the snapshot cannot be allocated
+	explicit CompressedSnapshot(const TreeMap<uint64_t, V>& map);
+
+	// parameters:
+	// in- stream positioned at a snapshot written by save
+	// constructs snapshot from in
+	// throws:
+	// runtime error if in does not hold a whole, well-formed snapshot,
+	// or bad_alloc if memory for the snapshot cannot be allocated
+	explicit CompressedSnapshot(std::istream& in);
+
+	// parameters:
+	// out- stream which the snapshot is to be written to
+	// modifies:
+	// out to hold the snapshot, in its compressed form
+	// throws:
+	// runtime error if out cannot be written
+	void save(std::ostream& out) const;
+
+	// parameters:
+	// map- map which is to be loaded
+	// modifies:
+	// map to hold exactly the snapshot's pairs, decoding every block and
+	// bulk building the map from them
+	// throws:
+	// bad_alloc if memory runs out, leaving map unchanged
+	void restore(TreeMap<uint64_t, V>* map) const;
+
+	// parameters:
+	// key- key of key-value pair which is to be retrieved
+	// returns:
+	// value corresponding to given key
+	// throws:
+	// out of range exception if no key in snapshot is equal to given key
+	const V& at(uint64_t key) const;
+
+	// parameters:
+	// key- key of key-value pair which is to be retrieved
+	// returns:
+	// pointer to value corresponding to given key,
+	// or nullptr if no key in snapshot is equal to given key
+	const V* find(uint64_t key) const;
+
+	// returns:
+	// number of key-value pairs in snapshot
+	unsigned int size() const { return static_cast<unsigned int>(values_.size()); };
+
+	// returns:
+	// number of blocks the keys are stored in
+	unsigned int blockCount() const {
+		return static_cast<unsigned int>(blockBases_.size());
+	};
+
+	// returns:
+	// breakdown of the memory this snapshot holds. the compressed keys
+	// and the values are counted as nodes and the block index as
+	// auxiliary
+	MemoryUsage memoryUsage() const;
+
+private:
+	// first key of every block, which its other keys are offsets from
+	vector<uint64_t> blockBases_;
+	// bytes taken by each offset of every block
+	vector<unsigned char> blockWidths_;
+	// where each block's offsets begin in packed_, worked out from the
+	// widths rather than stored
+	vector<uint64_t> blockStarts_;
+	// offsets of every block, one after another
+	vector<unsigned char> packed_;
+	// values in order of key
+	vector<V> values_;
+
+	// parameters:
+	// keys- every key, in ascending order
+	// modifies:
+	// snapshot to hold keys compressed into blocks
+	void encode(const vector<uint64_t>& keys);
+
+	// modifies:
+	// blockStarts_ to match blockWidths_
+	// returns:
+	// bytes of packed_ the blocks need in all
+	uint64_t locateBlocks();
+
+	// parameters:
+	// block- index of block which is to be decoded
+	// keys- room for BLOCK_KEYS keys
+	// returns:
+	// number of keys in block
+	// modifies:
+	// keys to begin with the block's keys
+	size_t decodeBlock(size_t block, uint64_t* keys) const;
+
+	// parameters:
+	// offsets- packed offsets which are to be widened
+	// width- bytes each offset takes: 1, 2, 4, or 8, least
+	// significant first
+	// count- number of offsets
+	// base- value every offset is relative to
+	// keys- return parameter for base plus each offset
+	static void decodeOffsets(const unsigned char* offsets, unsigned int width,
+		size_t count, uint64_t base, uint64_t* keys);
+
+	// parameters:
+	// key- key which is to be looked up
+	// returns:
+	// position of key in order of key, or size() if it is absent
+	size_t positionOf(uint64_t key) const;
+};  // end class CompressedSnapshot
+
+// marks the start of a saved snapshot, and its format version
+const char COMPRESSED_SNAPSHOT_MAGIC[8] = { 'T', 'M', 'C', 'S', 'N', 'A', 'P', '1' };
+
+template<class V>
+CompressedSnapshot<V>::CompressedSnapshot(const TreeMap<uint64_t, V>& map) {
+	vector<uint64_t> keys;
+	map.exportColumns(&keys, &values_);
+	encode(keys);
+}
+
+template<class V>
+void CompressedSnapshot<V>::encode(const vector<uint64_t>& keys) {
+	size_t blocks = (keys.size() + BLOCK_KEYS - 1) / BLOCK_KEYS;
+	blockBases_.reserve(blocks);
+	blockWidths_.reserve(blocks);
+	for (size_t first = 0; first < keys.size(); first += BLOCK_KEYS) {
+		size_t last = first + BLOCK_KEYS < keys.size() ? first + BLOCK_KEYS
+			: keys.size();
+		uint64_t range = keys[last - 1] - keys[first];
+		blockBases_.push_back(keys[first]);
+		blockWidths_.push_back(range < (1ull << 8) ? 1 : range < (1ull << 16) ? 2
+			: range < (1ull << 32) ? 4 : 8);
+	}
+	packed_.resize(locateBlocks());
+	for (size_t block = 0; block < blockBases_.size(); block++) {
+		unsigned char* out = packed_.data() + blockStarts_[block];
+		size_t first = block * BLOCK_KEYS;
+		size_t last = first + BLOCK_KEYS < keys.size() ? first + BLOCK_KEYS
+			: keys.size();
+		for (size_t i = first; i < last; i++) {
+			// the low bytes of the offset, least significant first
+			// whatever the byte order of this machine
+			uint64_t offset = keys[i] - blockBases_[block];
+			for (unsigned int byte = 0; byte < blockWidths_[block]; byte++) {
+				*out++ = static_cast<unsigned char>(offset >> (8 * byte));
+			}
+		}
+	}
+}
+
+template<class V>
+uint64_t CompressedSnapshot<V>::locateBlocks() {
+	blockStarts_.resize(blockWidths_.size());
+	uint64_t start = 0;
+	for (size_t block = 0; block < blockWidths_.size(); block++) {
+		blockStarts_[block] = start;
+		size_t count = block + 1 < blockWidths_.size() ? BLOCK_KEYS
+			: values_.size() - block * BLOCK_KEYS;
+		start += count * blockWidths_[block];
+	}
+	return start;
+}
+
+// file layout: the magic bytes, then the number of pairs, sizeof(V),
+// and the byte length of the packed offsets as uint64_t, then the block
+// bases, the block widths, the packed offsets, and the values
+template<class V>
+void CompressedSnapshot<V>::save(std::ostream& out) const {
+	uint64_t header[3] = { values_.size(), sizeof(V), packed_.size() };
+	out.write(COMPRESSED_SNAPSHOT_MAGIC, sizeof(COMPRESSED_SNAPSHOT_MAGIC));
+	out.write(reinterpret_cast<const char*>(header), sizeof(header));
+	out.write(reinterpret_cast<const char*>(blockBases_.data()),
+		blockBases_.size() * sizeof(uint64_t));
+	out.write(reinterpret_cast<const char*>(blockWidths_.data()),
+		blockWidths_.size());
+	out.write(reinterpret_cast<const char*>(packed_.data()), packed_.size());
+	out.write(reinterpret_cast<const char*>(values_.data()),
+		values_.size() * sizeof(V));
+	if (!out) {
+		throw std::runtime_error("Could not write compressed snapshot.");
+	}
+}
+
+template<class V>
+CompressedSnapshot<V>::CompressedSnapshot(std::istream& in) {
+	char magic[sizeof(COMPRESSED_SNAPSHOT_MAGIC)];
+	uint64_t header[3];
+	in.read(magic, sizeof(magic));
+	in.read(reinterpret_cast<char*>(header), sizeof(header));
+	if (!in || std::memcmp(magic, COMPRESSED_SNAPSHOT_MAGIC, sizeof(magic)) != 0
+		|| header[1] != sizeof(V)) {
+		throw std::runtime_error("Malformed compressed snapshot.");
+	}
+	uint64_t count = header[0];
+	uint64_t blocks = (count + BLOCK_KEYS - 1) / BLOCK_KEYS;
+	// no block takes more than 8 bytes per key, so a larger length
+	// can only be corruption
+	if (count > UINT_MAX || header[2] > 8 * count) {
+		throw std::runtime_error("Malformed compressed snapshot.");
+	}
+	blockBases_.resize(blocks);
+	blockWidths_.resize(blocks);
+	values_.resize(count);
+	in.read(reinterpret_cast<char*>(blockBases_.data()), blocks * sizeof(uint64_t));
+	in.read(reinterpret_cast<char*>(blockWidths_.data()), blocks);
+	for (unsigned char width : blockWidths_) {
+		if (width != 1 && width != 2 && width != 4 && width != 8) {
+			throw std::runtime_error("Malformed compressed snapshot.");
+		}
+	}
+	if (!in || locateBlocks() != header[2]) {
+		throw std::runtime_error("Malformed compressed snapshot.");
+	}
+	packed_.resize(header[2]);
+	in.read(reinterpret_cast<char*>(packed_.data()), packed_.size());
+	in.read(reinterpret_cast<char*>(values_.data()), count * sizeof(V));
+	if (!in) {
+		throw std::runtime_error("Malformed compressed snapshot.");
+	}
+}
+
+template<class V>
+void CompressedSnapshot<V>::restore(TreeMap<uint64_t, V>* map) const {
+	vector<uint64_t> keys(values_.size());
+	for (size_t block = 0; block < blockBases_.size(); block++) {
+		decodeBlock(block, keys.data() + block * BLOCK_KEYS);
+	}
+	map->importColumns(keys, values_);
+}
+
+template<class V>
+size_t CompressedSnapshot<V>::decodeBlock(size_t block, uint64_t* keys) const {
+	size_t count = block + 1 < blockBases_.size() ? BLOCK_KEYS
+		: values_.size() - block * BLOCK_KEYS;
+	decodeOffsets(packed_.data() + blockStarts_[block], blockWidths_[block],
+		count, blockBases_[block], keys);
+	return count;
+}
+
+#if defined(__SSE2__)
+// parameters:
+// offsets- four 32-bit offsets
+// base- base in both 64-bit lanes
+// keys- return parameter for base plus each offset
+inline void storeWidened32(__m128i offsets, __m128i base, uint64_t* keys) {
+	__m128i zero = _mm_setzero_si128();
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(keys),
+		_mm_add_epi64(_mm_unpacklo_epi32(offsets, zero), base));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(keys + 2),
+		_mm_add_epi64(_mm_unpackhi_epi32(offsets, zero), base));
+}
+
+// parameters:
+// offsets- eight 16-bit offsets
+// base- base in both 64-bit lanes
+// keys- return parameter for base plus each offset
+inline void storeWidened16(__m128i offsets, __m128i base, uint64_t* keys) {
+	__m128i zero = _mm_setzero_si128();
+	storeWidened32(_mm_unpacklo_epi16(offsets, zero), base, keys);
+	storeWidened32(_mm_unpackhi_epi16(offsets, zero), base, keys + 4);
+}
+#endif
+
+template<class V>
+void CompressedSnapshot<V>::decodeOffsets(const unsigned char* offsets,
+	unsigned int width, size_t count, uint64_t base, uint64_t* keys) {
+	size_t i = 0;
+#if defined(__SSE2__)
+	// widen 16 bytes of offsets at a time, zero-extending each lane
+	// until it is 64 bits wide and then adding the base. SSE2 means x86,
+	// which is little-endian like the packed offsets
+	__m128i bases = _mm_set1_epi64x(static_cast<long long>(base));
+	__m128i zero = _mm_setzero_si128();
+	size_t perLoad = 16 / width;
+	for (; i + perLoad <= count; i += perLoad) {
+		__m128i loaded = _mm_loadu_si128(
+			reinterpret_cast<const __m128i*>(offsets + i * width));
+		switch (width) {
+		case 1:
+			storeWidened16(_mm_unpacklo_epi8(loaded, zero), bases, keys + i);
+			storeWidened16(_mm_unpackhi_epi8(loaded, zero), bases, keys + i + 8);
+			break;
+		case 2:
+			storeWidened16(loaded, bases, keys + i);
+			break;
+		case 4:
+			storeWidened32(loaded, bases, keys + i);
+			break;
+		default:
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(keys + i),
+				_mm_add_epi64(loaded, bases));
+			break;
+		}
+	}
+#endif
+	for (; i < count; i++) {
+		uint64_t offset = 0;
+		for (unsigned int byte = 0; byte < width; byte++) {
+			offset |= static_cast<uint64_t>(offsets[i * width + byte]) << (8 * byte);
+		}
+		keys[i] = base + offset;
+	}
+}
+
+template<class V>
+size_t CompressedSnapshot<V>::positionOf(uint64_t key) const {
+	if (blockBases_.empty() || key < blockBases_.front()) {
+		return values_.size();
+	}
+	size_t block = std::upper_bound(blockBases_.begin(), blockBases_.end(), key)
+		- blockBases_.begin() - 1;
+	uint64_t keys[BLOCK_KEYS];
+	size_t count = decodeBlock(block, keys);
+	const uint64_t* found = std::lower_bound(keys, keys + count, key);
+	if (found == keys + count || *found != key) {
+		return values_.size();
+	}
+	return block * BLOCK_KEYS + (found - keys);
+}
+
+template<class V>
+const V& CompressedSnapshot<V>::at(uint64_t key) const {
+	size_t position = positionOf(key);
+	if (position == values_.size()) {
+		throw std::out_of_range("No such key exists in this snapshot.");
+	}
+	return values_[position];
+}
+
+template<class V>
+const V* CompressedSnapshot<V>::find(uint64_t key) const {
+	size_t position = positionOf(key);
+	return position == values_.size() ? nullptr : &values_[position];
+}
+
+template<class V>
+MemoryUsage CompressedSnapshot<V>::memoryUsage() const {
+	MemoryUsage usage = MemoryUsage();
+	size_t keyBytes = packed_.size();
+	size_t valueBytes = values_.size() * sizeof(V);
+	usage.nodeBytes = keyBytes + valueBytes;
+	usage.slackBytes = (packed_.capacity() - packed_.size())
+		+ (values_.capacity() - values_.size()) * sizeof(V);
+	usage.auxiliaryBytes = blockBases_.capacity() * sizeof(uint64_t)
+		+ blockWidths_.capacity() + blockStarts_.capacity() * sizeof(uint64_t);
+	usage.iteratorBytes = 0;
+	usage.nodeTypes.push_back(
+		MemoryUsage::NodeTypeUsage{ "packed key", values_.size(), keyBytes });
+	usage.nodeTypes.push_back(
+		MemoryUsage::NodeTypeUsage{ "value", values_.size(), valueBytes });
+	return usage;
+}
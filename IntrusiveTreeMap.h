@@ -0,0 +1,471 @@
+#pragma once
+#include <iterator>		// std::iterator, std::forward_iterator_tag
+#include <stdexcept>	// std::out_of_range
+
+// IntrusiveTreeMap represents a map over objects which the caller owns.
+// Rather than copying each key and value into a node of its own, the map
+// links the caller's objects together through a TreeHook embedded in
+// each of them, so linking and unlinking never allocate or copy anything.
+// A KeyOf functor finds the key within an object. The tree is kept an
+// AVL tree, whose heights fit in the hook's single byte of balance data.
+
+// Usage Notes Concerning IntrusiveTreeMap and IntrusiveIterator:
+
+// 1. class K must support the <, >, and == operators, and
+// KeyOf must be callable as const K& (const T&)
+
+// 2. an object may be linked into at most one map through each of its
+// hooks, must not move while linked, and must be unlinked (or the map
+// cleared) before it is destroyed
+
+// 3. if any object's key is altered while it is linked,
+// all behavior guarantees are immediately
+// and permanently nullified
+
+// 4. if the tree is modified after an iterator is constructed,
+// said iterator is invalid and its behavior is not guaranteed.
+
+// 5. the map never allocates, iterators included
+
+// links which let an object of type T join an IntrusiveTreeMap
+template<class T> struct TreeHook {
+	T* left;
+	T* right;
+	// number of nodes on the longest path down from here, at most
+	// about 1.44 * log2(size) in an AVL tree
+	unsigned char height;
+};
+
+template<class K, class T, class KeyOf, TreeHook<T> T::* Hook = &T::hook>
+class IntrusiveTreeMap {
+public:
+	// tallest an AVL tree can grow while holding fewer than 2^64 objects
+	static const unsigned int MAX_HEIGHT = 96;
+
+private:
+	// a forward iterator for IntrusiveTreeMap which performs an in-order
+	// traversal, keeping its path in place rather than on the heap
+	class IntrusiveIterator :
+		public std::iterator<std::forward_iterator_tag, T> {
+	public:
+		// constructs iterator of the subtree for which root is the root
+		explicit IntrusiveIterator(T* root);
+
+		// constructor for past-the-end iterator
+		IntrusiveIterator() : depth_(0) {};
+
+		// comparison operators.
+		// two iterators are equal if they are at an identical
+		// position in the same instance of a map
+		// or if they are both past-the-end
+		bool operator==(const IntrusiveIterator& rhs) const;
+		bool operator!=(const IntrusiveIterator& rhs) const;
+
+		// basic accessors
+		// each throws out of range exception if
+		// called when iterator is past-the-end
+		T& operator*() const;
+		T* operator->() const;
+
+		// pre and postfix incrementers
+		// each throws out of range exception if
+		// called when iterator is past-the-end
+		IntrusiveIterator& operator++();
+		IntrusiveIterator operator++(int);
+
+		// returns:
+		// true iff iterator is in legal state to be dereferenced
+		bool isLegal() const { return depth_ != 0; };
+
+	private:
+		// ancestors still to be visited, the current object on top
+		T* path_[MAX_HEIGHT];
+		unsigned int depth_;
+	};  // end class IntrusiveIterator
+
+public:
+	// parameters:
+	// keyOf- extracts the key of an object
+	// constructs empty IntrusiveTreeMap
+	explicit IntrusiveTreeMap(const KeyOf& keyOf = KeyOf())
+		: size_(0), root_(nullptr), keyOf_(keyOf) {};
+
+	IntrusiveTreeMap(const IntrusiveTreeMap&) = delete;
+	IntrusiveTreeMap& operator=(const IntrusiveTreeMap&) = delete;
+
+	// parameters:
+	// object- object which is to be linked in, whose hook is not in use
+	// returns:
+	// true if no object with an equivalent key was linked already
+	// else returns false
+	// modifies:
+	// map to contain object if its key is not present, and object's hook
+	bool link(T& object);
+
+	// parameters:
+	// key- key of object which is to be unlinked
+	// returns:
+	// the object which was unlinked
+	// modifies:
+	// map to no longer contain the object
+	// throws:
+	// out of range exception if no key in map is equivalent to given key
+	T& unlink(const K& key);
+
+	// parameters:
+	// key- key of object which is to be retrieved
+	// returns:
+	// object with given key
+	// throws:
+	// out of range exception if no key in map is equivalent to given key
+	T& at(const K& key) const;
+
+	// parameters:
+	// key- key of object which is to be retrieved
+	// returns:
+	// pointer to object with given key,
+	// or nullptr if no key in map is equivalent to given key
+	T* find(const K& key) const;
+
+	// modifies:
+	// map to be empty and every object it held to have an unused hook
+	void clear();
+
+	// returns:
+	// number of objects in map
+	unsigned int size() const { return size_; };
+
+	// returns:
+	// number of objects on the longest path from the root to a leaf
+	unsigned int height() const { return heightOf(root_); };
+
+	// returns:
+	// iterator to beginning of tree, which performs in-order traversal
+	IntrusiveIterator begin() const { return IntrusiveIterator(root_); };
+
+	// returns:
+	// past-the-end iterator for use in comparison
+	IntrusiveIterator end() const { return IntrusiveIterator(); };
+
+private:
+	unsigned int size_;
+	T* root_;
+	KeyOf keyOf_;
+
+	// parameters:
+	// object- object in the tree
+	// returns:
+	// the hook through which object is linked
+	static TreeHook<T>& hookOf(T* object) { return object->*Hook; };
+
+	// returns:
+	// height of the subtree rooted at object, 0 if object is nullptr
+	static unsigned int heightOf(T* object) {
+		return object == nullptr ? 0 : hookOf(object).height;
+	};
+
+	// parameters:
+	// current- root of subtree which is being linked into
+	// object- object which is being linked
+	// success- return parameter for whether the link succeeded
+	// returns:
+	// root of newly modified subtree
+	T* linkHelper(T* current, T* object, bool* success);
+
+	// parameters:
+	// current- root of subtree which is being unlinked from
+	// key- key of object which is to be unlinked
+	// unlinked- return parameter for the object unlinked
+	// returns:
+	// root of newly modified subtree
+	// throws:
+	// out of range exception if no key match is found
+	T* unlinkHelper(T* current, const K& key, T** unlinked);
+
+	// parameters:
+	// current- root of nonempty subtree whose minimum is to be detached
+	// minimum- return parameter for the detached object
+	// returns:
+	// root of the subtree without its minimum
+	static T* detachMinimum(T* current, T** minimum);
+
+	// parameters:
+	// current- object whose subtrees are AVL trees differing in height
+	// by at most 2
+	// returns:
+	// root of current's subtree after at most one single or double
+	// rotation, with its height up to date
+	static T* rebalance(T* current);
+
+	// parameters:
+	// current- object whose right child takes its place
+	// returns:
+	// current's former right child, with heights of both updated
+	static T* rotateLeft(T* current);
+
+	// parameters:
+	// current- object whose left child takes its place
+	// returns:
+	// current's former left child, with heights of both updated
+	static T* rotateRight(T* current);
+
+	// modifies:
+	// object's height to be one more than its taller child's
+	static void updateHeight(T* object);
+
+	// parameters:
+	// current- root of subtree whose hooks are to be reset
+	static void clearHelper(T* current);
+};  // end class IntrusiveTreeMap
+
+template<class K, class T, class KeyOf, TreeHook<T> T::* Hook>
+bool IntrusiveTreeMap<K, T, KeyOf, Hook>::link(T& object) {
+	TreeHook<T>& hook = hookOf(&object);
+	hook.left = nullptr;
+	hook.right = nullptr;
+	hook.height = 1;
+	bool success;
+	root_ = linkHelper(root_, &object, &success);
+	if (success) {
+		size_++;
+	}
+	return success;
+}
+
+template<class K, class T, class KeyOf, TreeHook<T> T::* Hook>
+T* IntrusiveTreeMap<K, T, KeyOf, Hook>::linkHelper(T* current, T* object,
+	bool* success) {
+	if (current == nullptr) {  // reached location where object belongs
+		*success = true;
+		return object;
+	}
+	const K& key = keyOf_(*object);
+	if (keyOf_(*current) < key) {
+		hookOf(current).right = linkHelper(hookOf(current).right, object, success);
+	}
+	else if (keyOf_(*current) > key) {
+		hookOf(current).left = linkHelper(hookOf(current).left, object, success);
+	}
+	else {  // key collision, tree will not be altered
+		*success = false;
+		return current;
+	}
+	return *success ? rebalance(current) : current;
+}
+
+template<class K, class T, class KeyOf, TreeHook<T> T::* Hook>
+T& IntrusiveTreeMap<K, T, KeyOf, Hook>::unlink(const K& key) {
+	T* unlinked;
+	root_ = unlinkHelper(root_, key, &unlinked);
+	size_--;
+	TreeHook<T>& hook = hookOf(unlinked);
+	hook.left = nullptr;
+	hook.right = nullptr;
+	hook.height = 0;
+	return *unlinked;
+}
+
+template<class K, class T, class KeyOf, TreeHook<T> T::* Hook>
+T* IntrusiveTreeMap<K, T, KeyOf, Hook>::unlinkHelper(T* current, const K& key,
+	T** unlinked) {
+	if (current == nullptr) {  // given key was bad
+		throw std::out_of_range("No such key exists in this tree.");
+	}
+	if (keyOf_(*current) < key) {
+		hookOf(current).right = unlinkHelper(hookOf(current).right, key, unlinked);
+	}
+	else if (keyOf_(*current) > key) {
+		hookOf(current).left = unlinkHelper(hookOf(current).left, key, unlinked);
+	}
+	else {
+		*unlinked = current;
+		TreeHook<T>& hook = hookOf(current);
+		if (hook.left == nullptr) {
+			return hook.right;
+		}
+		if (hook.right == nullptr) {
+			return hook.left;
+		}
+		// the in-order successor takes current's place
+		T* successor;
+		T* rightSubtree = detachMinimum(hook.right, &successor);
+		hookOf(successor).left = hook.left;
+		hookOf(successor).right = rightSubtree;
+		return rebalance(successor);
+	}
+	return rebalance(current);
+}
+
+template<class K, class T, class KeyOf, TreeHook<T> T::* Hook>
+T* IntrusiveTreeMap<K, T, KeyOf, Hook>::detachMinimum(T* current, T** minimum) {
+	if (hookOf(current).left == nullptr) {
+		*minimum = current;
+		return hookOf(current).right;
+	}
+	hookOf(current).left = detachMinimum(hookOf(current).left, minimum);
+	return rebalance(current);
+}
+
+template<class K, class T, class KeyOf, TreeHook<T> T::* Hook>
+T* IntrusiveTreeMap<K, T, KeyOf, Hook>::rebalance(T* current) {
+	TreeHook<T>& hook = hookOf(current);
+	unsigned int left = heightOf(hook.left);
+	unsigned int right = heightOf(hook.right);
+	if (left > right + 1) {
+		TreeHook<T>& child = hookOf(hook.left);
+		if (heightOf(child.left) < heightOf(child.right)) {
+			hook.left = rotateLeft(hook.left);
+		}
+		return rotateRight(current);
+	}
+	if (right > left + 1) {
+		TreeHook<T>& child = hookOf(hook.right);
+		if (heightOf(child.right) < heightOf(child.left)) {
+			hook.right = rotateRight(hook.right);
+		}
+		return rotateLeft(current);
+	}
+	updateHeight(current);
+	return current;
+}
+
+template<class K, class T, class KeyOf, TreeHook<T> T::* Hook>
+T* IntrusiveTreeMap<K, T, KeyOf, Hook>::rotateLeft(T* current) {
+	T* rightChild = hookOf(current).right;
+	hookOf(current).right = hookOf(rightChild).left;
+	hookOf(rightChild).left = current;
+	updateHeight(current);
+	updateHeight(rightChild);
+	return rightChild;
+}
+
+template<class K, class T, class KeyOf, TreeHook<T> T::* Hook>
+T* IntrusiveTreeMap<K, T, KeyOf, Hook>::rotateRight(T* current) {
+	T* leftChild = hookOf(current).left;
+	hookOf(current).left = hookOf(leftChild).right;
+	hookOf(leftChild).right = current;
+	updateHeight(current);
+	updateHeight(leftChild);
+	return leftChild;
+}
+
+template<class K, class T, class KeyOf, TreeHook<T> T::* Hook>
+void IntrusiveTreeMap<K, T, KeyOf, Hook>::updateHeight(T* object) {
+	TreeHook<T>& hook = hookOf(object);
+	unsigned int left = heightOf(hook.left);
+	unsigned int right = heightOf(hook.right);
+	hook.height = static_cast<unsigned char>(1 + (left > right ? left : right));
+}
+
+template<class K, class T, class KeyOf, TreeHook<T> T::* Hook>
+T& IntrusiveTreeMap<K, T, KeyOf, Hook>::at(const K& key) const {
+	T* found = find(key);
+	if (found == nullptr) {
+		throw std::out_of_range("No such key exists in this tree.");
+	}
+	return *found;
+}
+
+template<class K, class T, class KeyOf, TreeHook<T> T::* Hook>
+T* IntrusiveTreeMap<K, T, KeyOf, Hook>::find(const K& key) const {
+	T* current = root_;
+	while (current != nullptr) {
+		if (keyOf_(*current) < key) {
+			current = hookOf(current).right;
+		}
+		else if (keyOf_(*current) > key) {
+			current = hookOf(current).left;
+		}
+		else {
+			return current;
+		}
+	}
+	return nullptr;
+}
+
+template<class K, class T, class KeyOf, TreeHook<T> T::* Hook>
+void IntrusiveTreeMap<K, T, KeyOf, Hook>::clear() {
+	clearHelper(root_);
+	root_ = nullptr;
+	size_ = 0;
+}
+
+template<class K, class T, class KeyOf, TreeHook<T> T::* Hook>
+void IntrusiveTreeMap<K, T, KeyOf, Hook>::clearHelper(T* current) {
+	if (current != nullptr) {
+		TreeHook<T>& hook = hookOf(current);
+		clearHelper(hook.left);
+		clearHelper(hook.right);
+		hook.left = nullptr;
+		hook.right = nullptr;
+		hook.height = 0;
+	}
+}
+
+template<class K, class T, class KeyOf, TreeHook<T> T::* Hook>
+IntrusiveTreeMap<K, T, KeyOf, Hook>::IntrusiveIterator::IntrusiveIterator(T* root)
+	: depth_(0) {
+	while (root != nullptr) {
+		// to perform in-order traversal we must start
+		// in the most left ancestor of the root
+		// but remember those seen along the way
+		path_[depth_++] = root;
+		root = hookOf(root).left;
+	}
+}
+
+template<class K, class T, class KeyOf, TreeHook<T> T::* Hook>
+bool IntrusiveTreeMap<K, T, KeyOf, Hook>::IntrusiveIterator::operator==(
+	const IntrusiveIterator& rhs) const {
+	// the current object determines the rest of the path
+	if (depth_ == 0 || rhs.depth_ == 0) {
+		return depth_ == rhs.depth_;
+	}
+	return path_[depth_ - 1] == rhs.path_[rhs.depth_ - 1];
+}
+
+template<class K, class T, class KeyOf, TreeHook<T> T::* Hook>
+bool IntrusiveTreeMap<K, T, KeyOf, Hook>::IntrusiveIterator::operator!=(
+	const IntrusiveIterator& rhs) const {
+	return !(*this == rhs);
+}
+
+template<class K, class T, class KeyOf, TreeHook<T> T::* Hook>
+T& IntrusiveTreeMap<K, T, KeyOf, Hook>::IntrusiveIterator::operator*() const {
+	if (!isLegal()) {
+		throw std::out_of_range("This iterator is past its end.");
+	}
+	return *path_[depth_ - 1];
+}
+
+template<class K, class T, class KeyOf, TreeHook<T> T::* Hook>
+T* IntrusiveTreeMap<K, T, KeyOf, Hook>::IntrusiveIterator::operator->() const {
+	if (!isLegal()) {
+		throw std::out_of_range("This iterator is past its end.");
+	}
+	return path_[depth_ - 1];
+}
+
+template<class K, class T, class KeyOf, TreeHook<T> T::* Hook>
+typename IntrusiveTreeMap<K, T, KeyOf, Hook>::IntrusiveIterator&
+IntrusiveTreeMap<K, T, KeyOf, Hook>::IntrusiveIterator::operator++() {
+	if (!isLegal()) {
+		throw std::out_of_range("This iterator is past its end.");
+	}
+	T* current = hookOf(path_[--depth_]).right;
+	// if possible move to right child once
+	// then move left as many times as possible
+	while (current != nullptr) {
+		path_[depth_++] = current;
+		current = hookOf(current).left;
+	}
+	return *this;
+}
+
+template<class K, class T, class KeyOf, TreeHook<T> T::* Hook>
+typename IntrusiveTreeMap<K, T, KeyOf, Hook>::IntrusiveIterator
+IntrusiveTreeMap<K, T, KeyOf, Hook>::IntrusiveIterator::operator++(int) {
+	IntrusiveIterator tmp(*this);
+	operator++();
+	return tmp;
+}
@@ -0,0 +1,211 @@
+#pragma once
+#include "TreeMap.h"		// TreeMap
+#include "MemoryUsage.h"	// MemoryUsage
+
+#include <vector>		// std::vector
+#include <algorithm>	// std::lower_bound, std::upper_bound
+#include <stdexcept>	// std::out_of_range
+#include <cstdint>		// uint64_t
+
+using std::vector;
+
+// LearnedIndexMap represents a frozen, read-only snapshot of a
+// TreeMap<uint64_t, V>. The keys are stored sorted in one array and
+// located by a learned index: a piecewise-linear model of where each
+// key sits in that array, built so that every prediction is within
+// ERROR_BOUND slots of the truth (as in a PGM index). A lookup is a
+// binary search over the few segment boundaries, one multiply-add, and
+// a binary search over a window of 2 * ERROR_BOUND keys, which touches
+// far fewer cache lines than a descent through millions of tree nodes.
+// The model itself costs a handful of bytes per segment rather than
+// the two pointers per key a tree spends on links.
+
+// Usage Notes Concerning LearnedIndexMap:
+
+// 1. V must be copy constructible
+
+// 2. the snapshot is independent of the map it was built from, and
+// does not see later changes to it
+
+template<class V> class LearnedIndexMap {
+public:
+	// every key's position is predicted to within this many slots
+	static const unsigned int ERROR_BOUND = 32;
+
+	// parameters:
+	// map- map whose contents are to be frozen
+	// constructs snapshot of map's current contents
+	// throws:
+	// bad_alloc if memory for the snapshot cannot be allocated
+	explicit LearnedIndexMap(const TreeMap<uint64_t, V>& map);
+
+	// parameters:
+	// key- key of key-value pair which is to be retrieved
+	// returns:
+	// value corresponding to given key
+	// throws:
+	// out of range exception if no key in snapshot is equal to given key
+	const V& at(uint64_t key) const;
+
+	// parameters:
+	// key- key of key-value pair which is to be retrieved
+	// returns:
+	// pointer to value corresponding to given key,
+	// or nullptr if no key in snapshot is equal to given key
+	const V* find(uint64_t key) const;
+
+	// returns:
+	// number of key-value pairs in snapshot
+	unsigned int size() const { return static_cast<unsigned int>(keys_.size()); };
+
+	// returns:
+	// number of linear pieces the model needed
+	unsigned int segmentCount() const {
+		return static_cast<unsigned int>(segmentKeys_.size());
+	};
+
+	// returns:
+	// breakdown of the memory this snapshot holds. the keys and values
+	// are counted as nodes and the model as auxiliary
+	MemoryUsage memoryUsage() const;
+
+private:
+	// a line predicting the position of every key from firstKey up to
+	// the next segment's first key
+	typedef struct Segment {
+		double slope;
+		// position of the segment's first key
+		unsigned int firstPosition;
+	} LearnedSegment;
+
+	// sorted keys of the snapshot, and their values in the same order
+	vector<uint64_t> keys_;
+	vector<V> values_;
+	// first key covered by each segment, kept apart from the segments
+	// so that the search for the right one reads nothing else
+	vector<uint64_t> segmentKeys_;
+	vector<LearnedSegment> segments_;
+
+	// modifies:
+	// snapshot to have a model of keys_, built greedily: each segment is
+	// extended for as long as some slope keeps every key it covers within
+	// ERROR_BOUND of its position (the "shrinking cone" method)
+	void buildModel();
+
+	// parameters:
+	// key- key which is to be looked up
+	// returns:
+	// position of key in keys_, or keys_.size() if it is absent
+	size_t positionOf(uint64_t key) const;
+};  // end class LearnedIndexMap
+
+template<class V>
+LearnedIndexMap<V>::LearnedIndexMap(const TreeMap<uint64_t, V>& map) {
+	keys_.reserve(map.size());
+	values_.reserve(map.size());
+	for (auto it = map.begin(); it != map.end(); ++it) {
+		keys_.push_back(it->first);
+		values_.push_back(it->second);
+	}
+	buildModel();
+}
+
+template<class V>
+void LearnedIndexMap<V>::buildModel() {
+	size_t first = 0;
+	while (first < keys_.size()) {
+		// the slopes which keep every key so far within the bound
+		double lowest = 0;
+		double highest = 1e300;
+		size_t next = first + 1;
+		while (next < keys_.size()) {
+			double run = double(keys_[next] - keys_[first]);
+			double rise = double(next - first);
+			double low = (rise - ERROR_BOUND) / run;
+			double high = (rise + ERROR_BOUND) / run;
+			if (low > highest || high < lowest) {
+				break;
+			}
+			if (low > lowest) {
+				lowest = low;
+			}
+			if (high < highest) {
+				highest = high;
+			}
+			next++;
+		}
+		double slope = next == first + 1 ? 0 : (lowest + highest) / 2;
+		segmentKeys_.push_back(keys_[first]);
+		segments_.push_back(LearnedSegment{ slope,
+			static_cast<unsigned int>(first) });
+		first = next;
+	}
+}
+
+template<class V>
+size_t LearnedIndexMap<V>::positionOf(uint64_t key) const {
+	if (keys_.empty() || key < keys_.front() || key > keys_.back()) {
+		return keys_.size();
+	}
+	size_t segment = std::upper_bound(segmentKeys_.begin(), segmentKeys_.end(),
+		key) - segmentKeys_.begin() - 1;
+	const LearnedSegment& line = segments_[segment];
+	size_t segmentEnd = segment + 1 < segments_.size()
+		? segments_[segment + 1].firstPosition : keys_.size();
+	// a key missing from a wide gap can be predicted far past the end
+	// of its segment, so clamp the prediction before converting it
+	double offset = line.slope * double(key - segmentKeys_[segment]);
+	double span = double(segmentEnd - line.firstPosition - 1);
+	if (!(offset >= 0)) {
+		offset = 0;
+	}
+	else if (offset > span) {
+		offset = span;
+	}
+	// rounding in the model costs a slot or so on top of the bound
+	size_t predicted = line.firstPosition + static_cast<size_t>(offset);
+	size_t low = predicted > line.firstPosition + ERROR_BOUND + 2
+		? predicted - ERROR_BOUND - 2 : line.firstPosition;
+	size_t high = predicted + ERROR_BOUND + 3;
+	if (high > segmentEnd) {
+		high = segmentEnd;
+	}
+	auto found = std::lower_bound(keys_.begin() + low, keys_.begin() + high, key);
+	if (found == keys_.begin() + high || *found != key) {
+		return keys_.size();
+	}
+	return found - keys_.begin();
+}
+
+template<class V>
+const V& LearnedIndexMap<V>::at(uint64_t key) const {
+	size_t position = positionOf(key);
+	if (position == keys_.size()) {
+		throw std::out_of_range("No such key exists in this snapshot.");
+	}
+	return values_[position];
+}
+
+template<class V>
+const V* LearnedIndexMap<V>::find(uint64_t key) const {
+	size_t position = positionOf(key);
+	return position == keys_.size() ? nullptr : &values_[position];
+}
+
+template<class V>
+MemoryUsage LearnedIndexMap<V>::memoryUsage() const {
+	MemoryUsage usage = MemoryUsage();
+	size_t keyBytes = keys_.size() * sizeof(uint64_t);
+	size_t valueBytes = values_.size() * sizeof(V);
+	usage.nodeBytes = keyBytes + valueBytes;
+	usage.slackBytes = (keys_.capacity() - keys_.size()) * sizeof(uint64_t)
+		+ (values_.capacity() - values_.size()) * sizeof(V);
+	usage.auxiliaryBytes = segmentKeys_.capacity() * sizeof(uint64_t)
+		+ segments_.capacity() * sizeof(LearnedSegment);
+	usage.iteratorBytes = 0;
+	usage.nodeTypes.push_back(
+		MemoryUsage::NodeTypeUsage{ "key", keys_.size(), keyBytes });
+	usage.nodeTypes.push_back(
+		MemoryUsage::NodeTypeUsage{ "value", values_.size(), valueBytes });
+	return usage;
+}
@@ -0,0 +1,283 @@
+#pragma once
+#include "TreeMap.h"		// TreeMap
+#include "MemoryUsage.h"	// MemoryUsage
+
+#include <atomic>		// std::atomic
+#include <mutex>		// std::mutex, std::lock_guard
+#include <thread>		// std::this_thread::yield, std::this_thread::get_id
+#include <functional>	// std::hash
+#include <utility>		// std::declval
+#include <type_traits>	// std::decay
+#include <stdexcept>	// std::out_of_range
+#include <new>			// std::bad_alloc
+
+// LeftRightTreeMap represents a map which any number of threads may
+// read while one thread at a time writes, with reads that are wait-free
+// and never see a half-made change. It keeps two replicas of the map,
+// one of which readers are pointed at (the Left-Right technique). A
+// write is applied to the other replica, readers are then pointed at
+// that one, and once every reader still on the old replica has left it
+// the write is replayed there, so the two stay identical. A reader only
+// increments a counter, reads, and decrements it again: it never waits,
+// retries, or takes a lock, and no node is ever freed while a reader
+// might hold it, without any epochs or hazard pointers. The price is
+// twice the memory and twice the work per write, which suits small to
+// medium maps whose reads far outnumber their writes.
+
+// Usage Notes Concerning LeftRightTreeMap:
+
+// 1. class K must support the <, >, and == operators, and V must be
+// copy constructible, since at() returns values by copy
+
+// 2. writes are serialized with each other and wait for every read
+// which began before them to finish, so a read must not wait for a
+// write
+
+// 3. read() hands its callable the map itself, which other reads may be
+// using at the same time, so the callable may only use const members
+// which write nothing to the map. that rules out forEachInOrder, which
+// threads the tree as it walks. at, find, and contains write hit counts
+// while access sampling is on, but the replicas are never sampled, so
+// they are safe, as are scan and scanFrom, which only charge an atomic
+// tally
+
+template<class K, class V> class LeftRightTreeMap {
+public:
+	// parameters:
+	// policy- how both replicas keep themselves balanced
+	// constructs empty map
+	// throws:
+	// bad_alloc if the replicas' arenas cannot be allocated
+	explicit LeftRightTreeMap(typename TreeMap<K, V>::BalancePolicy policy
+		= TreeMap<K, V>::PartialRebuild);
+
+	// parameters:
+	// key- key of the new pair
+	// value- value paired with key
+	// returns:
+	// true if there was enough space to allocate another node in each
+	// replica AND this key is not equivalent to one in this map already
+	// else returns false
+	// modifies:
+	// map to contain given key-value pair if equal key is not present
+	bool add(const K& key, const V& value);
+
+	// parameters:
+	// key- key of key-value pair which is to be removed
+	// returns:
+	// value corresponding to given key
+	// modifies:
+	// map to no longer contain key-value pair
+	// throws:
+	// out of range exception if no key in map is equal to given key
+	V remove(const K& key);
+
+	// parameters:
+	// key- key of key-value pair which is to be retrieved
+	// returns:
+	// copy of the value corresponding to given key, wait-free
+	// throws:
+	// out of range exception if no key in map is equivalent to given key
+	V at(const K& key) const {
+		return read([&key](const TreeMap<K, V>& map) { return map.at(key); });
+	};
+
+	// parameters:
+	// key- key of key-value pair which is to be looked for
+	// returns:
+	// true iff some key in map is equivalent to given key, wait-free
+	bool contains(const K& key) const {
+		return read([&key](const TreeMap<K, V>& map) { return map.contains(key); });
+	};
+
+	// returns:
+	// number of key-value pairs in map, wait-free
+	unsigned int size() const {
+		return read([](const TreeMap<K, V>& map) { return map.size(); });
+	};
+
+	// parameters:
+	// reader- callable as reader(const TreeMap<K, V>&)
+	// returns:
+	// what reader returns, by value, so that nothing it returns can
+	// refer into the map once the read is over
+	// modifies:
+	// nothing. calls reader on a consistent replica of the map, which
+	// no write will change until reader returns. wait-free if reader is
+	template<class Reader>
+	auto read(Reader reader) const -> typename std::decay<
+		decltype(reader(std::declval<const TreeMap<K, V>&>()))>::type;
+
+	// returns:
+	// breakdown of the memory both replicas hold
+	MemoryUsage memoryUsage() const;
+
+private:
+	// counters of readers in each version are spread over this many
+	// cache lines, so that readers on different cores rarely share one
+	static const unsigned int READER_STRIPES = 16;
+
+	// a count of readers, alone on its cache line
+	struct alignas(64) ReaderCount {
+		std::atomic<long> count;
+	};
+
+	// keeps a reader counted for as long as it exists
+	class ReadSection {
+	public:
+		// constructs section counting the calling thread as a reader of
+		// the map's current version
+		explicit ReadSection(const LeftRightTreeMap* map);
+		~ReadSection() { count_->fetch_sub(1); };
+
+	private:
+		std::atomic<long>* count_;
+	};  // end class ReadSection
+
+	// the two replicas
+	TreeMap<K, V> left_;
+	TreeMap<K, V> right_;
+	// the replica which readers use: 0 for left_, 1 for right_
+	std::atomic<unsigned int> readable_;
+	// which row of readerCounts_ new readers count themselves in
+	std::atomic<unsigned int> version_;
+	mutable ReaderCount readerCounts_[2][READER_STRIPES];
+	// serializes writers
+	mutable std::mutex writeMutex_;
+
+	// parameters:
+	// which- 0 or 1
+	// returns:
+	// left_ or right_ respectively
+	TreeMap<K, V>& replica(unsigned int which) { return which == 0 ? left_ : right_; };
+	const TreeMap<K, V>& replica(unsigned int which) const {
+		return which == 0 ? left_ : right_;
+	};
+
+	// modifies:
+	// nothing. returns once every reader which may still be using the
+	// replica readers were last pointed away from has finished
+	void waitForReaders();
+
+	// parameters:
+	// version- row of readerCounts_
+	// returns:
+	// true iff no reader is counted in version
+	bool isEmpty(unsigned int version) const;
+
+	// returns:
+	// stripe of readerCounts_ the calling thread counts itself in
+	static unsigned int stripeOfThread();
+};  // end class LeftRightTreeMap
+
+template<class K, class V>
+LeftRightTreeMap<K, V>::LeftRightTreeMap(
+	typename TreeMap<K, V>::BalancePolicy policy)
+	: left_(NodeArena::Heap, policy), right_(NodeArena::Heap, policy),
+	readable_(0), version_(0) {
+	for (unsigned int version = 0; version < 2; version++) {
+		for (unsigned int stripe = 0; stripe < READER_STRIPES; stripe++) {
+			readerCounts_[version][stripe].count = 0;
+		}
+	}
+	// a node for the first replay, after which every add reserves the
+	// node its replica will next be replayed onto
+	left_.reserve(1);
+	right_.reserve(1);
+}
+
+template<class K, class V>
+bool LeftRightTreeMap<K, V>::add(const K& key, const V& value) {
+	std::lock_guard<std::mutex> lock(writeMutex_);
+	unsigned int readable = readable_.load();
+	TreeMap<K, V>& writable = replica(1 - readable);
+	// the replay below must not fail once readers can see the new pair,
+	// so make sure of the node it needs now. no reader is on writable,
+	// and it is next replayed onto after the one that follows
+	try {
+		writable.reserve(2);
+	}
+	catch (std::bad_alloc&) {
+		return false;
+	}
+	if (!writable.add(key, value)) {
+		return false;
+	}
+	readable_.store(1 - readable);
+	waitForReaders();
+	replica(readable).add(key, value);
+	return true;
+}
+
+template<class K, class V>
+V LeftRightTreeMap<K, V>::remove(const K& key) {
+	std::lock_guard<std::mutex> lock(writeMutex_);
+	unsigned int readable = readable_.load();
+	V removed = replica(1 - readable).remove(key);
+	readable_.store(1 - readable);
+	waitForReaders();
+	replica(readable).remove(key);
+	return removed;
+}
+
+template<class K, class V>
+template<class Reader>
+auto LeftRightTreeMap<K, V>::read(Reader reader) const -> typename std::decay<
+	decltype(reader(std::declval<const TreeMap<K, V>&>()))>::type {
+	ReadSection section(this);
+	return reader(replica(readable_.load()));
+}
+
+template<class K, class V>
+LeftRightTreeMap<K, V>::ReadSection::ReadSection(const LeftRightTreeMap* map)
+	: count_(&map->readerCounts_[map->version_.load()][stripeOfThread()].count) {
+	count_->fetch_add(1);
+}
+
+template<class K, class V>
+void LeftRightTreeMap<K, V>::waitForReaders() {
+	// readers which counted themselves before readable_ changed may be
+	// on either replica. new readers are steered to the idle row, and
+	// once it and then the old row have drained, no reader can be
+	// left on the replica readers were pointed away from
+	unsigned int previous = version_.load();
+	unsigned int next = 1 - previous;
+	while (!isEmpty(next)) {
+		std::this_thread::yield();
+	}
+	version_.store(next);
+	while (!isEmpty(previous)) {
+		std::this_thread::yield();
+	}
+}
+
+template<class K, class V>
+bool LeftRightTreeMap<K, V>::isEmpty(unsigned int version) const {
+	for (unsigned int stripe = 0; stripe < READER_STRIPES; stripe++) {
+		if (readerCounts_[version][stripe].count.load() != 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+template<class K, class V>
+unsigned int LeftRightTreeMap<K, V>::stripeOfThread() {
+	static thread_local unsigned int stripe = static_cast<unsigned int>(
+		std::hash<std::thread::id>()(std::this_thread::get_id()) % READER_STRIPES);
+	return stripe;
+}
+
+template<class K, class V>
+MemoryUsage LeftRightTreeMap<K, V>::memoryUsage() const {
+	std::lock_guard<std::mutex> lock(writeMutex_);
+	MemoryUsage usage = left_.memoryUsage();
+	MemoryUsage other = right_.memoryUsage();
+	usage.nodeBytes += other.nodeBytes;
+	usage.slackBytes += other.slackBytes;
+	usage.iteratorBytes += other.iteratorBytes;
+	usage.auxiliaryBytes += other.auxiliaryBytes + sizeof(readerCounts_);
+	usage.nodeTypes[0].count += other.nodeTypes[0].count;
+	usage.nodeTypes[0].bytes += other.nodeTypes[0].bytes;
+	return usage;
+}
@@ -0,0 +1,100 @@
+#pragma once
+#include <vector>		// std::vector
+#include <memory>		// std::shared_ptr, std::allocator
+#include <cstddef>		// size_t
+#include <atomic>		// std::atomic
+
+using std::vector;
+using std::shared_ptr;
+
+// MemoryUsage is a breakdown of the memory a map holds, as reported by
+// the memoryUsage() member of the maps in this repository.
+
+struct MemoryUsage {
+	// the share of nodeBytes taken by one kind of node
+	struct NodeTypeUsage {
+		const char* name;
+		size_t count;
+		size_t bytes;
+	};
+
+	// bytes of every node in the map, summed over nodeTypes
+	size_t nodeBytes;
+	// bytes the allocator holds on to beyond what the nodes asked for:
+	// malloc headers and rounding, or the unused space of an arena
+	size_t slackBytes;
+	// bytes held by the traversal stacks of live iterators
+	size_t iteratorBytes;
+	// bytes of everything else: indexes, filters, caches, bookkeeping
+	size_t auxiliaryBytes;
+	vector<NodeTypeUsage> nodeTypes;
+
+	// returns:
+	// all bytes accounted for
+	size_t total() const {
+		return nodeBytes + slackBytes + iteratorBytes + auxiliaryBytes;
+	};
+
+	// parameters:
+	// requested- size passed to operator new
+	// returns:
+	// bytes a typical 64-bit malloc actually sets aside for it: one
+	// size_t of header, rounded up to 16 bytes, never under 32 bytes
+	static size_t heapBlockSize(size_t requested) {
+		size_t block = (requested + sizeof(size_t) + 15) / 16 * 16;
+		return block < 32 ? 32 : block;
+	};
+
+	// parameters:
+	// valueBytes- size of a std::map's value_type
+	// returns:
+	// bytes a typical std::map asks operator new for to hold one such
+	// value: the color and three links of a red-black tree node, then
+	// the value itself
+	static size_t mapNodeSize(size_t valueBytes) {
+		return 4 * sizeof(void*) + valueBytes;
+	};
+};  // end struct MemoryUsage
+
+// CountingAllocator is a std::allocator which also tallies the bytes
+// it currently has handed out into a counter, so that containers owned
+// by short-lived objects such as iterators can be charged to their map.
+// a null counter counts nothing. the counter is atomic, since iterators
+// over the same map may be created and advanced on different threads.
+template<class T> struct CountingAllocator {
+	typedef T value_type;
+
+	shared_ptr<std::atomic<size_t>> counter;
+
+	CountingAllocator() {};
+	explicit CountingAllocator(const shared_ptr<std::atomic<size_t>>& tally)
+		: counter(tally) {};
+	// copying rather than moving, since a container which has been moved
+	// from still frees memory through its allocator and must still count it
+	CountingAllocator(const CountingAllocator& other) : counter(other.counter) {};
+	template<class U>
+	CountingAllocator(const CountingAllocator<U>& other) : counter(other.counter) {};
+
+	T* allocate(size_t n) {
+		T* memory = std::allocator<T>().allocate(n);
+		if (counter) {
+			counter->fetch_add(n * sizeof(T), std::memory_order_relaxed);
+		}
+		return memory;
+	};
+
+	void deallocate(T* memory, size_t n) {
+		if (counter) {
+			counter->fetch_sub(n * sizeof(T), std::memory_order_relaxed);
+		}
+		std::allocator<T>().deallocate(memory, n);
+	};
+
+	// every instance allocates from the same heap, so any one of them
+	// may free what another allocated. the tally may then drift between
+	// counters, which only happens when containers swap storage
+	template<class U>
+	bool operator==(const CountingAllocator<U>&) const { return true; };
+	template<class U>
+	bool operator!=(const CountingAllocator<U>&) const { return false; };
+};  // end struct CountingAllocator
@@ -0,0 +1,351 @@
+#pragma once
+#include <vector>		// std::vector
+#include <new>			// std::bad_alloc, operator new
+#include <cstddef>		// size_t
+
+#ifdef __linux__
+#include <sys/mman.h>	// mmap, munmap, madvise
+#endif
+
+using std::vector;
+
+// NodeArena hands out fixed-size slots for tree nodes, carved out of a
+// few large regions rather than one heap allocation per node. Regions
+// can be backed by 2 MB huge pages, so that a tree of many millions of
+// nodes spans a few thousand TLB entries instead of millions of 4 KB
+// pages. Released slots are kept on a free list and reused before any
+// new region is carved up. An arena may instead be given a block of the
+// caller's memory, in which case it hands out slots of that block alone
+// and never allocates.
+
+// Usage Notes Concerning NodeArena:
+
+// 1. slots are raw memory; the caller constructs and destroys
+// whatever it places in them
+
+// 2. every slot must be released before the arena is destroyed, or
+// whatever lives in it must not need destruction
+
+// 3. the arena is not safe for concurrent use
+
+// 4. memory given to an arena must outlive it, and is never freed by it
+
+class NodeArena {
+public:
+	// where an arena's regions come from
+	enum Backing {
+		// explicit 2 MB huge pages if the system has any reserved,
+		// else ordinary anonymous mappings which transparent huge
+		// pages are asked to back. falls back to Heap off Linux
+		HugePages,
+		// plain operator new
+		Heap
+	};
+
+	// size of one huge page, which regions are rounded up to
+	static const size_t HUGE_PAGE_SIZE = size_t(2) << 20;
+	// largest region the arena will grow to
+	static const size_t MAX_REGION_SIZE = size_t(256) << 20;
+
+	// parameters:
+	// slotSize- size in bytes of each slot handed out
+	// slotAlign- alignment required of each slot
+	// backing- where regions come from
+	NodeArena(size_t slotSize, size_t slotAlign, Backing backing);
+
+	// parameters:
+	// slotSize- size in bytes of each slot handed out
+	// slotAlign- alignment required of each slot
+	// storage- memory to carve slots from, with no alignment required
+	// bytes- size of storage
+	// constructs an arena which never allocates, and so holds at most
+	// (bytes - slotAlign + 1) / slotSize slots
+	NodeArena(size_t slotSize, size_t slotAlign, void* storage, size_t bytes);
+	~NodeArena();
+
+	NodeArena(const NodeArena&) = delete;
+	NodeArena& operator=(const NodeArena&) = delete;
+
+	// returns:
+	// an uninitialized slot
+	// throws:
+	// bad_alloc if no slot is free and a new region cannot be mapped
+	void* allocate();
+
+	// parameters:
+	// slots- number of slots wanted
+	// returns:
+	// first of slots uninitialized slots which lie back to back in
+	// memory, each of which may later be released on its own
+	// throws:
+	// bad_alloc if no new region can be obtained for them
+	void* allocateContiguous(size_t slots);
+
+	// parameters:
+	// slot- slot previously returned by allocate()
+	// modifies:
+	// arena to hand slot out again
+	void release(void* slot);
+
+	// parameters:
+	// slots- number of allocations to prepare for
+	// modifies:
+	// arena so that the next slots calls to allocate() need no new region
+	// throws:
+	// bad_alloc if a region cannot be obtained, or the arena was given
+	// its memory and has fewer than slots free
+	void reserve(size_t slots);
+
+	// parameters:
+	// slot- any pointer
+	// returns:
+	// true iff slot points into one of this arena's regions
+	bool owns(const void* slot) const;
+
+	// returns:
+	// number of slots allocate() can hand out before it needs a new region
+	size_t slotsAvailable() const {
+		return freeSlots_ + (next_ == nullptr ? 0 : (limit_ - next_) / slotSize_);
+	};
+
+	// returns:
+	// number of slots currently handed out
+	size_t slotsInUse() const { return slotsInUse_; };
+
+	// returns:
+	// total bytes reserved from the system for regions
+	size_t bytesReserved() const { return bytesReserved_; };
+
+	// returns:
+	// true iff any region is backed by explicit huge pages
+	// or was advised to use transparent ones
+	bool usesHugePages() const { return usesHugePages_; };
+
+private:
+	// a contiguous block of slots
+	typedef struct Region {
+		char* base;
+		size_t bytes;
+		bool isMapped;
+		// true iff the caller owns this memory
+		bool isBorrowed;
+	} ArenaRegion;
+
+	size_t slotSize_;
+	Backing backing_;
+	// true iff the arena was given its only region and may not grow
+	bool isFixed_;
+	vector<ArenaRegion> regions_;
+	// bump pointer into the newest region
+	char* next_;
+	char* limit_;
+	// released slots, linked through their first bytes
+	void* freeList_;
+	size_t freeSlots_;
+	size_t slotsInUse_;
+	size_t bytesReserved_;
+	bool usesHugePages_;
+
+	// modifies:
+	// arena to have moved the uncarved end of its newest region
+	// onto the free list, ahead of starting a new region
+	void retireNewestRegion();
+
+	// parameters:
+	// minimumBytes- least size the new region must have
+	// modifies:
+	// arena to have a fresh region to carve slots from
+	// throws:
+	// bad_alloc if the region cannot be obtained or the arena is fixed
+	void grow(size_t minimumBytes);
+
+	// parameters:
+	// slotAlign- alignment requested of each slot
+	// returns:
+	// slotAlign raised to what a free list link needs
+	static size_t slotAlignment(size_t slotAlign) {
+		return slotAlign < alignof(void*) ? alignof(void*) : slotAlign;
+	};
+
+	// parameters:
+	// slotSize- size requested of each slot
+	// slotAlign- alignment requested of each slot
+	// returns:
+	// slotSize raised to fit a free list link and rounded to keep
+	// consecutive slots aligned
+	static size_t slotStride(size_t slotSize, size_t slotAlign) {
+		if (slotSize < sizeof(void*)) {
+			slotSize = sizeof(void*);
+		}
+		slotAlign = slotAlignment(slotAlign);
+		return (slotSize + slotAlign - 1) / slotAlign * slotAlign;
+	};
+};  // end class NodeArena
+
+inline NodeArena::NodeArena(size_t slotSize, size_t slotAlign, Backing backing)
+	: slotSize_(slotStride(slotSize, slotAlign)), backing_(backing),
+	isFixed_(false), next_(nullptr), limit_(nullptr), freeList_(nullptr),
+	freeSlots_(0), slotsInUse_(0), bytesReserved_(0), usesHugePages_(false) {}
+
+inline NodeArena::NodeArena(size_t slotSize, size_t slotAlign, void* storage,
+	size_t bytes)
+	: slotSize_(slotStride(slotSize, slotAlign)), backing_(Heap),
+	isFixed_(true), next_(nullptr), limit_(nullptr), freeList_(nullptr),
+	freeSlots_(0), slotsInUse_(0), bytesReserved_(bytes), usesHugePages_(false) {
+	char* base = static_cast<char*>(storage);
+	size_t misalignment = reinterpret_cast<size_t>(base) % slotAlignment(slotAlign);
+	size_t head = misalignment == 0 ? 0 : slotAlignment(slotAlign) - misalignment;
+	if (base != nullptr && head < bytes) {
+		regions_.push_back(ArenaRegion{ base, bytes, false, true });
+		next_ = base + head;
+		limit_ = base + bytes;
+	}
+}
+
+inline NodeArena::~NodeArena() {
+	for (const ArenaRegion& region : regions_) {
+		if (region.isBorrowed) {
+			continue;
+		}
+#ifdef __linux__
+		if (region.isMapped) {
+			munmap(region.base, region.bytes);
+			continue;
+		}
+#endif
+		::operator delete(region.base);
+	}
+}
+
+inline void* NodeArena::allocate() {
+	void* slot;
+	if (freeList_ != nullptr) {
+		slot = freeList_;
+		freeList_ = *static_cast<void**>(freeList_);
+		freeSlots_--;
+	}
+	else {
+		if (next_ == nullptr || slotSize_ > size_t(limit_ - next_)) {
+			grow(slotSize_);
+		}
+		slot = next_;
+		next_ += slotSize_;
+	}
+	slotsInUse_++;
+	return slot;
+}
+
+inline void NodeArena::release(void* slot) {
+	*static_cast<void**>(slot) = freeList_;
+	freeList_ = slot;
+	freeSlots_++;
+	slotsInUse_--;
+}
+
+inline void NodeArena::reserve(size_t slots) {
+	size_t available = slotsAvailable();
+	if (available >= slots) {
+		return;
+	}
+	if (isFixed_) {
+		throw std::bad_alloc();
+	}
+	retireNewestRegion();
+	grow((slots - available) * slotSize_);
+}
+
+inline void* NodeArena::allocateContiguous(size_t slots) {
+	size_t bytes = slots * slotSize_;
+	if (next_ == nullptr || bytes > size_t(limit_ - next_)) {
+		if (isFixed_) {
+			throw std::bad_alloc();
+		}
+		retireNewestRegion();
+		grow(bytes);
+	}
+	void* run = next_;
+	next_ += bytes;
+	slotsInUse_ += slots;
+	return run;
+}
+
+inline void NodeArena::retireNewestRegion() {
+	// the rest of the newest region would be abandoned by grow(),
+	// so move it onto the free list first
+	while (next_ != nullptr && slotSize_ <= size_t(limit_ - next_)) {
+		*reinterpret_cast<void**>(next_) = freeList_;
+		freeList_ = next_;
+		freeSlots_++;
+		next_ += slotSize_;
+	}
+}
+
+inline bool NodeArena::owns(const void* slot) const {
+	const char* address = static_cast<const char*>(slot);
+	for (const ArenaRegion& region : regions_) {
+		if (address >= region.base && address < region.base + region.bytes) {
+			return true;
+		}
+	}
+	return false;
+}
+
+inline void NodeArena::grow(size_t minimumBytes) {
+	if (isFixed_) {
+		throw std::bad_alloc();
+	}
+	// regions double in size so a huge tree needs few of them,
+	// while a small one does not reserve much it will never use
+	size_t bytes = regions_.empty() ? HUGE_PAGE_SIZE
+		: regions_.back().bytes * 2;
+	if (bytes > MAX_REGION_SIZE) {
+		bytes = MAX_REGION_SIZE;
+	}
+	if (bytes < minimumBytes) {
+		bytes = (minimumBytes + HUGE_PAGE_SIZE - 1) / HUGE_PAGE_SIZE * HUGE_PAGE_SIZE;
+	}
+	ArenaRegion region{ nullptr, bytes, false, false };
+#ifdef __linux__
+	if (backing_ == HugePages) {
+		// explicit huge pages only exist if the administrator
+		// reserved some, so be ready for this to fail
+		void* mapped = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+			MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+		if (mapped != MAP_FAILED) {
+			usesHugePages_ = true;
+		}
+		else {
+			// over-map so the region can start on a huge page boundary,
+			// which transparent huge pages need to back it fully
+			size_t padded = bytes + HUGE_PAGE_SIZE;
+			mapped = mmap(nullptr, padded, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+			if (mapped == MAP_FAILED) {
+				throw std::bad_alloc();
+			}
+			char* raw = static_cast<char*>(mapped);
+			size_t misalignment = reinterpret_cast<size_t>(raw) % HUGE_PAGE_SIZE;
+			size_t head = misalignment == 0 ? 0 : HUGE_PAGE_SIZE - misalignment;
+			if (head > 0) {
+				munmap(raw, head);
+			}
+			munmap(raw + head + bytes, padded - head - bytes);
+			mapped = raw + head;
+#ifdef MADV_HUGEPAGE
+			if (madvise(mapped, bytes, MADV_HUGEPAGE) == 0) {
+				usesHugePages_ = true;
+			}
+#endif
+		}
+		region.base = static_cast<char*>(mapped);
+		region.isMapped = true;
+	}
+#endif
+	if (region.base == nullptr) {
+		region.base = static_cast<char*>(::operator new(bytes));
+	}
+	regions_.push_back(region);
+	bytesReserved_ += bytes;
+	next_ = region.base;
+	limit_ = region.base + bytes;
+}
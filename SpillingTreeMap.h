@@ -0,0 +1,950 @@
+#pragma once
+#include "MemoryUsage.h"	// MemoryUsage, CountingAllocator
+#include <fstream>		// std::fstream, std::ifstream
+#include <string>		// std::string
+#include <vector>		// std::vector
+#include <map>			// std::map
+#include <future>		// std::future, std::async
+#include <utility>		// std::pair
+#include <iterator>		// std::iterator, std::input_iterator_tag
+#include <stdexcept>	// std::out_of_range, std::runtime_error
+#include <type_traits>	// std::is_trivially_copyable
+#include <new>			// std::bad_alloc
+#include <cstdio>		// std::remove
+#include <cstring>		// std::memcpy
+#include <cstdint>		// int64_t, uint64_t
+#include <memory>		// std::shared_ptr, std::make_shared
+#include <atomic>		// std::atomic
+
+using std::pair;
+using std::vector;
+
+// SpillingTreeMap represents a map implemented as a binary search tree
+// whose cold subtrees are written out to a local spill file once the
+// tree outgrows its memory budget. A spilled subtree is replaced by a
+// small stub and is read back in transparently the next time a lookup,
+// insertion, deletion, or iteration reaches it. Which subtrees are cold
+// is decided from per-node access ticks, so lookups keep their hot paths
+// resident, while sequential scans spill what they have already visited
+// and prefetch spilled subtrees ahead of themselves on another thread.
+// As in TreeMap, an add which lands too deep rebuilds a lopsided subtree
+// (of resident nodes only; stubs keep their places between them), so
+// that keys inserted in order leave cold subtrees off the hot path for
+// eviction to spill rather than one long chain every add passes through.
+
+// Usage Notes Concerning SpillingTreeMap and SpillIterator:
+
+// 1. class K must support the <, >, and == operators, and both
+// K and V must be trivially copyable, as they are written to disk
+// byte for byte
+
+// 2. if any key is altered after it is inserted into the
+// tree, all behavior guarantees are immediately
+// and permanently nullified
+
+// 3. if the map is used other than through an iterator after said
+// iterator is constructed, it is invalid and its behavior is not
+// guaranteed. this includes at(), since lookups may spill subtrees.
+// likewise, only one iterator may be advanced at a time
+
+// 4. references returned by at() are valid only until the next
+// operation on the map
+
+// 5. space in the spill file taken by subtrees which have since been
+// read back in is not reclaimed until the map is destroyed
+
+template<class K, class V> class SpillingTreeMap {
+	static_assert(std::is_trivially_copyable<K>::value
+		&& std::is_trivially_copyable<V>::value,
+		"SpillingTreeMap writes keys and values to disk byte for byte");
+
+	// struct representing a node in the tree, or a stub
+	// standing in for a subtree which has been spilled
+	typedef struct Node {
+		pair<K, V> payload;
+		Node* right;
+		Node* left;
+		// tick of the latest lookup or update passing through this node
+		uint64_t lastAccess;
+		bool isStub;
+		// location of a stub's subtree in the spill file
+		int64_t offset;
+		int64_t bytes;
+	} SpillNode;
+
+	// a lazy input_iterator for SpillingTreeMap which performs an
+	// in-order traversal, reading spilled subtrees back as it reaches
+	// them and spilling the subtrees it leaves behind
+	class SpillIterator :
+		public std::iterator<std::input_iterator_tag, pair<K, V>> {
+
+		// stacks whose storage is charged to the map's iterator tally
+		typedef vector<SpillNode*, CountingAllocator<SpillNode*>> NodeStack;
+		typedef vector<SpillNode**, CountingAllocator<SpillNode**>> LinkStack;
+
+	public:
+		// constructs iterator over the whole of map, whose memory is
+		// added to map's iterator tally
+		explicit SpillIterator(SpillingTreeMap* map);
+
+		// constructor for past-the-end iterator
+		SpillIterator() : map_(nullptr), spilling_(false) {};
+
+		// comparison operators.
+		// two iterators are equal if they are at an identical
+		// position in the same instance of a SpillingTreeMap
+		// or if they are both past-the-end
+		bool operator==(const SpillIterator& rhs) const;
+		bool operator!=(const SpillIterator& rhs) const;
+
+		// basic accessors, rvalues only
+		// each throws out of range exception if
+		// called when iterator is past-the-end
+		const pair<K, V>& operator*() const;
+		pair<K, V> const* operator->() const;
+
+		// pre and postfix incrementers
+		// each throws out of range exception if
+		// called when iterator is past-the-end
+		SpillIterator& operator++();
+		SpillIterator operator++(int);
+
+		// returns:
+		// true iff iterator is in legal state to be dereferenced
+		bool isLegal() const { return toBeProcessed_.size() != 0; };
+
+	private:
+		SpillingTreeMap* map_;
+		// working stack of node pointers
+		NodeStack toBeProcessed_;
+		// link through which each node of toBeProcessed_ is reached
+		LinkStack links_;
+		// whether the scan has run over budget, after which it spills
+		// everything it passes rather than hovering at the budget and
+		// leaving the nodes it passed while under it resident
+		bool spilling_;
+
+		// parameters:
+		// link- link to the subtree whose leftmost path is wanted
+		// modifies:
+		// iterator to have that path pushed, reading in stubs on it
+		// and prefetching stubs which the traversal will reach next
+		void pushLeftPath(SpillNode** link);
+	};  // end class SpillIterator
+
+public:
+	// maximum number of spilled subtrees read ahead by a scan at once
+	static const size_t MAX_PREFETCHES = 4;
+
+	// parameters:
+	// spillPath- file which spilled subtrees are written to. it is
+	// truncated on construction and deleted on destruction
+	// memoryBudget- number of bytes resident nodes may occupy
+	// throws:
+	// runtime error if the spill file cannot be opened
+	SpillingTreeMap(const std::string& spillPath, size_t memoryBudget);
+	~SpillingTreeMap();
+
+	SpillingTreeMap(const SpillingTreeMap&) = delete;
+	SpillingTreeMap& operator=(const SpillingTreeMap&) = delete;
+
+	// parameters:
+	// key- represents the key in this pair
+	// and must implement the <, >, and == operators.
+	// value- represents the value paired with key
+	// returns:
+	// true if there was enough space to allocate another node
+	// AND this key is not equivalent to one in this tree already
+	// else returns false
+	// modifies:
+	// map to contain given key-value pair if equal key is not present
+	// if equivalent key is present, nothing is modified
+	bool add(const K& key, const V& value);
+
+	// parameters:
+	// key- key of key-value pair which is to be retrieved
+	// returns:
+	// value corresponding to given key, read back from the spill file
+	// first if need be
+	// throws:
+	// out of range exception if no key in map is equivalent to given key
+	V& at(const K& key);
+
+	// parameters:
+	// key- key of key-value pair which is to be removed
+	// returns:
+	// value corresponding to given key
+	// modifies:
+	// map to no longer contain key-value pair
+	// throws:
+	// out of range exception if no key in map is equal to given key
+	V remove(const K& key);
+
+	// returns:
+	// number of key-value pairs in map, spilled or not
+	unsigned int size() const { return size_; };
+
+	// returns:
+	// number of key-value pairs currently held in memory
+	size_t residentCount() const { return residentNodes_; };
+
+	// returns:
+	// breakdown of the memory this map holds, with resident nodes and
+	// stubs reported as separate node types and the buffers of reads
+	// being prefetched as auxiliary bytes. the file stream's own buffer
+	// is not counted. O(1), as every figure is kept up to date as the
+	// map and its iterators change
+	MemoryUsage memoryUsage() const;
+
+	// returns:
+	// iterator to beginning of tree, which performs in-order traversal
+	SpillIterator begin() { return SpillIterator(this); }
+
+	// returns:
+	// past-the-end iterator for use in comparison
+	SpillIterator end() { return SpillIterator(); };
+
+private:
+	std::string spillPath_;
+	std::fstream file_;
+	unsigned int size_;
+	size_t residentNodes_;
+	size_t stubs_;
+	// residency above which subtrees start being spilled
+	size_t maxResident_;
+	// largest subtree spilled in one go
+	size_t spillChunk_;
+	// advanced once per operation; nodes touched by the current
+	// operation carry the current tick and are never spilled by it
+	uint64_t clock_;
+	SpillNode* root_;
+	// reads of spilled subtrees in flight, keyed by stub
+	std::map<SpillNode*, std::future<vector<char>>> prefetches_;
+	// bytes held for those reads, as measured by prefetchBytes()
+	size_t prefetchBytes_;
+	// bytes held by live iterators, shared with each of them
+	shared_ptr<std::atomic<size_t>> iteratorBytes_;
+
+	// parameters:
+	// current- root of tree which is to be deleted
+	// modifies:
+	// tree to not contain any nodes, stubs included
+	void deleteTree(SpillNode* current);
+
+	// parameters:
+	// link- link which may hold a stub
+	// returns:
+	// node now held by link, the stub's subtree having been read
+	// back in from the spill file if link held one
+	SpillNode* resolve(SpillNode** link);
+
+	// parameters:
+	// link- link which may hold a stub
+	// modifies:
+	// starts reading in the stub's subtree on another thread
+	// if link holds a stub and too many reads are not in flight
+	void prefetch(SpillNode** link);
+
+	// parameters:
+	// link- link to a resident subtree
+	// modifies:
+	// subtree to be written to the spill file and replaced by a stub
+	void spill(SpillNode** link);
+
+	// modifies:
+	// spills the coldest subtrees not touched by the current operation
+	// until residency is back under budget, as far as that is possible
+	void evictIfNeeded();
+
+	// returns:
+	// true iff some subtree could be spilled
+	bool evictOne();
+
+	// parameters:
+	// key- key of a resident node
+	// modifies:
+	// clock_ to advance, and every node from root_ down to that one to
+	// carry the new tick, so that eviction leaves the path alone
+	void stampPath(const K& key);
+
+	// parameters:
+	// path- links from root_ down to a node just added, root_ first
+	// modifies:
+	// map to have the lowest ancestor of that node whose resident
+	// subtree is lopsided rebuilt, if the node is too deep
+	void rebalancePath(const vector<SpillNode**>& path);
+
+	// parameters:
+	// link- link to a resident subtree
+	// modifies:
+	// subtree to hold the same resident nodes perfectly balanced, with
+	// its stubs and empty links hung off them in the same order
+	static void rebuild(SpillNode** link);
+
+	// parameters:
+	// nodes- resident nodes in order
+	// gaps- the stubs or nullptrs between and around them, one more
+	// than there are nodes
+	// low- index of the first node of the subtree
+	// high- index one past the last node of the subtree
+	// returns:
+	// root of nodes[low, high) arranged as a balanced tree over
+	// gaps[low, high], each root carrying its subtree's latest tick
+	static SpillNode* buildBalanced(const vector<SpillNode*>& nodes,
+		const vector<SpillNode*>& gaps, size_t low, size_t high);
+
+	// returns:
+	// true iff residency is over budget
+	bool isOverBudget() const { return residentNodes_ > maxResident_; };
+
+	// parameters:
+	// current- root of a resident subtree
+	// limit- count beyond which counting stops
+	// returns:
+	// number of resident nodes in subtree, or limit + 1 if that is more
+	static size_t countResident(SpillNode* current, size_t limit);
+
+	// parameters:
+	// stub- stub whose subtree is read
+	// returns:
+	// bytes of the stub's subtree, as written by spill()
+	vector<char> readSpilled(const SpillNode* stub);
+
+	// parameters:
+	// bytes- serialized subtree
+	// returns:
+	// root of the rebuilt subtree
+	// modifies:
+	// residentNodes_ to count the rebuilt nodes
+	SpillNode* parse(const vector<char>& bytes);
+
+	// returns:
+	// new stub with the given location
+	// modifies:
+	// stubs_ to count it
+	SpillNode* newStub(int64_t offset, int64_t bytes);
+
+	// parameters:
+	// stub- stub which is to be deleted
+	// modifies:
+	// stubs_ to no longer count it, and any prefetch of its subtree
+	// to be dropped
+	void deleteStub(SpillNode* stub);
+
+	// parameters:
+	// bytes- length of a spilled subtree
+	// returns:
+	// bytes a prefetch of that subtree holds: its read buffer and its
+	// entry in prefetches_
+	static size_t prefetchBytes(int64_t bytes);
+};  // end class SpillingTreeMap
+
+template<class K, class V>
+SpillingTreeMap<K, V>::SpillingTreeMap(const std::string& spillPath,
+	size_t memoryBudget)
+	: spillPath_(spillPath), size_(0), residentNodes_(0), stubs_(0), clock_(0),
+	root_(nullptr), prefetchBytes_(0),
+	iteratorBytes_(std::make_shared<std::atomic<size_t>>(0)) {
+	file_.open(spillPath_, std::ios::in | std::ios::out
+		| std::ios::binary | std::ios::trunc);
+	if (!file_.is_open()) {
+		throw std::runtime_error("Could not open spill file.");
+	}
+	maxResident_ = memoryBudget / sizeof(SpillNode);
+	if (maxResident_ < 16) {
+		maxResident_ = 16;
+	}
+	spillChunk_ = maxResident_ / 16;
+}
+
+template<class K, class V>
+SpillingTreeMap<K, V>::~SpillingTreeMap() {
+	prefetches_.clear();  // waits for reads still in flight
+	deleteTree(root_);
+	file_.close();
+	std::remove(spillPath_.c_str());
+}
+
+template<class K, class V>
+void SpillingTreeMap<K, V>::deleteTree(SpillNode* current) {
+	// removes can leave the tree unbalanced, so avoid recursion
+	vector<SpillNode*> pending;
+	if (current != nullptr) {
+		pending.push_back(current);
+	}
+	while (!pending.empty()) {
+		current = pending.back();
+		pending.pop_back();
+		if (!current->isStub) {
+			if (current->left != nullptr) {
+				pending.push_back(current->left);
+			}
+			if (current->right != nullptr) {
+				pending.push_back(current->right);
+			}
+		}
+		delete current;
+	}
+}
+
+template<class K, class V>
+bool SpillingTreeMap<K, V>::add(const K& key, const V& value) {
+	clock_++;
+	vector<SpillNode**> path;
+	SpillNode** link = &root_;
+	SpillNode* current;
+	while ((current = resolve(link)) != nullptr) {
+		path.push_back(link);
+		current->lastAccess = clock_;
+		if (current->payload.first < key) {
+			link = &current->right;
+		}
+		else if (current->payload.first > key) {
+			link = &current->left;
+		}
+		else {  // key collision, tree will not be altered
+			return false;
+		}
+	}
+	try {
+		*link = new SpillNode{ pair<K, V>(key, value), nullptr, nullptr,
+			clock_, false, 0, 0 };
+	}
+	catch (std::bad_alloc&) {
+		return false;
+	}
+	path.push_back(link);
+	residentNodes_++;
+	size_++;
+	rebalancePath(path);
+	evictIfNeeded();
+	return true;
+}
+
+template<class K, class V>
+V& SpillingTreeMap<K, V>::at(const K& key) {
+	clock_++;
+	SpillNode** link = &root_;
+	SpillNode* current;
+	while ((current = resolve(link)) != nullptr) {
+		current->lastAccess = clock_;
+		if (current->payload.first < key) {
+			link = &current->right;
+		}
+		else if (current->payload.first > key) {
+			link = &current->left;
+		}
+		else {
+			// current carries this tick, so eviction will leave it be
+			evictIfNeeded();
+			return current->payload.second;
+		}
+	}
+	throw std::out_of_range("No such key exists in this tree.");
+}
+
+template<class K, class V>
+V SpillingTreeMap<K, V>::remove(const K& key) {
+	clock_++;
+	SpillNode** link = &root_;
+	SpillNode* current;
+	while (true) {
+		current = resolve(link);
+		if (current == nullptr) {  // given key was bad
+			throw std::out_of_range("No such key exists in this tree.");
+		}
+		current->lastAccess = clock_;
+		if (current->payload.first < key) {
+			link = &current->right;
+		}
+		else if (current->payload.first > key) {
+			link = &current->left;
+		}
+		else {
+			break;
+		}
+	}
+	V retVal = current->payload.second;
+	// the left subtree takes the removed node's place, and the right
+	// subtree is hung below the rightmost node of the left one. either
+	// may be a stub. only the left subtree's right spine is read back
+	if (current->left == nullptr) {
+		*link = current->right;
+	}
+	else {
+		if (current->right != nullptr) {
+			SpillNode** spot = &current->left;
+			SpillNode* rightmost;
+			while ((rightmost = resolve(spot))->right != nullptr) {
+				rightmost->lastAccess = clock_;
+				spot = &rightmost->right;
+			}
+			rightmost->lastAccess = clock_;
+			rightmost->right = current->right;
+		}
+		*link = current->left;
+	}
+	delete current;
+	residentNodes_--;
+	size_--;
+	evictIfNeeded();
+	return retVal;
+}
+
+template<class K, class V>
+MemoryUsage SpillingTreeMap<K, V>::memoryUsage() const {
+	MemoryUsage usage = MemoryUsage();
+	size_t residentBytes = residentNodes_ * sizeof(SpillNode);
+	size_t stubBytes = stubs_ * sizeof(SpillNode);
+	usage.nodeBytes = residentBytes + stubBytes;
+	usage.slackBytes = (residentNodes_ + stubs_)
+		* (MemoryUsage::heapBlockSize(sizeof(SpillNode)) - sizeof(SpillNode));
+	usage.iteratorBytes = iteratorBytes_->load(std::memory_order_relaxed);
+	usage.auxiliaryBytes = prefetchBytes_;
+	usage.nodeTypes.push_back(MemoryUsage::NodeTypeUsage{ "resident SpillNode",
+		residentNodes_, residentBytes });
+	usage.nodeTypes.push_back(
+		MemoryUsage::NodeTypeUsage{ "stub", stubs_, stubBytes });
+	return usage;
+}
+
+template<class K, class V>
+typename SpillingTreeMap<K, V>::SpillNode*
+SpillingTreeMap<K, V>::newStub(int64_t offset, int64_t bytes) {
+	SpillNode* stub = new SpillNode{ pair<K, V>(), nullptr, nullptr, 0, true,
+		offset, bytes };
+	stubs_++;
+	return stub;
+}
+
+template<class K, class V>
+void SpillingTreeMap<K, V>::deleteStub(SpillNode* stub) {
+	if (prefetches_.erase(stub) != 0) {
+		prefetchBytes_ -= prefetchBytes(stub->bytes);
+	}
+	stubs_--;
+	delete stub;
+}
+
+template<class K, class V>
+size_t SpillingTreeMap<K, V>::prefetchBytes(int64_t bytes) {
+	return MemoryUsage::heapBlockSize(static_cast<size_t>(bytes))
+		+ MemoryUsage::heapBlockSize(MemoryUsage::mapNodeSize(
+			sizeof(pair<SpillNode* const, std::future<vector<char>>>)));
+}
+
+template<class K, class V>
+typename SpillingTreeMap<K, V>::SpillNode*
+SpillingTreeMap<K, V>::resolve(SpillNode** link) {
+	SpillNode* stub = *link;
+	if (stub == nullptr || !stub->isStub) {
+		return stub;
+	}
+	vector<char> bytes;
+	auto pending = prefetches_.find(stub);
+	if (pending != prefetches_.end()) {
+		// forgotten before get() so that a failed read, which get()
+		// rethrows, is retried directly next time
+		std::future<vector<char>> reading = std::move(pending->second);
+		prefetches_.erase(pending);
+		prefetchBytes_ -= prefetchBytes(stub->bytes);
+		bytes = reading.get();
+	}
+	else {
+		bytes = readSpilled(stub);
+	}
+	*link = parse(bytes);
+	deleteStub(stub);
+	return *link;
+}
+
+template<class K, class V>
+void SpillingTreeMap<K, V>::prefetch(SpillNode** link) {
+	SpillNode* stub = *link;
+	if (stub == nullptr || !stub->isStub || prefetches_.size() >= MAX_PREFETCHES
+		|| prefetches_.count(stub) != 0) {
+		return;
+	}
+	std::string path = spillPath_;
+	int64_t offset = stub->offset;
+	int64_t bytes = stub->bytes;
+	// the reader opens its own stream so it never races file_
+	prefetches_[stub] = std::async(std::launch::async, [path, offset, bytes]() {
+		vector<char> buffer(static_cast<size_t>(bytes));
+		std::ifstream in(path, std::ios::binary);
+		in.seekg(offset);
+		in.read(buffer.data(), bytes);
+		if (!in) {
+			throw std::runtime_error("Could not read spill file.");
+		}
+		return buffer;
+	});
+	prefetchBytes_ += prefetchBytes(bytes);
+}
+
+template<class K, class V>
+vector<char> SpillingTreeMap<K, V>::readSpilled(const SpillNode* stub) {
+	vector<char> buffer(static_cast<size_t>(stub->bytes));
+	file_.seekg(stub->offset);
+	file_.read(buffer.data(), stub->bytes);
+	if (!file_) {
+		file_.clear();
+		throw std::runtime_error("Could not read spill file.");
+	}
+	return buffer;
+}
+
+// record layout, in preorder: a tag byte which is 0 for an empty link,
+// 1 for a node followed by its payload and access tick, or 2 for a
+// nested stub followed by its offset and length
+template<class K, class V>
+void SpillingTreeMap<K, V>::spill(SpillNode** link) {
+	vector<char> bytes;
+	vector<SpillNode*> pending;
+	pending.push_back(*link);
+	size_t spilledNodes = 0;
+	while (!pending.empty()) {
+		SpillNode* current = pending.back();
+		pending.pop_back();
+		if (current == nullptr) {
+			bytes.push_back(0);
+		}
+		else if (current->isStub) {
+			bytes.push_back(2);
+			const char* raw = reinterpret_cast<const char*>(&current->offset);
+			bytes.insert(bytes.end(), raw, raw + sizeof(int64_t));
+			raw = reinterpret_cast<const char*>(&current->bytes);
+			bytes.insert(bytes.end(), raw, raw + sizeof(int64_t));
+			deleteStub(current);
+		}
+		else {
+			bytes.push_back(1);
+			const char* raw = reinterpret_cast<const char*>(&current->payload.first);
+			bytes.insert(bytes.end(), raw, raw + sizeof(K));
+			raw = reinterpret_cast<const char*>(&current->payload.second);
+			bytes.insert(bytes.end(), raw, raw + sizeof(V));
+			raw = reinterpret_cast<const char*>(&current->lastAccess);
+			bytes.insert(bytes.end(), raw, raw + sizeof(uint64_t));
+			// right is pushed first so that left is written first
+			pending.push_back(current->right);
+			pending.push_back(current->left);
+			delete current;
+			spilledNodes++;
+		}
+	}
+	file_.seekp(0, std::ios::end);
+	int64_t offset = file_.tellp();
+	file_.write(bytes.data(), bytes.size());
+	file_.flush();
+	if (!file_) {
+		file_.clear();
+		throw std::runtime_error("Could not write spill file.");
+	}
+	*link = newStub(offset, bytes.size());
+	residentNodes_ -= spilledNodes;
+}
+
+template<class K, class V>
+typename SpillingTreeMap<K, V>::SpillNode*
+SpillingTreeMap<K, V>::parse(const vector<char>& bytes) {
+	SpillNode* root = nullptr;
+	// links still waiting for their record, in preorder
+	vector<SpillNode**> pending;
+	pending.push_back(&root);
+	size_t position = 0;
+	while (!pending.empty()) {
+		SpillNode** link = pending.back();
+		pending.pop_back();
+		char tag = bytes[position++];
+		if (tag == 0) {
+			*link = nullptr;
+		}
+		else if (tag == 2) {
+			int64_t offset;
+			int64_t length;
+			std::memcpy(&offset, &bytes[position], sizeof(int64_t));
+			std::memcpy(&length, &bytes[position + sizeof(int64_t)], sizeof(int64_t));
+			position += 2 * sizeof(int64_t);
+			*link = newStub(offset, length);
+		}
+		else {
+			SpillNode* current = new SpillNode{ pair<K, V>(), nullptr, nullptr,
+				0, false, 0, 0 };
+			std::memcpy(&current->payload.first, &bytes[position], sizeof(K));
+			position += sizeof(K);
+			std::memcpy(&current->payload.second, &bytes[position], sizeof(V));
+			position += sizeof(V);
+			std::memcpy(&current->lastAccess, &bytes[position], sizeof(uint64_t));
+			position += sizeof(uint64_t);
+			*link = current;
+			residentNodes_++;
+			pending.push_back(&current->right);
+			pending.push_back(&current->left);
+		}
+	}
+	return root;
+}
+
+template<class K, class V>
+size_t SpillingTreeMap<K, V>::countResident(SpillNode* current, size_t limit) {
+	size_t count = 0;
+	vector<SpillNode*> pending;
+	pending.push_back(current);
+	while (!pending.empty() && count <= limit) {
+		current = pending.back();
+		pending.pop_back();
+		if (current != nullptr && !current->isStub) {
+			count++;
+			pending.push_back(current->left);
+			pending.push_back(current->right);
+		}
+	}
+	return count;
+}
+
+template<class K, class V>
+void SpillingTreeMap<K, V>::evictIfNeeded() {
+	if (!isOverBudget()) {
+		return;
+	}
+	// spill a little past the budget so that the next few operations
+	// do not each have to spill again
+	while (residentNodes_ + spillChunk_ > maxResident_ && evictOne()) {
+	}
+}
+
+template<class K, class V>
+bool SpillingTreeMap<K, V>::evictOne() {
+	SpillNode* current = root_;
+	if (current == nullptr || current->isStub) {
+		return false;
+	}
+	while (true) {
+		// follow the colder resident child. every access passes through
+		// the root of the subtree it lands in, so a subtree's root carries
+		// the latest tick of anything below it
+		SpillNode** colder = nullptr;
+		if (current->left != nullptr && !current->left->isStub) {
+			colder = &current->left;
+		}
+		if (current->right != nullptr && !current->right->isStub
+			&& (colder == nullptr || current->right->lastAccess < (*colder)->lastAccess)) {
+			colder = &current->right;
+		}
+		if (colder == nullptr) {
+			return false;
+		}
+		if ((*colder)->lastAccess != clock_
+			&& countResident(*colder, spillChunk_) <= spillChunk_) {
+			spill(colder);
+			return true;
+		}
+		current = *colder;
+	}
+}
+
+template<class K, class V>
+void SpillingTreeMap<K, V>::stampPath(const K& key) {
+	clock_++;
+	SpillNode* current = root_;
+	while (current != nullptr) {
+		current->lastAccess = clock_;
+		if (current->payload.first < key) {
+			current = current->right;
+		}
+		else if (current->payload.first > key) {
+			current = current->left;
+		}
+		else {
+			return;
+		}
+	}
+}
+
+template<class K, class V>
+void SpillingTreeMap<K, V>::rebalancePath(const vector<SpillNode**>& path) {
+	// too deep past floor(2 * log2(resident nodes)), as in TreeMap
+	size_t depth = path.size() - 1;
+	unsigned long long squared = (unsigned long long)residentNodes_ * residentNodes_;
+	size_t limit = 0;
+	while (squared > 1) {
+		squared >>= 1;
+		limit++;
+	}
+	if (depth <= limit) {
+		return;
+	}
+	// climb to the first ancestor whose child on the path holds more
+	// than 1 / sqrt(2) of its resident nodes, counting the other side
+	unsigned long long childSize = 1;
+	for (size_t i = depth; i-- > 0; ) {
+		SpillNode* ancestor = *path[i];
+		SpillNode* sibling = ancestor->left == *path[i + 1]
+			? ancestor->right : ancestor->left;
+		unsigned long long size = childSize + 1
+			+ countResident(sibling, residentNodes_);
+		if (2 * childSize * childSize > size * size) {
+			rebuild(path[i]);
+			return;
+		}
+		childSize = size;
+	}
+}
+
+template<class K, class V>
+void SpillingTreeMap<K, V>::rebuild(SpillNode** link) {
+	vector<SpillNode*> nodes;
+	vector<SpillNode*> gaps;
+	vector<SpillNode*> pending;
+	SpillNode* current = *link;
+	while (true) {
+		while (current != nullptr && !current->isStub) {
+			pending.push_back(current);
+			current = current->left;
+		}
+		gaps.push_back(current);
+		if (pending.empty()) {
+			break;
+		}
+		current = pending.back();
+		pending.pop_back();
+		nodes.push_back(current);
+		current = current->right;
+	}
+	*link = buildBalanced(nodes, gaps, 0, nodes.size());
+}
+
+template<class K, class V>
+typename SpillingTreeMap<K, V>::SpillNode*
+SpillingTreeMap<K, V>::buildBalanced(const vector<SpillNode*>& nodes,
+	const vector<SpillNode*>& gaps, size_t low, size_t high) {
+	if (low == high) {
+		return gaps[low];
+	}
+	size_t middle = low + (high - low) / 2;
+	SpillNode* root = nodes[middle];
+	root->left = buildBalanced(nodes, gaps, low, middle);
+	root->right = buildBalanced(nodes, gaps, middle + 1, high);
+	// eviction relies on every access having passed through the root
+	// of its subtree, which the new roots must be made to look like
+	SpillNode* children[2] = { root->left, root->right };
+	for (SpillNode* child : children) {
+		if (child != nullptr && !child->isStub && child->lastAccess > root->lastAccess) {
+			root->lastAccess = child->lastAccess;
+		}
+	}
+	return root;
+}
+
+template<class K, class V>
+SpillingTreeMap<K, V>::SpillIterator::SpillIterator(SpillingTreeMap* map)
+	: map_(map), toBeProcessed_(CountingAllocator<SpillNode*>(map->iteratorBytes_)),
+	links_(CountingAllocator<SpillNode**>(map->iteratorBytes_)), spilling_(false) {
+	pushLeftPath(&map_->root_);
+}
+
+template<class K, class V>
+void SpillingTreeMap<K, V>::SpillIterator::pushLeftPath(SpillNode** link) {
+	SpillNode* current;
+	while ((current = map_->resolve(link)) != nullptr) {
+		toBeProcessed_.push_back(current);
+		links_.push_back(link);
+		// the right subtree is visited once current is, so start
+		// reading it in now if it was spilled
+		map_->prefetch(&current->right);
+		link = &current->left;
+	}
+}
+
+template<class K, class V>
+bool SpillingTreeMap<K, V>::SpillIterator::operator==
+(const SpillIterator& rhs) const {
+	return toBeProcessed_ == rhs.toBeProcessed_;
+}
+
+template<class K, class V>
+bool SpillingTreeMap<K, V>::SpillIterator::operator!=
+(const SpillIterator& rhs) const {
+	return toBeProcessed_ != rhs.toBeProcessed_;
+}
+
+template<class K, class V>
+typename SpillingTreeMap<K, V>::SpillIterator&
+SpillingTreeMap<K, V>::SpillIterator::operator++() {
+	if (!isLegal()) {
+		throw std::out_of_range("This iterator is past its end.");
+	}
+	SpillNode* current = toBeProcessed_.back();
+	SpillNode** link = links_.back();
+	toBeProcessed_.pop_back();
+	links_.pop_back();
+	spilling_ = spilling_ || map_->isOverBudget();
+	if (!spilling_) {
+		if (current->right != nullptr) {
+			pushLeftPath(&current->right);
+		}
+		return *this;
+	}
+	// everything left of current has been visited, so a scan which
+	// has run over budget spills it rather than anything ahead
+	if (current->left != nullptr && !current->left->isStub) {
+		map_->spill(&current->left);
+	}
+	if (current->right == nullptr) {
+		// nothing below current remains to be visited
+		map_->spill(link);
+	}
+	else {
+		// current would otherwise stay resident above the rest of the
+		// scan, so move its right subtree up into its place and hang it,
+		// visited, below the least node of that subtree, whose left
+		// link is empty
+		*link = current->right;
+		current->right = nullptr;
+		try {
+			pushLeftPath(link);
+		}
+		catch (...) {
+			// a read failed before current found its new place, so put
+			// it back where it was rather than lose it
+			current->right = *link;
+			*link = current;
+			throw;
+		}
+		SpillNode* next = toBeProcessed_.back();
+		next->left = current;
+		map_->spill(&next->left);
+	}
+	if (map_->isOverBudget() && isLegal()) {
+		// what is still over budget lies ahead of the scan. every node
+		// the iterator holds is on the path to its current node, so
+		// once that path is stamped the coldest of the rest can go
+		map_->stampPath(toBeProcessed_.back()->payload.first);
+		map_->evictIfNeeded();
+	}
+	return *this;
+}
+
+template<class K, class V>
+typename SpillingTreeMap<K, V>::SpillIterator
+SpillingTreeMap<K, V>::SpillIterator::operator++(int) {
+	SpillIterator tmp(*this);
+	operator++();
+	return tmp;
+}
+
+template<class K, class V>
+const pair<K, V>& SpillingTreeMap<K, V>::SpillIterator::operator*() const {
+	if (!isLegal()) {
+		throw std::out_of_range("This iterator is past its end.");
+	}
+	return toBeProcessed_.back()->payload;
+}
+
+template<class K, class V>
+pair<K, V> const* SpillingTreeMap<K, V>::SpillIterator::operator->() const {
+	if (!isLegal()) {
+		throw std::out_of_range("This iterator is past its end.");
+	}
+	return &toBeProcessed_.back()->payload;
+}
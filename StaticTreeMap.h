@@ -0,0 +1,306 @@
+#pragma once
+#include <iterator>		// std::iterator, std::forward_iterator_tag
+#include <stdexcept>	// std::out_of_range, std::invalid_argument
+#include <cstddef>		// size_t
+
+// StaticTreeMap represents a frozen map whose contents are known at
+// compile time. It is built by a constexpr constructor, so a map declared
+// constexpr is sorted, checked, and laid out by the compiler and sits in
+// read-only data with nothing left to do at startup. Entries are kept in
+// one array in Eytzinger (breadth-first) order: the implicit binary
+// search tree rooted at slot 1 has the children of slot k at 2k and
+// 2k + 1, so a lookup walks down the array touching the top levels'
+// shared cache lines first. Lookups and iteration work the same in
+// constant expressions and at run time.
+
+// Usage Notes Concerning StaticTreeMap and StaticIterator:
+
+// 1. class K must support the <, >, and == operators, and K and V must
+// be literal types which are default constructible and copy assignable
+// in constant expressions
+
+// 2. keys must be distinct. a repeated key fails compilation when the
+// map is built in a constant expression, and throws invalid argument
+// exception otherwise
+
+// 3. at() on a missing key likewise fails compilation in a constant
+// expression, and throws out of range exception otherwise
+
+// a key-value pair of a StaticTreeMap. std::pair can't be assigned
+// in constant expressions before C++20, so the map uses its own
+template<class K, class V> struct StaticEntry {
+	K first;
+	V second;
+};
+
+template<class K, class V, size_t N> class StaticTreeMap {
+	// a forward iterator for StaticTreeMap which visits the entries in
+	// order of key by walking the implicit tree in order
+	class StaticIterator :
+		public std::iterator<std::forward_iterator_tag, StaticEntry<K, V>> {
+	public:
+		// constructs iterator positioned at slot of map, or past-the-end
+		// if slot is 0
+		constexpr StaticIterator(const StaticTreeMap* map, size_t slot)
+			: map_(map), slot_(slot) {};
+
+		// comparison operators.
+		// two iterators are equal if they are at an identical
+		// position in the same map or if they are both past-the-end
+		constexpr bool operator==(const StaticIterator& rhs) const {
+			return slot_ == rhs.slot_ && (slot_ == 0 || map_ == rhs.map_);
+		};
+		constexpr bool operator!=(const StaticIterator& rhs) const {
+			return !(*this == rhs);
+		};
+
+		// basic accessors, rvalues only
+		// each throws out of range exception if
+		// called when iterator is past-the-end
+		constexpr const StaticEntry<K, V>& operator*() const;
+		constexpr const StaticEntry<K, V>* operator->() const { return &**this; };
+
+		// pre and postfix incrementers
+		// each throws out of range exception if
+		// called when iterator is past-the-end
+		constexpr StaticIterator& operator++();
+		constexpr StaticIterator operator++(int);
+
+		// returns:
+		// true iff iterator is in legal state to be dereferenced
+		constexpr bool isLegal() const { return slot_ != 0; };
+
+	private:
+		const StaticTreeMap* map_;
+		// 1-based slot of the current entry, or 0 past the end
+		size_t slot_;
+	};  // end class StaticIterator
+
+public:
+	// parameters:
+	// entries- contents of the map, in any order
+	// constructs map of entries
+	// throws:
+	// invalid argument exception if two entries have equivalent keys
+	constexpr explicit StaticTreeMap(const StaticEntry<K, V>(&entries)[N]);
+
+	// parameters:
+	// key- key of key-value pair which is to be retrieved
+	// returns:
+	// value corresponding to given key
+	// throws:
+	// out of range exception if no key in map is equivalent to given key
+	constexpr const V& at(const K& key) const;
+
+	// parameters:
+	// key- key of key-value pair which is to be retrieved
+	// returns:
+	// pointer to value corresponding to given key,
+	// or nullptr if no key in map is equivalent to given key
+	constexpr const V* find(const K& key) const;
+
+	// parameters:
+	// key- key of key-value pair which is to be looked for
+	// returns:
+	// true iff some key in map is equivalent to given key
+	constexpr bool contains(const K& key) const { return find(key) != nullptr; };
+
+	// returns:
+	// number of key-value pairs in map
+	constexpr size_t size() const { return N; };
+
+	// returns:
+	// iterator to the entry with the least key
+	constexpr StaticIterator begin() const { return StaticIterator(this, leftmost(1)); };
+
+	// returns:
+	// past-the-end iterator for use in comparison
+	constexpr StaticIterator end() const { return StaticIterator(this, 0); };
+
+private:
+	// entries in Eytzinger order, entry k of the implicit tree in
+	// slots_[k - 1]
+	StaticEntry<K, V> slots_[N];
+
+	// parameters:
+	// slot- 1-based slot, possibly past the last one
+	// returns:
+	// slot of the least entry in the subtree rooted at slot, or 0 if
+	// that subtree is empty
+	static constexpr size_t leftmost(size_t slot);
+
+	// parameters:
+	// sorted- entries in ascending order of key
+	// next- index into sorted of the next entry to place
+	// slot- 1-based slot of the subtree which is to be filled
+	// modifies:
+	// slots_ of the subtree rooted at slot to hold the next entries
+	// of sorted, in order
+	constexpr void layOut(const StaticEntry<K, V>* sorted, size_t* next,
+		size_t slot);
+
+	// parameters:
+	// entries- array which is to be sorted
+	// count- number of entries in it
+	// modifies:
+	// entries to be in ascending order of key, by heapsort, since
+	// std::sort isn't constexpr before C++20
+	static constexpr void sortEntries(StaticEntry<K, V>* entries, size_t count);
+
+	// parameters:
+	// entries- heap which is to be repaired
+	// root- index of the entry which may be out of place
+	// count- number of entries in the heap
+	// modifies:
+	// entries to be a max-heap below root again
+	static constexpr void siftDown(StaticEntry<K, V>* entries, size_t root,
+		size_t count);
+};  // end class StaticTreeMap
+
+// parameters:
+// entries- contents of the map, in any order
+// returns:
+// StaticTreeMap of entries, whose key and value types and size are
+// deduced from the array
+// throws:
+// invalid argument exception if two entries have equivalent keys
+template<class K, class V, size_t N>
+constexpr StaticTreeMap<K, V, N> makeStaticTreeMap(
+	const StaticEntry<K, V>(&entries)[N]) {
+	return StaticTreeMap<K, V, N>(entries);
+}
+
+template<class K, class V, size_t N>
+constexpr StaticTreeMap<K, V, N>::StaticTreeMap(
+	const StaticEntry<K, V>(&entries)[N]) : slots_() {
+	StaticEntry<K, V> sorted[N] = {};
+	for (size_t i = 0; i < N; i++) {
+		sorted[i] = entries[i];
+	}
+	sortEntries(sorted, N);
+	for (size_t i = 1; i < N; i++) {
+		if (sorted[i - 1].first == sorted[i].first) {
+			throw std::invalid_argument("Keys of a StaticTreeMap must be distinct.");
+		}
+	}
+	size_t next = 0;
+	layOut(sorted, &next, 1);
+}
+
+template<class K, class V, size_t N>
+constexpr const V& StaticTreeMap<K, V, N>::at(const K& key) const {
+	const V* found = find(key);
+	if (found == nullptr) {
+		throw std::out_of_range("No such key exists in this tree.");
+	}
+	return *found;
+}
+
+template<class K, class V, size_t N>
+constexpr const V* StaticTreeMap<K, V, N>::find(const K& key) const {
+	size_t slot = 1;
+	while (slot <= N) {
+		const StaticEntry<K, V>& entry = slots_[slot - 1];
+		if (entry.first < key) {
+			slot = 2 * slot + 1;
+		}
+		else if (entry.first > key) {
+			slot = 2 * slot;
+		}
+		else {
+			return &entry.second;
+		}
+	}
+	return nullptr;
+}
+
+template<class K, class V, size_t N>
+constexpr size_t StaticTreeMap<K, V, N>::leftmost(size_t slot) {
+	if (slot > N) {
+		return 0;
+	}
+	while (2 * slot <= N) {
+		slot = 2 * slot;
+	}
+	return slot;
+}
+
+template<class K, class V, size_t N>
+constexpr void StaticTreeMap<K, V, N>::layOut(const StaticEntry<K, V>* sorted,
+	size_t* next, size_t slot) {
+	if (slot <= N) {
+		layOut(sorted, next, 2 * slot);
+		slots_[slot - 1] = sorted[(*next)++];
+		layOut(sorted, next, 2 * slot + 1);
+	}
+}
+
+template<class K, class V, size_t N>
+constexpr void StaticTreeMap<K, V, N>::sortEntries(StaticEntry<K, V>* entries,
+	size_t count) {
+	for (size_t root = count / 2; root > 0; root--) {
+		siftDown(entries, root - 1, count);
+	}
+	for (size_t end = count; end > 1; end--) {
+		StaticEntry<K, V> largest = entries[0];
+		entries[0] = entries[end - 1];
+		entries[end - 1] = largest;
+		siftDown(entries, 0, end - 1);
+	}
+}
+
+template<class K, class V, size_t N>
+constexpr void StaticTreeMap<K, V, N>::siftDown(StaticEntry<K, V>* entries,
+	size_t root, size_t count) {
+	while (2 * root + 1 < count) {
+		size_t child = 2 * root + 1;
+		if (child + 1 < count && entries[child].first < entries[child + 1].first) {
+			child++;
+		}
+		if (!(entries[root].first < entries[child].first)) {
+			return;
+		}
+		StaticEntry<K, V> displaced = entries[root];
+		entries[root] = entries[child];
+		entries[child] = displaced;
+		root = child;
+	}
+}
+
+template<class K, class V, size_t N>
+constexpr const StaticEntry<K, V>&
+StaticTreeMap<K, V, N>::StaticIterator::operator*() const {
+	if (!isLegal()) {
+		throw std::out_of_range("This iterator is past its end.");
+	}
+	return map_->slots_[slot_ - 1];
+}
+
+template<class K, class V, size_t N>
+constexpr typename StaticTreeMap<K, V, N>::StaticIterator&
+StaticTreeMap<K, V, N>::StaticIterator::operator++() {
+	if (!isLegal()) {
+		throw std::out_of_range("This iterator is past its end.");
+	}
+	if (2 * slot_ + 1 <= N) {
+		// the least entry of the right subtree comes next
+		slot_ = leftmost(2 * slot_ + 1);
+	}
+	else {
+		// else climb past every ancestor of which this is a right
+		// descendant, to the first of which it is a left one
+		while (slot_ % 2 == 1) {
+			slot_ /= 2;
+		}
+		slot_ /= 2;
+	}
+	return *this;
+}
+
+template<class K, class V, size_t N>
+constexpr typename StaticTreeMap<K, V, N>::StaticIterator
+StaticTreeMap<K, V, N>::StaticIterator::operator++(int) {
+	StaticIterator tmp(*this);
+	operator++();
+	return tmp;
+}
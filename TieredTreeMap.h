@@ -0,0 +1,770 @@
+#pragma once
+#include "TreeMap.h"	// TreeMap
+#include "MemoryUsage.h"	// MemoryUsage
+
+#include <vector>		// std::vector
+#include <memory>		// std::shared_ptr, std::make_shared
+#include <utility>		// std::pair, std::declval
+#include <mutex>		// std::mutex, std::unique_lock, std::lock_guard
+#include <condition_variable>	// std::condition_variable
+#include <thread>		// std::thread
+#include <functional>	// std::hash
+#include <algorithm>	// std::lower_bound
+#include <iterator>		// std::iterator, std::input_iterator_tag
+#include <stdexcept>	// std::out_of_range
+#include <new>			// std::bad_alloc
+#include <cstdint>		// uint64_t
+
+using std::pair;
+using std::vector;
+using std::shared_ptr;
+
+// TieredTreeMap represents a map organised like an in-memory
+// log-structured merge tree. Writes land in a small mutable TreeMap
+// (the memtable). Once full, the memtable is frozen and handed to a
+// worker thread which turns it into an immutable sorted run and merges
+// runs of equal tier together in the background, so the writer never
+// pays for more than one memtable insert. Lookups consult the memtable,
+// then frozen memtables and runs from newest to oldest, skipping any
+// run whose Bloom filter rules the key out.
+
+// Usage Notes Concerning TieredTreeMap and TieredIterator:
+
+// 1. class K must support the <, >, and == operators and std::hash,
+// and class V must be default constructible
+
+// 2. user retains responsibility for freeing keys and values
+// if either K or V is a pointer type
+
+// 3. if any key is altered after it is inserted into the
+// tree, all behavior guarantees are immediately
+// and permanently nullified
+
+// 4. if the map is modified after an iterator is constructed,
+// said iterator is invalid and its behavior is not guaranteed.
+// background merging alone never invalidates an iterator
+
+// 5. the map itself is not safe for concurrent use; only the merging
+// it performs internally runs on another thread
+
+// 6. put() and erase() are blind writes. add() and remove() keep
+// TreeMap's checked semantics and so pay for one lookup each.
+
+template<class K, class V> class TieredTreeMap {
+	// a value, or a tombstone recording that a key was erased
+	typedef struct Record {
+		bool isDelete;
+		V value;
+	} TieredRecord;
+
+	typedef TreeMap<K, TieredRecord> Memtable;
+	typedef decltype(std::declval<const Memtable&>().begin()) MemtableIterator;
+
+	// a Bloom filter over the keys of one sorted run
+	class BloomFilter {
+	public:
+		// parameters:
+		// keyCount- number of keys the filter will hold
+		explicit BloomFilter(size_t keyCount);
+
+		// modifies:
+		// filter to report key as possibly present
+		void insert(const K& key);
+
+		// returns:
+		// false if key was certainly never inserted
+		bool mayContain(const K& key) const;
+
+		// returns:
+		// bytes held by the filter's bit array
+		size_t bytes() const { return bits_.capacity() * sizeof(uint64_t); };
+
+	private:
+		vector<uint64_t> bits_;
+
+		// returns:
+		// the two hashes every probe position is derived from
+		pair<uint64_t, uint64_t> hashes(const K& key) const;
+	};  // end class BloomFilter
+
+	// an immutable sorted run. keys and records are parallel arrays
+	typedef struct Run {
+		vector<K> keys;
+		vector<TieredRecord> records;
+		BloomFilter filter;
+		unsigned int tier;
+	} SortedRun;
+
+	// the frozen memtables and runs a reader sees, newest first.
+	// a version is never modified once published. the totals
+	// describe runs and are brought up to date before publishing
+	typedef struct Version {
+		vector<shared_ptr<const Memtable>> frozen;
+		vector<shared_ptr<const SortedRun>> runs;
+		size_t runEntries;
+		size_t runSlackBytes;
+		size_t filterBytes;
+	} TieredVersion;
+
+	// a lazy input_iterator for TieredTreeMap which merges the
+	// memtable, frozen memtables, and runs into one in-order traversal
+	class TieredIterator :
+		public std::iterator<std::input_iterator_tag, pair<K, V>> {
+
+	public:
+		// constructs iterator over given memtable and version
+		TieredIterator(const Memtable* memtable,
+			const shared_ptr<const TieredVersion>& version);
+
+		// constructor for past-the-end iterator
+		TieredIterator() : isLegal_(false) {};
+
+		// comparison operators.
+		// two iterators are equal if they are at an identical
+		// position in the same instance of a TieredTreeMap
+		// or if they are both past-the-end
+		bool operator==(const TieredIterator& rhs) const;
+		bool operator!=(const TieredIterator& rhs) const;
+
+		// basic accessors, rvalues only
+		// each throws out of range exception if
+		// called when iterator is past-the-end
+		const pair<K, V>& operator*() const;
+		pair<K, V> const* operator->() const;
+
+		// pre and postfix incrementers
+		// each throws out of range exception if
+		// called when iterator is past-the-end
+		TieredIterator& operator++();
+		TieredIterator operator++(int);
+
+		// returns:
+		// true iff iterator is in legal state to be dereferenced
+		bool isLegal() const { return isLegal_; };
+
+	private:
+		// keeps the runs being read alive while merging replaces them
+		shared_ptr<const TieredVersion> version_;
+		// memtable cursors first, newest first
+		vector<pair<MemtableIterator, MemtableIterator>> memtableCursors_;
+		// then run cursors, newest first
+		vector<pair<const SortedRun*, size_t>> runCursors_;
+		pair<K, V> current_;
+		bool isLegal_;
+
+		// modifies:
+		// iterator to rest on the smallest key not yet visited whose
+		// newest record is not a tombstone, or to be past-the-end
+		void settle();
+	};  // end class TieredIterator
+
+public:
+	// number of runs a tier collects before they are merged into one
+	// run of the next tier
+	static const size_t TIER_WIDTH = 4;
+	// number of frozen memtables which may wait for the worker before
+	// the writer blocks for it to catch up
+	static const size_t MAX_FROZEN = 4;
+
+	// parameters:
+	// memtableCapacity- number of entries after which the
+	// memtable is frozen and handed to the worker
+	// constructs empty TieredTreeMap
+	explicit TieredTreeMap(unsigned int memtableCapacity = 1024);
+	~TieredTreeMap();
+
+	TieredTreeMap(const TieredTreeMap&) = delete;
+	TieredTreeMap& operator=(const TieredTreeMap&) = delete;
+
+	// parameters:
+	// key- represents the key in this pair
+	// value- represents the value paired with key
+	// modifies:
+	// map to associate value with key, replacing any earlier value
+	void put(const K& key, const V& value);
+
+	// parameters:
+	// key- key of key-value pair which is to be removed
+	// modifies:
+	// map to no longer contain key, if it did
+	void erase(const K& key);
+
+	// parameters:
+	// key- represents the key in this pair
+	// value- represents the value paired with key
+	// returns:
+	// true iff this key is not equivalent to one in this map already
+	// modifies:
+	// map to contain given key-value pair if equal key is not present
+	// if equivalent key is present, nothing is modified
+	bool add(const K& key, const V& value);
+
+	// parameters:
+	// key- key of key-value pair which is to be retrieved
+	// returns:
+	// copy of value corresponding to given key. runs may be merged
+	// away at any moment, so no reference into them is handed out
+	// throws:
+	// out of range exception if no key in map is equivalent to given key
+	V at(const K& key) const;
+
+	// parameters:
+	// key- key of key-value pair which is to be removed
+	// returns:
+	// value corresponding to given key
+	// modifies:
+	// map to no longer contain key-value pair
+	// throws:
+	// out of range exception if no key in map is equal to given key
+	V remove(const K& key);
+
+	// returns:
+	// number of key-value pairs in map. this is O(1) unless blind
+	// writes have been made since it was last known, in which case
+	// it costs one merged traversal
+	unsigned int size() const;
+
+	// modifies:
+	// blocks until every frozen memtable has become a run and
+	// no merge is in progress
+	void waitForMerges();
+
+	// returns:
+	// number of immutable sorted runs currently held
+	size_t runCount() const;
+
+	// returns:
+	// breakdown of the memory this map holds, with memtable nodes and
+	// run entries reported as separate node types and Bloom filters
+	// as auxiliary bytes
+	MemoryUsage memoryUsage() const;
+
+	// returns:
+	// iterator to beginning of map, which performs in-order traversal
+	TieredIterator begin() const { return TieredIterator(memtable_.get(), snapshot()); }
+
+	// returns:
+	// past-the-end iterator for use in comparison
+	TieredIterator end() const { return TieredIterator(); };
+
+private:
+	unsigned int memtableCapacity_;
+	mutable unsigned int size_;
+	// false once a blind write has made size_ stale
+	mutable bool sizeKnown_;
+	shared_ptr<Memtable> memtable_;
+
+	// guards version_, busy_, and stopping_
+	mutable std::mutex mutex_;
+	// signalled when a memtable is frozen or the map is destroyed
+	std::condition_variable workAvailable_;
+	// signalled whenever the worker finishes with a frozen memtable
+	std::condition_variable workDone_;
+	shared_ptr<const TieredVersion> version_;
+	bool busy_;
+	bool stopping_;
+	std::thread worker_;
+
+	// parameters:
+	// key- key of the record
+	// record- value or tombstone to be written
+	// modifies:
+	// memtable to hold record for key, freezing it if it is full
+	void write(const K& key, const TieredRecord& record);
+
+	// parameters:
+	// key- key which is to be looked up
+	// record- return parameter for newest record of key
+	// returns:
+	// true iff any record for key exists, tombstones included
+	bool findRecord(const K& key, TieredRecord* record) const;
+
+	// returns:
+	// the version currently published to readers
+	shared_ptr<const TieredVersion> snapshot() const;
+
+	// parameters:
+	// version- version about to be published
+	// modifies:
+	// version's totals to describe its runs
+	static void summarize(TieredVersion* version);
+
+	// modifies:
+	// hands the memtable to the worker and starts a fresh one,
+	// blocking first if the worker is MAX_FROZEN memtables behind
+	void freezeMemtable();
+
+	// modifies:
+	// runs until destruction, turning frozen memtables into runs
+	// and merging full tiers
+	void workerLoop();
+
+	// parameters:
+	// memtable- frozen memtable to be converted
+	// returns:
+	// run holding memtable's records, built in one in-order pass
+	static shared_ptr<const SortedRun> buildRun(const Memtable& memtable);
+
+	// parameters:
+	// runs- runs to be merged, newest first
+	// dropTombstones- true iff no older run remains which a
+	// tombstone would need to shadow
+	// returns:
+	// one run of the next tier holding the newest record of every key
+	static shared_ptr<const SortedRun> mergeRuns(
+		const vector<shared_ptr<const SortedRun>>& runs, bool dropTombstones);
+};  // end class TieredTreeMap
+
+template<class K, class V>
+TieredTreeMap<K, V>::BloomFilter::BloomFilter(size_t keyCount)
+	// ten bits per key gives roughly a one percent false positive rate
+	: bits_((keyCount * 10) / 64 + 1, 0) {}
+
+template<class K, class V>
+pair<uint64_t, uint64_t>
+TieredTreeMap<K, V>::BloomFilter::hashes(const K& key) const {
+	uint64_t h1 = std::hash<K>()(key);
+	// std::hash is often the identity for integers, so mix it up before
+	// deriving the probe sequence from it
+	h1 ^= h1 >> 33;
+	h1 *= 0xff51afd7ed558ccdULL;
+	h1 ^= h1 >> 33;
+	uint64_t h2 = (h1 * 0x9e3779b97f4a7c15ULL) | 1;
+	return pair<uint64_t, uint64_t>(h1, h2);
+}
+
+template<class K, class V>
+void TieredTreeMap<K, V>::BloomFilter::insert(const K& key) {
+	pair<uint64_t, uint64_t> h = hashes(key);
+	uint64_t bitCount = bits_.size() * 64;
+	for (int i = 0; i < 7; i++) {
+		uint64_t bit = (h.first + i * h.second) % bitCount;
+		bits_[bit / 64] |= uint64_t(1) << (bit % 64);
+	}
+}
+
+template<class K, class V>
+bool TieredTreeMap<K, V>::BloomFilter::mayContain(const K& key) const {
+	pair<uint64_t, uint64_t> h = hashes(key);
+	uint64_t bitCount = bits_.size() * 64;
+	for (int i = 0; i < 7; i++) {
+		uint64_t bit = (h.first + i * h.second) % bitCount;
+		if ((bits_[bit / 64] & (uint64_t(1) << (bit % 64))) == 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+template<class K, class V>
+TieredTreeMap<K, V>::TieredTreeMap(unsigned int memtableCapacity)
+	: memtableCapacity_(memtableCapacity > 0 ? memtableCapacity : 1),
+	size_(0), sizeKnown_(true), memtable_(std::make_shared<Memtable>()),
+	version_(std::make_shared<const TieredVersion>(TieredVersion())),
+	busy_(false), stopping_(false) {
+	worker_ = std::thread(&TieredTreeMap::workerLoop, this);
+}
+
+template<class K, class V>
+TieredTreeMap<K, V>::~TieredTreeMap() {
+	{
+		std::lock_guard<std::mutex> lock(mutex_);
+		stopping_ = true;
+	}
+	workAvailable_.notify_all();
+	worker_.join();
+}
+
+template<class K, class V>
+void TieredTreeMap<K, V>::put(const K& key, const V& value) {
+	write(key, TieredRecord{ false, value });
+	sizeKnown_ = false;
+}
+
+template<class K, class V>
+void TieredTreeMap<K, V>::erase(const K& key) {
+	write(key, TieredRecord{ true, V() });
+	sizeKnown_ = false;
+}
+
+template<class K, class V>
+bool TieredTreeMap<K, V>::add(const K& key, const V& value) {
+	TieredRecord existing;
+	if (findRecord(key, &existing) && !existing.isDelete) {
+		return false;
+	}
+	write(key, TieredRecord{ false, value });
+	size_++;
+	return true;
+}
+
+template<class K, class V>
+V TieredTreeMap<K, V>::at(const K& key) const {
+	TieredRecord record;
+	if (!findRecord(key, &record) || record.isDelete) {
+		throw std::out_of_range("No such key exists in this tree.");
+	}
+	return record.value;
+}
+
+template<class K, class V>
+V TieredTreeMap<K, V>::remove(const K& key) {
+	TieredRecord record;
+	if (!findRecord(key, &record) || record.isDelete) {
+		throw std::out_of_range("No such key exists in this tree.");
+	}
+	write(key, TieredRecord{ true, V() });
+	size_--;
+	return record.value;
+}
+
+template<class K, class V>
+unsigned int TieredTreeMap<K, V>::size() const {
+	if (!sizeKnown_) {
+		unsigned int count = 0;
+		for (auto it = begin(); it != end(); ++it) {
+			count++;
+		}
+		size_ = count;
+		sizeKnown_ = true;
+	}
+	return size_;
+}
+
+template<class K, class V>
+void TieredTreeMap<K, V>::write(const K& key, const TieredRecord& record) {
+	TieredRecord* existing = memtable_->find(key);
+	if (existing != nullptr) {
+		*existing = record;
+	}
+	else if (!memtable_->add(key, record)) {
+		throw std::bad_alloc();
+	}
+	if (memtable_->size() >= memtableCapacity_) {
+		freezeMemtable();
+	}
+}
+
+template<class K, class V>
+bool TieredTreeMap<K, V>::findRecord(const K& key, TieredRecord* record) const {
+	TieredRecord* found = memtable_->find(key);
+	if (found != nullptr) {
+		*record = *found;
+		return true;
+	}
+	shared_ptr<const TieredVersion> version = snapshot();
+	for (const auto& frozen : version->frozen) {
+		found = frozen->find(key);
+		if (found != nullptr) {
+			*record = *found;
+			return true;
+		}
+	}
+	for (const auto& run : version->runs) {
+		if (!run->filter.mayContain(key)) {
+			continue;
+		}
+		auto pos = std::lower_bound(run->keys.begin(), run->keys.end(), key);
+		if (pos != run->keys.end() && *pos == key) {
+			*record = run->records[pos - run->keys.begin()];
+			return true;
+		}
+	}
+	return false;
+}
+
+template<class K, class V>
+shared_ptr<const typename TieredTreeMap<K, V>::TieredVersion>
+TieredTreeMap<K, V>::snapshot() const {
+	std::lock_guard<std::mutex> lock(mutex_);
+	return version_;
+}
+
+template<class K, class V>
+void TieredTreeMap<K, V>::waitForMerges() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	workDone_.wait(lock, [this] { return version_->frozen.empty() && !busy_; });
+}
+
+template<class K, class V>
+size_t TieredTreeMap<K, V>::runCount() const {
+	return snapshot()->runs.size();
+}
+
+template<class K, class V>
+void TieredTreeMap<K, V>::summarize(TieredVersion* version) {
+	version->runEntries = 0;
+	version->runSlackBytes = 0;
+	version->filterBytes = 0;
+	for (const auto& run : version->runs) {
+		version->runEntries += run->keys.size();
+		version->runSlackBytes += (run->keys.capacity() - run->keys.size()) * sizeof(K)
+			+ (run->records.capacity() - run->records.size()) * sizeof(TieredRecord);
+		version->filterBytes += run->filter.bytes();
+	}
+}
+
+template<class K, class V>
+MemoryUsage TieredTreeMap<K, V>::memoryUsage() const {
+	shared_ptr<const TieredVersion> version = snapshot();
+	MemoryUsage usage = memtable_->memoryUsage();
+	usage.nodeTypes[0].name = "memtable TreeMapNode";
+	for (const auto& frozen : version->frozen) {
+		MemoryUsage frozenUsage = frozen->memoryUsage();
+		usage.slackBytes += frozenUsage.slackBytes;
+		usage.auxiliaryBytes += frozenUsage.auxiliaryBytes;
+		usage.nodeTypes[0].count += frozenUsage.nodeTypes[0].count;
+		usage.nodeTypes[0].bytes += frozenUsage.nodeTypes[0].bytes;
+	}
+	size_t runBytes = version->runEntries * (sizeof(K) + sizeof(TieredRecord));
+	usage.nodeTypes.push_back(MemoryUsage::NodeTypeUsage{ "run entry",
+		version->runEntries, runBytes });
+	usage.nodeBytes = usage.nodeTypes[0].bytes + runBytes;
+	usage.slackBytes += version->runSlackBytes;
+	usage.auxiliaryBytes += version->filterBytes
+		+ version->runs.size() * MemoryUsage::heapBlockSize(sizeof(SortedRun));
+	return usage;
+}
+
+template<class K, class V>
+void TieredTreeMap<K, V>::freezeMemtable() {
+	{
+		std::unique_lock<std::mutex> lock(mutex_);
+		workDone_.wait(lock,
+			[this] { return version_->frozen.size() < MAX_FROZEN; });
+		shared_ptr<TieredVersion> next = std::make_shared<TieredVersion>(*version_);
+		next->frozen.insert(next->frozen.begin(), memtable_);
+		version_ = next;
+	}
+	workAvailable_.notify_one();
+	memtable_ = std::make_shared<Memtable>();
+}
+
+template<class K, class V>
+void TieredTreeMap<K, V>::workerLoop() {
+	std::unique_lock<std::mutex> lock(mutex_);
+	while (true) {
+		workAvailable_.wait(lock,
+			[this] { return stopping_ || !version_->frozen.empty(); });
+		if (stopping_) {
+			return;
+		}
+		busy_ = true;
+		// the writer only ever prepends, so the oldest frozen
+		// memtable stays at the back while it is converted
+		shared_ptr<const Memtable> oldest = version_->frozen.back();
+		lock.unlock();
+		shared_ptr<const SortedRun> run = buildRun(*oldest);
+		lock.lock();
+		shared_ptr<TieredVersion> next = std::make_shared<TieredVersion>(*version_);
+		next->frozen.pop_back();
+		next->runs.insert(next->runs.begin(), run);
+		summarize(next.get());
+		version_ = next;
+		workDone_.notify_all();
+
+		// runs are ordered by tier, so each tier is a contiguous range.
+		// only this thread changes runs, so they can be read unlocked
+		size_t first = 0;
+		while (first < version_->runs.size() && !stopping_) {
+			shared_ptr<const TieredVersion> current = version_;
+			const vector<shared_ptr<const SortedRun>>& runs = current->runs;
+			size_t last = first;
+			while (last < runs.size() && runs[last]->tier == runs[first]->tier) {
+				last++;
+			}
+			if (last - first < TIER_WIDTH) {
+				first = last;
+				continue;
+			}
+			vector<shared_ptr<const SortedRun>> tier(runs.begin() + first,
+				runs.begin() + last);
+			bool isOldest = last == runs.size();
+			lock.unlock();
+			shared_ptr<const SortedRun> merged = mergeRuns(tier, isOldest);
+			lock.lock();
+			next = std::make_shared<TieredVersion>(*version_);
+			next->runs.erase(next->runs.begin() + first, next->runs.begin() + last);
+			next->runs.insert(next->runs.begin() + first, merged);
+			summarize(next.get());
+			version_ = next;
+			// the merged run may have completed the next tier up
+		}
+		busy_ = false;
+		workDone_.notify_all();
+	}
+}
+
+template<class K, class V>
+shared_ptr<const typename TieredTreeMap<K, V>::SortedRun>
+TieredTreeMap<K, V>::buildRun(const Memtable& memtable) {
+	shared_ptr<SortedRun> run = std::make_shared<SortedRun>(
+		SortedRun{ vector<K>(), vector<TieredRecord>(),
+		BloomFilter(memtable.size()), 0 });
+	run->keys.reserve(memtable.size());
+	run->records.reserve(memtable.size());
+	for (auto it = memtable.begin(); it != memtable.end(); ++it) {
+		run->keys.push_back(it->first);
+		run->records.push_back(it->second);
+		run->filter.insert(it->first);
+	}
+	return run;
+}
+
+template<class K, class V>
+shared_ptr<const typename TieredTreeMap<K, V>::SortedRun>
+TieredTreeMap<K, V>::mergeRuns(const vector<shared_ptr<const SortedRun>>& runs,
+	bool dropTombstones) {
+	size_t total = 0;
+	for (const auto& run : runs) {
+		total += run->keys.size();
+	}
+	shared_ptr<SortedRun> merged = std::make_shared<SortedRun>(
+		SortedRun{ vector<K>(), vector<TieredRecord>(),
+		BloomFilter(total), runs.front()->tier + 1 });
+	merged->keys.reserve(total);
+	merged->records.reserve(total);
+
+	vector<size_t> positions(runs.size(), 0);
+	while (true) {
+		// find the smallest unvisited key; the newest run holding it wins
+		size_t newest = runs.size();
+		for (size_t i = 0; i < runs.size(); i++) {
+			if (positions[i] < runs[i]->keys.size() && (newest == runs.size()
+				|| runs[i]->keys[positions[i]] < runs[newest]->keys[positions[newest]])) {
+				newest = i;
+			}
+		}
+		if (newest == runs.size()) {
+			break;
+		}
+		const K& key = runs[newest]->keys[positions[newest]];
+		const TieredRecord& record = runs[newest]->records[positions[newest]];
+		if (!(dropTombstones && record.isDelete)) {
+			merged->keys.push_back(key);
+			merged->records.push_back(record);
+			merged->filter.insert(key);
+		}
+		for (size_t i = 0; i < runs.size(); i++) {
+			if (i != newest && positions[i] < runs[i]->keys.size()
+				&& runs[i]->keys[positions[i]] == key) {
+				positions[i]++;
+			}
+		}
+		positions[newest]++;
+	}
+	return merged;
+}
+
+template<class K, class V>
+TieredTreeMap<K, V>::TieredIterator::TieredIterator(const Memtable* memtable,
+	const shared_ptr<const TieredVersion>& version)
+	: version_(version), isLegal_(false) {
+	memtableCursors_.push_back(std::make_pair(memtable->begin(), memtable->end()));
+	for (const auto& frozen : version_->frozen) {
+		memtableCursors_.push_back(std::make_pair(frozen->begin(), frozen->end()));
+	}
+	for (const auto& run : version_->runs) {
+		runCursors_.push_back(std::make_pair(run.get(), size_t(0)));
+	}
+	settle();
+}
+
+template<class K, class V>
+void TieredTreeMap<K, V>::TieredIterator::settle() {
+	while (true) {
+		// find the smallest key under any cursor, and the newest
+		// source holding it, memtables being newer than runs
+		const K* smallest = nullptr;
+		const TieredRecord* newest = nullptr;
+		for (auto& cursor : memtableCursors_) {
+			if (cursor.first != cursor.second
+				&& (smallest == nullptr || cursor.first->first < *smallest)) {
+				smallest = &cursor.first->first;
+				newest = &cursor.first->second;
+			}
+		}
+		for (auto& cursor : runCursors_) {
+			if (cursor.second < cursor.first->keys.size()
+				&& (smallest == nullptr || cursor.first->keys[cursor.second] < *smallest)) {
+				smallest = &cursor.first->keys[cursor.second];
+				newest = &cursor.first->records[cursor.second];
+			}
+		}
+		if (smallest == nullptr) {
+			isLegal_ = false;
+			return;
+		}
+		bool isDelete = newest->isDelete;
+		if (!isDelete) {
+			current_ = pair<K, V>(*smallest, newest->value);
+		}
+		K key = *smallest;
+		// step every source past key, discarding the older records
+		for (auto& cursor : memtableCursors_) {
+			if (cursor.first != cursor.second && cursor.first->first == key) {
+				++cursor.first;
+			}
+		}
+		for (auto& cursor : runCursors_) {
+			if (cursor.second < cursor.first->keys.size()
+				&& cursor.first->keys[cursor.second] == key) {
+				cursor.second++;
+			}
+		}
+		if (!isDelete) {
+			isLegal_ = true;
+			return;
+		}
+	}
+}
+
+template<class K, class V>
+bool TieredTreeMap<K, V>::TieredIterator::operator==
+(const TieredIterator& rhs) const {
+	if (!isLegal_ || !rhs.isLegal_) {
+		return isLegal_ == rhs.isLegal_;
+	}
+	return version_ == rhs.version_ && runCursors_ == rhs.runCursors_
+		&& memtableCursors_ == rhs.memtableCursors_;
+}
+
+template<class K, class V>
+bool TieredTreeMap<K, V>::TieredIterator::operator!=
+(const TieredIterator& rhs) const {
+	return !(*this == rhs);
+}
+
+template<class K, class V>
+typename TieredTreeMap<K, V>::TieredIterator&
+TieredTreeMap<K, V>::TieredIterator::operator++() {
+	if (!isLegal()) {
+		throw std::out_of_range("This iterator is past its end.");
+	}
+	settle();
+	return *this;
+}
+
+template<class K, class V>
+typename TieredTreeMap<K, V>::TieredIterator
+TieredTreeMap<K, V>::TieredIterator::operator++(int) {
+	TieredIterator tmp(*this);
+	operator++();
+	return tmp;
+}
+
+template<class K, class V>
+const pair<K, V>& TieredTreeMap<K, V>::TieredIterator::operator*() const {
+	if (!isLegal()) {
+		throw std::out_of_range("This iterator is past its end.");
+	}
+	return current_;
+}
+
+template<class K, class V>
+pair<K, V> const* TieredTreeMap<K, V>::TieredIterator::operator->() const {
+	if (!isLegal()) {
+		throw std::out_of_range("This iterator is past its end.");
+	}
+	return &current_;
+}
@@ -0,0 +1,505 @@
+#include "TreeMap.h"	// TreeMap
+#include "LearnedIndexMap.h"	// LearnedIndexMap
+#include "CompressedSnapshot.h"	// CompressedSnapshot
+#include "AsyncSnapshotWriter.h"	// AsyncSnapshotWriter, readSnapshot
+#include "LeftRightTreeMap.h"	// LeftRightTreeMap
+#include "TreeSequence.h"	// TreeSequence
+
+#include <iostream>     // std::cout, std::endl
+#include <algorithm>    // std::shuffle
+#include <random>		// std::mt19937_64
+#include <vector>       // std::vector
+#include <chrono>		// std::chrono::steady_clock
+#include <string>		// std::string
+#include <cstdlib>		// std::strtoul
+#include <cstdint>		// uint64_t
+#include <cstdio>		// std::remove
+#include <sstream>		// std::ostringstream, std::istringstream, std::stringstream
+#include <thread>		// std::thread
+#include <atomic>		// std::atomic
+
+#ifdef __linux__
+#include <linux/perf_event.h>	// perf_event_attr
+#include <sys/syscall.h>		// SYS_perf_event_open
+#include <sys/ioctl.h>			// ioctl
+#include <unistd.h>				// syscall, read, close
+#endif
+
+using std::cout;
+using std::endl;
+using std::vector;
+
+// counts data TLB load misses of the calling thread, where the kernel
+// lets us. reports nothing if perf events are unavailable
+class TlbMissCounter {
+public:
+	TlbMissCounter() : fd_(-1) {
+#ifdef __linux__
+		perf_event_attr attr = perf_event_attr();
+		attr.size = sizeof(attr);
+		attr.type = PERF_TYPE_HW_CACHE;
+		attr.config = PERF_COUNT_HW_CACHE_DTLB
+			| (PERF_COUNT_HW_CACHE_OP_READ << 8)
+			| (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+		attr.disabled = 1;
+		attr.exclude_kernel = 1;
+		attr.exclude_hv = 1;
+		fd_ = static_cast<int>(syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0));
+#endif
+	}
+
+	~TlbMissCounter() {
+#ifdef __linux__
+		if (fd_ >= 0) {
+			close(fd_);
+		}
+#endif
+	}
+
+	bool isAvailable() const { return fd_ >= 0; }
+
+	void start() {
+#ifdef __linux__
+		if (fd_ >= 0) {
+			ioctl(fd_, PERF_EVENT_IOC_RESET, 0);
+			ioctl(fd_, PERF_EVENT_IOC_ENABLE, 0);
+		}
+#endif
+	}
+
+	uint64_t stop() {
+		uint64_t count = 0;
+#ifdef __linux__
+		if (fd_ >= 0) {
+			ioctl(fd_, PERF_EVENT_IOC_DISABLE, 0);
+			if (read(fd_, &count, sizeof(count)) != sizeof(count)) {
+				count = 0;
+			}
+		}
+#endif
+		return count;
+	}
+
+private:
+	int fd_;
+};
+
+// reports the cost of looking every probe up in map
+template<class Map>
+void timeLookups(const std::string& label, const Map& map,
+	const vector<uint64_t>& probes) {
+	TlbMissCounter tlbMisses;
+	uint64_t checksum = 0;
+	auto started = std::chrono::steady_clock::now();
+	tlbMisses.start();
+	for (uint64_t key : probes) {
+		checksum += map.at(key);
+	}
+	uint64_t misses = tlbMisses.stop();
+	double seconds = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - started).count();
+
+	cout << label << ": " << probes.size() / seconds / 1e6 << " M lookups/s";
+	if (tlbMisses.isAvailable()) {
+		cout << ", " << double(misses) / probes.size() << " dTLB misses/lookup";
+	}
+	else {
+		cout << ", dTLB misses unavailable";
+	}
+	cout << " (checksum " << checksum << ")" << endl;
+}
+
+// builds a map of the given keys and reports the cost of looking
+// every one of them up again in a different random order
+template<class Map>
+void benchmarkLookups(const std::string& label, Map& map,
+	const vector<uint64_t>& keys, const vector<uint64_t>& probes) {
+	for (uint64_t key : keys) {
+		map.add(key, key);
+	}
+	timeLookups(label, map, probes);
+}
+
+// reports the rate at which first visits count pairs on its way to last
+template<class Iterator>
+void benchmarkScan(const std::string& label, Iterator first, Iterator last,
+	size_t count) {
+	uint64_t checksum = 0;
+	auto started = std::chrono::steady_clock::now();
+	for (; first != last; ++first) {
+		checksum += first->second;
+	}
+	double seconds = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - started).count();
+	cout << label << ": " << count / seconds / 1e6 << " M pairs/s (checksum "
+		<< checksum << ")" << endl;
+}
+
+// adds keys in ascending order, the input which most often makes a map
+// rebalance, and reports the mean and worst cost of a single add
+void benchmarkAddLatency(const std::string& label,
+	TreeMap<uint64_t, uint64_t>::BalancePolicy policy, size_t numNodes) {
+	TreeMap<uint64_t, uint64_t> map(policy);
+	double worst = 0;
+	auto started = std::chrono::steady_clock::now();
+	for (size_t i = 0; i < numNodes; i++) {
+		auto before = std::chrono::steady_clock::now();
+		map.add(i, i);
+		double elapsed = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - before).count();
+		if (elapsed > worst) {
+			worst = elapsed;
+		}
+	}
+	double seconds = std::chrono::duration<double>(
+		std::chrono::steady_clock::now() - started).count();
+	cout << label << ": " << seconds / numNodes * 1e9 << " ns mean add, "
+		<< worst * 1e6 << " us worst add, height " << map.height() << endl;
+}
+
+int main(int argc, char** argv) {
+	// the TLB effects only show once the tree dwarfs what 4 KB pages
+	// can map, so pass e.g. 100000000 on a machine with the memory
+	size_t numNodes = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 4000000;
+	std::mt19937_64 random(42);
+
+	vector<uint64_t> keys(numNodes);
+	for (size_t i = 0; i < numNodes; i++) {
+		keys[i] = random();
+	}
+	vector<uint64_t> probes(keys);
+	std::shuffle(probes.begin(), probes.end(), random);
+
+	cout << "COMMENCING RANDOM LOOKUP BENCHMARK ON " << numNodes
+		<< " NODES..." << endl;
+	{
+		TreeMap<uint64_t, uint64_t> heap;
+		benchmarkLookups("heap nodes", heap, keys, probes);
+	}
+	{
+		TreeMap<uint64_t, uint64_t> arena(NodeArena::Heap);
+		benchmarkLookups("heap arena", arena, keys, probes);
+	}
+	{
+		TreeMap<uint64_t, uint64_t> hugePages(NodeArena::HugePages);
+		benchmarkLookups("huge page arena", hugePages, keys, probes);
+	}
+	cout << "RANDOM LOOKUP BENCHMARK: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING HASH INDEX BENCHMARK ON " << numNodes
+		<< " NODES..." << endl;
+	{
+		TreeMap<uint64_t, uint64_t> treeOnly;
+		benchmarkLookups("tree descent", treeOnly, keys, probes);
+		cout << "tree descent: " << double(treeOnly.memoryUsage().total())
+			/ numNodes << " bytes/entry" << endl;
+	}
+	{
+		TreeMap<uint64_t, uint64_t> indexed;
+		indexed.enableHashIndex();
+		benchmarkLookups("hash index", indexed, keys, probes);
+		cout << "hash index: " << double(indexed.memoryUsage().total())
+			/ numNodes << " bytes/entry" << endl;
+	}
+	cout << "HASH INDEX BENCHMARK: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING LEARNED INDEX BENCHMARK ON " << numNodes
+		<< " NODES..." << endl;
+	{
+		TreeMap<uint64_t, uint64_t> tree;
+		benchmarkLookups("tree descent", tree, keys, probes);
+		MemoryUsage treeUsage = tree.memoryUsage();
+		LearnedIndexMap<uint64_t> frozen(tree);
+		timeLookups("learned index", frozen, probes);
+		MemoryUsage frozenUsage = frozen.memoryUsage();
+		// what each spends on finding keys, beyond the keys and values
+		cout << "tree links: " << double(treeUsage.total()
+			- numNodes * 2 * sizeof(uint64_t)) / numNodes << " bytes/entry, "
+			<< "learned model: " << double(frozenUsage.auxiliaryBytes) / numNodes
+			<< " bytes/entry in " << frozen.segmentCount() << " segments" << endl;
+	}
+	cout << "LEARNED INDEX BENCHMARK: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING COMPRESSED SNAPSHOT BENCHMARK ON " << numNodes
+		<< " NODES..." << endl;
+	{
+		// keys a few hundred apart, as from a sequence with gaps
+		TreeMap<uint64_t, uint64_t> dense;
+		vector<uint64_t> denseKeys(numNodes);
+		uint64_t next = 0;
+		for (size_t i = 0; i < numNodes; i++) {
+			next += 1 + random() % 512;
+			denseKeys[i] = next;
+			dense.add(next, i);
+		}
+		vector<uint64_t> denseProbes(denseKeys);
+		std::shuffle(denseProbes.begin(), denseProbes.end(), random);
+		timeLookups("tree descent", dense, denseProbes);
+		CompressedSnapshot<uint64_t> compressed(dense);
+		timeLookups("compressed snapshot", compressed, denseProbes);
+		cout << "compressed keys: " << double(compressed.memoryUsage().nodeTypes[0].bytes)
+			/ numNodes << " bytes/key in " << compressed.blockCount() << " blocks" << endl;
+
+		std::stringstream file;
+		compressed.save(file);
+		auto started = std::chrono::steady_clock::now();
+		CompressedSnapshot<uint64_t> loaded(file);
+		TreeMap<uint64_t, uint64_t> restored;
+		loaded.restore(&restored);
+		double seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - started).count();
+		cout << "load and restore: " << numNodes / seconds / 1e6 << " M pairs/s" << endl;
+	}
+	cout << "COMPRESSED SNAPSHOT BENCHMARK: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING HOT NODE RELOCATION BENCHMARK ON " << numNodes
+		<< " NODES..." << endl;
+	{
+		// nine lookups in ten go to one key in a hundred
+		vector<uint64_t> skewed(probes.size());
+		size_t hotKeys = numNodes / 100 > 0 ? numNodes / 100 : 1;
+		for (size_t i = 0; i < skewed.size(); i++) {
+			skewed[i] = random() % 10 != 0 ? keys[random() % hotKeys]
+				: keys[random() % numNodes];
+		}
+		TreeMap<uint64_t, uint64_t> skewedMap;
+		benchmarkLookups("scattered nodes", skewedMap, keys, skewed);
+		skewedMap.sampleAccesses(64);
+		timeLookups("sampling lookups", skewedMap, skewed);
+		skewedMap.sampleAccesses(0);
+		unsigned int moved = skewedMap.relocateHot(
+			static_cast<unsigned int>(4 * hotKeys));
+		timeLookups("relocated nodes", skewedMap, skewed);
+		cout << moved << " nodes relocated" << endl;
+	}
+	cout << "HOT NODE RELOCATION BENCHMARK: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING SCAN BENCHMARK ON " << numNodes << " NODES..." << endl;
+	{
+		// nodes allocated in random key order, so an in-order scan
+		// hops all over memory
+		TreeMap<uint64_t, uint64_t> scanned;
+		for (uint64_t key : keys) {
+			scanned.add(key, key);
+		}
+		benchmarkScan("TreeIterator full scan", scanned.begin(), scanned.end(),
+			numNodes);
+		benchmarkScan("ScanIterator full scan", scanned.scan(), scanned.scanEnd(),
+			numNodes);
+
+		// many short range scans from random starting keys
+		const size_t RANGE_LENGTH = 1000;
+		size_t ranges = numNodes / RANGE_LENGTH;
+		uint64_t checksum = 0;
+		auto started = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < ranges; i++) {
+			auto sit = scanned.scanFrom(probes[i]);
+			for (size_t j = 0; j < RANGE_LENGTH && sit != scanned.scanEnd(); j++, ++sit) {
+				checksum += sit->second;
+			}
+		}
+		double seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - started).count();
+		cout << "ScanIterator range scans: " << ranges * RANGE_LENGTH / seconds / 1e6
+			<< " M pairs/s (checksum " << checksum << ")" << endl;
+	}
+	cout << "SCAN BENCHMARK: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING COLUMNAR EXPORT BENCHMARK ON " << numNodes
+		<< " NODES..." << endl;
+	{
+		TreeMap<uint64_t, uint64_t> exported;
+		for (uint64_t key : keys) {
+			exported.add(key, key);
+		}
+		vector<uint64_t> keyColumn;
+		vector<uint64_t> valueColumn;
+		auto started = std::chrono::steady_clock::now();
+		for (auto it = exported.begin(); it != exported.end(); ++it) {
+			keyColumn.push_back(it->first);
+			valueColumn.push_back(it->second);
+		}
+		double seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - started).count();
+		cout << "TreeIterator and push_back: " << numNodes / seconds / 1e6
+			<< " M pairs/s" << endl;
+
+		started = std::chrono::steady_clock::now();
+		exported.exportColumns(&keyColumn, &valueColumn);
+		seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - started).count();
+		cout << "exportColumns: " << numNodes / seconds / 1e6 << " M pairs/s" << endl;
+
+		TreeMap<uint64_t, uint64_t> imported;
+		started = std::chrono::steady_clock::now();
+		imported.importColumns(keyColumn, valueColumn);
+		seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - started).count();
+		cout << "importColumns: " << numNodes / seconds / 1e6 << " M pairs/s" << endl;
+	}
+	cout << "COLUMNAR EXPORT BENCHMARK: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING TEXT EXPORT BENCHMARK ON " << numNodes
+		<< " NODES..." << endl;
+	{
+		TreeMap<uint64_t, uint64_t> exported;
+		for (uint64_t key : keys) {
+			exported.add(key, key);
+		}
+		std::ostringstream slow;
+		auto started = std::chrono::steady_clock::now();
+		slow << exported;
+		double seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - started).count();
+		cout << "operator<<: " << slow.str().size() / seconds / 1e6 << " MB/s" << endl;
+
+		std::ostringstream fast;
+		started = std::chrono::steady_clock::now();
+		writeText(fast, exported);
+		seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - started).count();
+		cout << "writeText: " << fast.str().size() / seconds / 1e6 << " MB/s" << endl;
+
+		std::istringstream in(fast.str());
+		TreeMap<uint64_t, uint64_t> read;
+		started = std::chrono::steady_clock::now();
+		readText(in, &read);
+		seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - started).count();
+		cout << "readText: " << fast.str().size() / seconds / 1e6 << " MB/s" << endl;
+	}
+	cout << "TEXT EXPORT BENCHMARK: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING ASYNC SNAPSHOT BENCHMARK ON " << numNodes
+		<< " NODES..." << endl;
+	{
+		TreeMap<uint64_t, uint64_t> saved;
+		for (uint64_t key : keys) {
+			saved.add(key, key);
+		}
+		auto started = std::chrono::steady_clock::now();
+		AsyncSnapshotWriter<uint64_t, uint64_t> writer(saved, "snapshot_benchmark.bin");
+		double stalled = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - started).count();
+		writer.wait();
+		double seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - started).count();
+		cout << (writer.usesIoUring() ? "io_uring" : "pwrite thread") << ": "
+			<< stalled * 1e6 << " us caller stall, " << numNodes / seconds / 1e6
+			<< " M pairs/s written" << endl;
+
+		TreeMap<uint64_t, uint64_t> loaded;
+		started = std::chrono::steady_clock::now();
+		readSnapshot("snapshot_benchmark.bin", &loaded);
+		seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - started).count();
+		cout << "readSnapshot: " << numNodes / seconds / 1e6 << " M pairs/s" << endl;
+		std::remove("snapshot_benchmark.bin");
+	}
+	cout << "ASYNC SNAPSHOT BENCHMARK: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING LEFT RIGHT BENCHMARK ON " << numNodes
+		<< " NODES..." << endl;
+	{
+		// readers look keys up as fast as they can while one writer
+		// keeps adding and removing keys the readers never ask for
+		LeftRightTreeMap<uint64_t, uint64_t> shared;
+		for (uint64_t key : keys) {
+			shared.add(2 * key, key);
+		}
+		const unsigned int numReaders = 3;
+		std::atomic<bool> running(true);
+		std::atomic<uint64_t> reads(0);
+		std::atomic<uint64_t> checksum(0);
+		vector<std::thread> readers;
+		auto started = std::chrono::steady_clock::now();
+		for (unsigned int r = 0; r < numReaders; r++) {
+			readers.push_back(std::thread([&shared, &keys, &running, &reads, &checksum, r]() {
+				uint64_t count = 0;
+				uint64_t sum = 0;
+				for (size_t i = r; running; i = (i + numReaders) % keys.size()) {
+					sum += shared.at(2 * keys[i]);
+					count++;
+				}
+				reads += count;
+				checksum += sum;
+			}));
+		}
+		uint64_t writes = 0;
+		while (std::chrono::steady_clock::now() - started < std::chrono::seconds(1)) {
+			uint64_t key = 2 * keys[writes % keys.size()] + 1;
+			shared.add(key, key);
+			shared.remove(key);
+			writes += 2;
+		}
+		running = false;
+		for (std::thread& reader : readers) {
+			reader.join();
+		}
+		double seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - started).count();
+		cout << numReaders << " readers: " << reads / seconds / 1e6
+			<< " M lookups/s, 1 writer: " << writes / seconds / 1e3
+			<< " K writes/s (checksum " << checksum << ")" << endl;
+	}
+	cout << "LEFT RIGHT BENCHMARK: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING TREE SEQUENCE BENCHMARK ON " << numNodes
+		<< " VALUES..." << endl;
+	{
+		// inserts at random positions, where a vector moves half its
+		// values each time, so it only gets a slice of the inserts
+		std::mt19937_64 random(100);
+		TreeSequence<uint64_t> sequence;
+		auto started = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < numNodes; i++) {
+			sequence.insert((unsigned int)(random() % (i + 1)), i);
+		}
+		double seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - started).count();
+		cout << "TreeSequence random inserts: " << numNodes / seconds / 1e6
+			<< " M inserts/s, height " << sequence.height() << endl;
+
+		size_t vectorInserts = numNodes < 100000 ? numNodes : 100000;
+		vector<uint64_t> array;
+		started = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < vectorInserts; i++) {
+			array.insert(array.begin() + (random() % (i + 1)), i);
+		}
+		seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - started).count();
+		cout << "vector random inserts (first " << vectorInserts << "): "
+			<< vectorInserts / seconds / 1e6 << " M inserts/s" << endl;
+
+		uint64_t checksum = 0;
+		started = std::chrono::steady_clock::now();
+		for (size_t i = 0; i < numNodes; i++) {
+			checksum += sequence.at((unsigned int)(random() % numNodes));
+		}
+		seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - started).count();
+		cout << "TreeSequence random at: " << numNodes / seconds / 1e6
+			<< " M lookups/s (checksum " << checksum << ")" << endl;
+
+		TreeSequence<uint64_t> back;
+		started = std::chrono::steady_clock::now();
+		for (int i = 0; i < 1000; i++) {
+			sequence.split((unsigned int)(random() % (numNodes + 1)), &back);
+			sequence.concat(&back);
+		}
+		seconds = std::chrono::duration<double>(
+			std::chrono::steady_clock::now() - started).count();
+		cout << "TreeSequence split and concat: " << seconds / 1000 * 1e6
+			<< " us per pair" << endl;
+	}
+	cout << "TREE SEQUENCE BENCHMARK: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING SEQUENTIAL ADD LATENCY BENCHMARK ON " << numNodes
+		<< " NODES..." << endl;
+	benchmarkAddLatency("partial rebuild",
+		TreeMap<uint64_t, uint64_t>::PartialRebuild, numNodes);
+	benchmarkAddLatency("weight balanced",
+		TreeMap<uint64_t, uint64_t>::WeightBalanced, numNodes);
+	cout << "SEQUENTIAL ADD LATENCY BENCHMARK: COMPLETE" << endl << endl;
+	return EXIT_SUCCESS;
+}
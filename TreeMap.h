@@ -1,18 +1,51 @@
 #pragma once
+#include "NodeArena.h"	// NodeArena
+#include "MemoryUsage.h"	// MemoryUsage, CountingAllocator
+
 #include <iostream>		// std::cout, std::endl
-#include <stack>		// std::stack
+#include <memory>		// std::shared_ptr, std::make_shared
 #include <utility>		// std::pair
-#include <stdexcept>	// std::out_of_range
+#include <vector>		// std::vector
+#include <stdexcept>	// std::out_of_range, std::invalid_argument
+#include <new>			// std::bad_alloc
+#include <functional>	// std::hash
+#include <cstdint>		// uint64_t
+#include <tuple>		// std::tuple, std::get
+#include <algorithm>	// std::stable_sort, std::upper_bound, std::nth_element
+#include <climits>		// UINT_MAX
+#include <exception>	// std::exception_ptr, std::rethrow_exception
+#include <future>		// std::future, std::async
+#include <thread>		// std::thread::hardware_concurrency
+#include <system_error>	// std::system_error
+#include <charconv>		// std::to_chars, std::from_chars
+#include <cstring>		// std::memchr, std::memmove
+#include <type_traits>	// std::is_arithmetic, std::is_same
+#include <atomic>		// std::atomic
 
 using std::pair;
-using std::stack;
+using std::vector;
+using std::shared_ptr;
 using std::ostream;
+using std::istream;
 
 // TreeMap represents a map implemented as a binary search tree
 // which supports deletion (but not the [] operator)
 // and includes an input_iterator
 // which performs lazy in-order iteration
 
+// By default the tree keeps itself balanced by partial rebuilding (as
+// in a scapegoat tree): whenever an add or remove walks a path longer
+// than 2 * log2(size), the subtree on that path whose weight has become
+// too lopsided is rebuilt into a perfectly balanced one. Random inputs
+// almost never trigger this, while sorted inputs no longer degrade
+// into a linked list. Maps constructed with TreeMap::WeightBalanced
+// instead repair the path with rotations as they go, which bounds the
+// cost of every single add and remove rather than just their average.
+// Either way the map remembers its greatest key, and a key greater than
+// it is hung straight off that node, repairing only the right spine
+// above it, so keys arriving in ascending order (as in a time series)
+// skip the search from the root.
+
 // Usage Notes Concerning TreeMap and TreeIterator:
 
 // 1. class K must support the <, >, and == operators
@@ -24,32 +57,54 @@ using std::ostream;
 // tree, all behavior guarantees are immediately
 // and permanently nullified
 
-// 4. if the tree is modified after an iterator is constructed,
-// said iterator is invalid and its behavior is not guaranteed.
+// 4. a TreeIterator stays valid across adds and removes of other keys,
+// and across rebalance, but not across erasing or removing its own
+// pair, buildWeighted, or relocateHot, which moves nodes. a
+// ScanIterator is invalidated by any modification of the tree
+
+// 5. a map constructed over caller storage never allocates nodes, and
+// neither do add, at, find, remove, erase, or TreeIterators unless a
+// hash index is enabled, but scan iterators and height still allocate
+// from the heap
+
+// 6. while access sampling is on, at, find, and contains write to the
+// map, so they may not run concurrently with each other. the same goes
+// for forEachInOrder at any time
+
+template<class V> class TreeSequence;
 
 template<class K, class V> class TreeMap {
+	// TreeSequence builds on this map's nodes and rotations
+	template<class> friend class TreeSequence;
+
 	// struct representing a node in the tree
 	typedef struct Node {
 		pair<K, V> payload;
 		Node* right;
 		Node* left;
+		// number of nodes in the subtree rooted here
+		unsigned int weight;
+		// number of sampled lookups which passed through here
+		unsigned int hits;
+		// node of which this is a child, or nullptr at the root
+		Node* parent;
 	} TreeMapNode;
 
 	// a lazy input_iterator for TreeMap which performs an in-order
-	// traversal of the tree in question
+	// traversal of the tree in question. it holds only its current node
+	// and finds the next one through the parent links, so it costs
+	// nothing to copy and survives changes to the rest of the tree
 	class TreeIterator :
 		public std::iterator<std::input_iterator_tag, pair<K, V>> {
+		friend class TreeMap;
 
 	public:
-		// constructs iterator of the subtree for which root is the root
-		TreeIterator(TreeMapNode* root);
-
-		// copy constructor
-		TreeIterator(const TreeIterator& tit);
+		// constructs iterator positioned at node, or past-the-end
+		// if node is nullptr
+		explicit TreeIterator(TreeMapNode* node) : current_(node) {};
 
 		// constructor for past-the-end iterator
-		TreeIterator() : toBeProcessed_(new stack<TreeMapNode*>()) {};
-		~TreeIterator() { delete toBeProcessed_; };
+		TreeIterator() : current_(nullptr) {};
 
 		// comparison operators.
 		// two iterators are equal if they are at an identical
@@ -72,18 +127,132 @@ template<class K, class V> class TreeMap {
 
 		// returns:
 		// true iff iterator is in legal state to be dereferenced
-		bool isLegal() const { return toBeProcessed_->size() != 0; };
+		bool isLegal() const { return current_ != nullptr; };
 
 	private:
-		// working stack of node pointers
-		stack<TreeMapNode*>* toBeProcessed_;
+		// node of the current pair, or nullptr past the end
+		TreeMapNode* current_;
 	};  // end class TreeIterator
 
+	// an input_iterator for TreeMap built for long scans. unlike
+	// TreeIterator it walks the tree in order with a stack of the nodes
+	// still to visit, so that every node pushed can have its right child
+	// prefetched, since that child is the next node the scan will need
+	// once the node is popped. the loads of the next several subtrees
+	// thus overlap the visits to the nodes before them rather than
+	// stalling one after another
+	class ScanIterator :
+		public std::iterator<std::input_iterator_tag, pair<K, V>> {
+
+		// path whose storage is charged to the map's iterator tally
+		typedef vector<TreeMapNode*, CountingAllocator<TreeMapNode*>> NodePath;
+
+	public:
+		// constructs iterator of the subtree for which root is the root,
+		// starting from its least key not less than lowerBound if that
+		// isn't nullptr, whose memory is added to tally
+		ScanIterator(TreeMapNode* root, const K* lowerBound,
+			const shared_ptr<std::atomic<size_t>>& tally);
+
+		// constructor for past-the-end iterator
+		ScanIterator() {};
+
+		// comparison operators.
+		// two iterators are equal if they are at an identical
+		// position in the same instance of a TreeMap
+		// or if they are both past-the-end
+		bool operator==(const ScanIterator& rhs) const;
+		bool operator!=(const ScanIterator& rhs) const;
+
+		// basic accessors, rvalues only
+		// each throws out of range exception if
+		// called when iterator is past-the-end
+		const pair<K, V>& operator*() const;
+		pair<K, V> const* operator->() const;
+
+		// pre and postfix incrementers
+		// each throws out of range exception if
+		// called when iterator is past-the-end
+		ScanIterator& operator++();
+		ScanIterator operator++(int);
+
+		// returns:
+		// true iff iterator is in legal state to be dereferenced
+		bool isLegal() const { return !path_.empty(); };
+
+	private:
+		// nodes still to be visited, the current one at the back
+		NodePath path_;
+
+		// parameters:
+		// current- root of subtree whose leftmost path is to be pushed
+		// modifies:
+		// path_ to end in current's leftmost path, with the right
+		// child of every node pushed prefetched
+		void descend(TreeMapNode* current);
+	};  // end class ScanIterator
+
 public:
-	// constructs empty TreeMap
-	TreeMap() : size_(0), root_(nullptr) {};
+	// how a map keeps itself balanced
+	enum BalancePolicy {
+		// rebuild a lopsided subtree whenever a path grows too deep.
+		// cheapest on average, but the odd add or remove pays for
+		// rebuilding a subtree which may hold most of the map
+		PartialRebuild,
+		// fix every node along the path with at most one single or
+		// double rotation (a BB[alpha] tree), so that no add or remove
+		// costs more than O(log n) at the price of a taller tree
+		WeightBalanced
+	};
+
+	// constructs empty TreeMap whose nodes are individually heap allocated
+	TreeMap() : TreeMap(PartialRebuild) {};
+
+	// parameters:
+	// policy- how the map keeps itself balanced
+	// constructs empty TreeMap whose nodes are individually heap allocated
+	explicit TreeMap(BalancePolicy policy) : size_(0), maxSize_(0),
+		root_(nullptr), maximum_(nullptr), arena_(nullptr), heapNodes_(0),
+		policy_(policy),
+		hashIndex_(nullptr), samplePeriod_(0), lookupsUntilSample_(0),
+		iteratorBytes_(std::make_shared<std::atomic<size_t>>(0)) {};
+
+	// parameters:
+	// backing- where the arena holding this map's nodes gets its memory.
+	// NodeArena::HugePages cuts TLB misses on very large maps
+	// policy- how the map keeps itself balanced
+	// constructs empty TreeMap whose nodes are carved out of an arena
+	explicit TreeMap(NodeArena::Backing backing,
+		BalancePolicy policy = PartialRebuild);
+
+	// parameters:
+	// storage- memory to keep this map's nodes in, which must outlive it
+	// bytes- size of storage. storageFor(n) bytes hold n nodes
+	// policy- how the map keeps itself balanced
+	// constructs empty TreeMap which keeps its nodes in storage and never
+	// allocates any, so that add returns false once storage is full
+	TreeMap(void* storage, size_t bytes, BalancePolicy policy = PartialRebuild);
 	~TreeMap();
 
+	// parameters:
+	// capacity- number of nodes
+	// returns:
+	// bytes of caller storage needed to hold capacity nodes,
+	// however that storage is aligned
+	static size_t storageFor(unsigned int capacity) {
+		return capacity * sizeof(TreeMapNode) + alignof(TreeMapNode) - 1;
+	};
+
+	// parameters:
+	// count- number of adds to prepare for
+	// modifies:
+	// map so that the next count adds never call the allocator. a map
+	// whose nodes were heap allocated carves all later nodes out of an arena
+	// throws:
+	// bad_alloc if the memory cannot be obtained, or the map was constructed
+	// over caller storage with room for fewer than count more nodes
+	void reserve(unsigned int count);
+
 	// parameters:
 	// key- represents the key in this pair 
 	// and must implement the <, >, and == operators.
@@ -96,7 +265,8 @@ public:
 	// else returns false
 	// modifies:
 	// map to contain given key-value pair if equal key is not present
-	// if equivalent key is present, nothing is modified
+	// if equivalent key is present, nothing is modified. a key greater
+	// than every other is appended without searching from the root
 	bool add(const K& key, const V& value);
 
 	// parameters:
@@ -107,6 +277,19 @@ public:
 	// out of range exception if no key in map is equivalent to given key
 	V& at(const K& key) const;
 
+	// parameters:
+	// key- key of key-value pair which is to be retrieved
+	// returns:
+	// pointer to value corresponding to given key,
+	// or nullptr if no key in map is equivalent to given key
+	V* find(const K& key) const;
+
+	// parameters:
+	// key- key of key-value pair which is to be looked for
+	// returns:
+	// true iff some key in map is equivalent to given key
+	bool contains(const K& key) const { return findHelper(key) != nullptr; };
+
 	// parameters:
 	// key- key of key-value pair which is to be removed
 	// returns:
@@ -117,21 +300,251 @@ public:
 	// out of range exception if no key in map is equal to given key
 	V remove(const K& key);
 
+	// parameters:
+	// position- iterator to a pair of this map
+	// returns:
+	// iterator to the pair after it, or past-the-end
+	// modifies:
+	// map to no longer contain the pair at position. the node is unlinked
+	// through its parent, without a search from the root, and finding the
+	// next pair takes amortized O(1). updating the weights above it still
+	// takes O(log n). iterators to other pairs remain valid
+	// throws:
+	// out of range exception if position is past-the-end
+	TreeIterator erase(TreeIterator position);
+
 	// returns:
 	// number of key-value pairs in map
 	unsigned int size() const;
 
+	// returns:
+	// number of nodes on the longest path from the root to a leaf,
+	// found by walking the whole tree
+	unsigned int height() const;
+
+	// parameters:
+	// key- key whose node is to be found
+	// returns:
+	// number of nodes on the path from the root to key's node, inclusive,
+	// which is how many comparisons looking key up takes
+	// throws:
+	// out of range exception if no key in map is equivalent to given key
+	unsigned int depthOf(const K& key) const;
+
+	// parameters:
+	// entries- key, value, and relative access frequency of every pair the
+	// map is to hold, in any order. of entries with equivalent keys only
+	// the first is kept
+	// modifies:
+	// map to hold exactly the given pairs, arranged as a near-optimal
+	// search tree for that distribution of lookups: each subtree's root is
+	// the key whose share of the subtree's weight spans its midpoint
+	// (Mehlhorn's bisection rule), which keeps the expected depth within
+	// about 2 of the optimum. O(n log n). later adds and removes may
+	// rebalance parts of the tree away from this arrangement
+	// throws:
+	// bad_alloc if the nodes cannot be allocated, leaving map unchanged
+	void buildWeighted(const vector<std::tuple<K, V, double>>& entries);
+
+	// parameters:
+	// keys- keys the map is to hold, in strictly ascending order
+	// values- value paired with each key
+	// count- number of pairs
+	// modifies:
+	// map to hold exactly the given pairs, as a perfectly balanced tree
+	// built in O(n) with no search for where each pair belongs
+	// throws:
+	// invalid argument exception if keys are not strictly ascending,
+	// or bad_alloc if the nodes cannot be allocated, either leaving map
+	// unchanged
+	void importColumns(const K* keys, const V* values, size_t count);
+
+	// parameters:
+	// keys- keys the map is to hold, in strictly ascending order
+	// values- value paired with each key
+	// modifies:
+	// map to hold exactly the given pairs, as above
+	// throws:
+	// invalid argument exception if keys are not strictly ascending or
+	// there are not as many values as keys, or bad_alloc if the nodes
+	// cannot be allocated, either leaving map unchanged
+	void importColumns(const vector<K>& keys, const vector<V>& values);
+
+	// parameters:
+	// period- sample one lookup in every period, or 0 to stop sampling
+	// modifies:
+	// map to count, in every node, the sampled lookups which pass through
+	// it on their way down. counts stay with their nodes when rotations
+	// or rebuilds move them, so a node may come to be hotter than its
+	// new parent
+	void sampleAccesses(unsigned int period);
+
+	// parameters:
+	// count- most nodes to move
+	// returns:
+	// number of nodes moved
+	// modifies:
+	// map to move the count nodes through which the most sampled lookups
+	// have passed, wherever they are in the tree, into one contiguous
+	// run of memory in breadth-first order, so that hot paths share cache
+	// lines and pages. the tree keeps its shape. every count is then
+	// halved so that later calls follow shifts in the workload. a map
+	// whose nodes were heap allocated takes the run from a new arena
+	// throws:
+	// bad_alloc if the run cannot be allocated, leaving map unchanged
+	unsigned int relocateHot(unsigned int count);
+
+	// modifies:
+	// tree to be perfectly balanced, by reshaping the existing nodes with
+	// rotations (Day-Stout-Warren). takes linear time and constant extra
+	// memory and never touches the allocator, so it is cheap to run
+	// whenever the map is idle
+	void rebalance();
+
+	// modifies:
+	// map to keep a hash table from every key to its node alongside the
+	// tree, which at, find, and contains then use in place of a descent.
+	// costs a pointer and a half or so per key, plus a hash per add and
+	// remove. replaces any index already enabled
+	// throws:
+	// bad_alloc if the table cannot be allocated
+	template<class Hash = std::hash<K>>
+	void enableHashIndex();
+
+	// modifies:
+	// map to drop its hash index, if it has one
+	void disableHashIndex();
+
+	// returns:
+	// true iff map has a hash index
+	bool hasHashIndex() const { return hashIndex_ != nullptr; };
+
+	// returns:
+	// breakdown of the memory this map holds, not counting the TreeMap
+	// object itself. O(1), as every figure is kept up to date as the
+	// map and its iterators change
+	MemoryUsage memoryUsage() const;
+
+	// parameters:
+	// visit- callable as visit(const pair<K, V>&), which must not modify
+	// the map
+	// modifies:
+	// nothing once it returns or throws. calls visit on every pair in
+	// order of key, by Morris traversal: the tree is walked through
+	// temporary links from each node's in-order predecessor back up to
+	// it, so the scan allocates nothing and follows each link at most
+	// three times. the tree is restored as the walk proceeds, and if
+	// visit throws, the walk is finished without it before rethrowing
+	template<class Visit>
+	void forEachInOrder(Visit visit) const;
+
+	// parameters:
+	// keys- room for size() keys, which are overwritten
+	// values- room for size() values, which are overwritten
+	// modifies:
+	// keys and values to hold every pair in order of key, the i-th
+	// value paired with the i-th key. the weights tell where each
+	// subtree's span of the arrays begins, so a large map is exported
+	// by several threads at once, each filling its own span
+	void exportColumns(K* keys, V* values) const;
+
+	// parameters:
+	// keys- return parameter for every key in ascending order
+	// values- return parameter for the value paired with each key
+	// modifies:
+	// keys and values to be resized to size() and filled as above
+	// throws:
+	// bad_alloc if either cannot be resized
+	void exportColumns(vector<K>* keys, vector<V>* values) const;
+
 	// returns:
 	// iterator to beginning of tree, which performs in-order traversal
-	TreeIterator begin() const { return TreeIterator(root_); }
+	TreeIterator begin() const {
+		return TreeIterator(root_ == nullptr ? nullptr : leftmost(root_));
+	}
 
 	// returns:
 	// past-the-end iterator for use in comparison
 	TreeIterator end() const { return TreeIterator(); };
 
+	// returns:
+	// iterator to beginning of tree which prefetches ahead of itself,
+	// for scans over much of a large map
+	ScanIterator scan() const {
+		return ScanIterator(root_, nullptr, iteratorBytes_);
+	};
+
+	// parameters:
+	// lowerBound- least key the scan may start from
+	// returns:
+	// prefetching iterator to the pair with the least key not less
+	// than lowerBound, for range scans
+	ScanIterator scanFrom(const K& lowerBound) const {
+		return ScanIterator(root_, &lowerBound, iteratorBytes_);
+	};
+
+	// returns:
+	// past-the-end prefetching iterator for use in comparison
+	ScanIterator scanEnd() const { return ScanIterator(); };
+
 private:
+	// a WeightBalanced node is out of balance once one side is this many
+	// times heavier than the other, counting each side's weight plus one
+	static const unsigned int BALANCE_DELTA = 3;
+	// and is then fixed with a double rotation rather than a single one
+	// if the heavier child's inner subtree is this many times heavier
+	// than its outer one. (3, 2) is the only integer pair which keeps
+	// every add and remove down to one rotation per node
+	static const unsigned int BALANCE_GAMMA = 2;
+	// nodes a subtree must hold before exportColumns gives it a thread
+	static const unsigned int EXPORT_GRAIN = 1 << 16;
+
+	// open-addressed table from keys to the nodes holding them. Hash is
+	// erased into hashKey, so that it needn't be part of TreeMap's type
+	typedef struct HashIndex {
+		// nodes, each in the first free slot at or after its key's
+		// home slot, or nullptr. always a power of two long
+		vector<TreeMapNode*> slots;
+		unsigned int count;
+		size_t (*hashKey)(const K& key);
+	} TreeMapHashIndex;
+
 	unsigned int size_;
+	// largest size_ since the whole tree was last rebuilt
+	unsigned int maxSize_;
 	TreeMapNode* root_;
+	// node holding the greatest key, or nullptr if that isn't known,
+	// in which case the next add finds it
+	TreeMapNode* maximum_;
+	// source of node memory, or nullptr to use new and delete
+	NodeArena* arena_;
+	// number of nodes allocated with new rather than from arena_,
+	// which is every node if arena_ is nullptr
+	unsigned int heapNodes_;
+	BalancePolicy policy_;
+	// index of every node by key, or nullptr if there is none
+	TreeMapHashIndex* hashIndex_;
+	// one in every samplePeriod_ lookups is counted, none if it is 0
+	unsigned int samplePeriod_;
+	mutable unsigned int lookupsUntilSample_;
+	// bytes held by live iterators, shared with them since
+	// they may outlive the map
+	shared_ptr<std::atomic<size_t>> iteratorBytes_;
+
+	// parameters:
+	// key- key of new node
+	// value- value of new node
+	// returns:
+	// new childless node
+	// throws:
+	// bad_alloc if no memory is available for it
+	TreeMap<K, V>::TreeMapNode* newNode(const K& key, const V& value);
+
+	// parameters:
+	// node- node which is to be freed
+	// modifies:
+	// returns node's memory to wherever it came from
+	void deleteNode(TreeMapNode* node);
 
 	// parameters:
 	// current- root of tree which is to be deleted
@@ -142,40 +555,302 @@ private:
 	// parameters:
 	// current- root of subtree which is being added to
 	// newElement- node which is being added
+	// depth- number of edges between the root and current
 	// success- return parameter for whether the add succeeded
+	// tooDeep- return parameter for whether a scapegoat is still sought
 	// returns: 
 	// root of newly modified tree
 	// modifies:
 	// map to contain newElement if its key isn't equivalent to one 
-	// already in map
+	// already in map, rebalancing the path down to it
 	TreeMap<K, V>::TreeMapNode* addHelper(TreeMapNode* current,
-		TreeMapNode* newElement, bool* success);
+		TreeMapNode* newElement, unsigned int depth, bool* success,
+		bool* tooDeep);
 
 	// parameters:
-	// current- root of subtree which is being removed from
-	// key- key of element which is to be removed
-	// retVal- return parameter for value of element being removed
-	// returns: 
-	// root of newly modified tree
+	// newElement- node whose key is greater than every key in the
+	// map, which must not be empty
 	// modifies:
-	// removes element with matching key from map
-	// throws:
-	// out of range excpetion if no key match is found
-	TreeMap<K, V>::TreeMapNode* removeHelper(TreeMapNode* current,
-		const K& key, V* retVal);
+	// map to contain newElement as the right child of maximum_, and
+	// maximum_ to be newElement, rebalancing the right spine above it
+	// without comparing any keys
+	void appendNode(TreeMapNode* newElement);
+
+	// parameters:
+	// node- node of this map which is to be removed
+	// modifies:
+	// map to no longer contain node, which is freed, rebalancing the
+	// path from where it was up to the root
+	void eraseNode(TreeMapNode* node);
+
+	// parameters:
+	// parent- node whose child is to be replaced, or nullptr for the root
+	// child- parent's current child, or the root
+	// replacement- node to take child's place, or nullptr
+	// modifies:
+	// parent's link to child, or root_, to lead to replacement instead,
+	// and replacement's parent link to lead back
+	void replaceChild(TreeMapNode* parent, TreeMapNode* child,
+		TreeMapNode* replacement);
+
+	// parameters:
+	// node- node whose children are to be claimed
+	// modifies:
+	// parent links of node's children to lead to node
+	static void adoptChildren(TreeMapNode* node) {
+		if (node->left != nullptr) {
+			node->left->parent = node;
+		}
+		if (node->right != nullptr) {
+			node->right->parent = node;
+		}
+	};
+
+	// parameters:
+	// current- root of nonempty subtree
+	// returns:
+	// node holding the least key in subtree
+	static TreeMapNode* leftmost(TreeMapNode* current) {
+		while (current->left != nullptr) {
+			current = current->left;
+		}
+		return current;
+	};
+
+	// parameters:
+	// current- root of nonempty subtree
+	// returns:
+	// node holding the greatest key in subtree
+	static TreeMapNode* rightmost(TreeMapNode* current) {
+		while (current->right != nullptr) {
+			current = current->right;
+		}
+		return current;
+	};
+
+	// parameters:
+	// current- node of the tree
+	// returns:
+	// node holding the next key after current's, or nullptr if
+	// current holds the greatest. amortized O(1) over a whole walk
+	static TreeMapNode* successor(TreeMapNode* current);
+
+	// parameters:
+	// nodes- the map's new nodes, in ascending order of key
+	// root- root of those nodes arranged as a tree with up to date
+	// weights
+	// modifies:
+	// map to free its old nodes and hold the new ones instead
+	void replaceContents(const vector<TreeMapNode*>& nodes, TreeMapNode* root);
+
+	// parameters:
+	// current- node on the search path whose weight is up to date
+	// and which has just been returned to
+	// searchedChild- current's child on the search path
+	// tooDeep- whether a scapegoat is still sought
+	// returns:
+	// root of current's subtree after balancing it by the map's policy:
+	// rotated back into weight balance, or rebuilt if current is the
+	// scapegoat, i.e. if searchedChild holds more than 1 / sqrt(2) of
+	// current's subtree
+	TreeMap<K, V>::TreeMapNode* restoreBalance(TreeMapNode* current,
+		TreeMapNode* searchedChild, bool* tooDeep) const;
+
+	// parameters:
+	// current- node whose children are each weight-balanced and were
+	// balanced with each other before a single add or remove below
+	// returns:
+	// root of current's subtree after at most one single or double
+	// rotation which leaves it weight-balanced
+	static TreeMapNode* rotateIntoBalance(TreeMapNode* current);
+
+	// parameters:
+	// current- node whose right child takes its place
+	// returns:
+	// current's former right child, with weights of both updated
+	static TreeMapNode* rotateLeft(TreeMapNode* current);
+
+	// parameters:
+	// current- node whose left child takes its place
+	// returns:
+	// current's former left child, with weights of both updated
+	static TreeMapNode* rotateRight(TreeMapNode* current);
+
+	// parameters:
+	// current- root of subtree, or nullptr
+	// returns:
+	// number of nodes in subtree
+	static unsigned int weightOf(const TreeMapNode* current) {
+		return current == nullptr ? 0 : current->weight;
+	};
+
+	// parameters:
+	// size- number of nodes in the tree
+	// returns:
+	// depth (in edges) beyond which a node is too deep, which is
+	// floor(2 * log2(size)). any node deeper than this has an
+	// ancestor which makes a suitable scapegoat
+	static unsigned int depthLimit(unsigned int size);
+
+	// parameters:
+	// root- root of subtree which is to be rebuilt
+	// count- number of nodes in that subtree
+	// returns:
+	// root of the same nodes arranged as a perfectly balanced tree
+	// with up to date weights and parent links
+	static TreeMapNode* rebuildSubtree(TreeMapNode* root, unsigned int count);
+
+	// parameters:
+	// link- link to the first node of a vine (a tree in which no node
+	// has a left child)
+	// count- number of rotations to perform
+	// modifies:
+	// vine to have every other node among its first 2 * count rotated
+	// left beneath its successor, keeping weights and parent links correct
+	static void compressVine(TreeMapNode** link, unsigned int count);
+
+	// parameters:
+	// key- key of element which is to be looked up
+	// returns: node holding given key, or nullptr if there is none
+	TreeMap<K, V>::TreeMapNode* findHelper(const K& key) const;
+
+	// parameters:
+	// key- key of element which is to be looked up
+	// returns: node holding given key, or nullptr if there is none,
+	// found through the hash index if there is one, without sampling
+	TreeMap<K, V>::TreeMapNode* locate(const K& key) const;
+
+	// parameters:
+	// nodes- childless nodes in ascending order of key
+	// prefixWeights- prefixWeights[i] is the total weight of nodes[0, i)
+	// low- index of the first node of the subtree
+	// high- index one past the last node of the subtree
+	// returns:
+	// root of nodes[low, high) arranged by Mehlhorn's bisection rule
+	static TreeMapNode* buildWeightedHelper(const vector<TreeMapNode*>& nodes,
+		const vector<double>& prefixWeights, size_t low, size_t high);
+
+	// parameters:
+	// nodes- childless nodes in ascending order of key
+	// low- index of the first node of the subtree
+	// high- index one past the last node of the subtree
+	// returns:
+	// root of nodes[low, high) arranged as a perfectly balanced tree
+	static TreeMapNode* buildBalanced(const vector<TreeMapNode*>& nodes,
+		size_t low, size_t high);
+
+	// parameters:
+	// root- root of subtree which is to be exported, or nullptr
+	// keys- room for root's weight in keys
+	// values- room for root's weight in values
+	// splits- how many more times the work may be split between threads
+	// modifies:
+	// keys and values to hold the subtree's pairs in order of key
+	static void exportSubtree(TreeMapNode* root, K* keys, V* values,
+		unsigned int splits);
 
 	// parameters:
-	// current- root of subtree in which lookup is desired
 	// key- key of element which is to be looked up
-	// returns: value associated with given key
+	// returns: node holding given key, or nullptr if there is none
+	// modifies:
+	// hit count of every node on the search path
+	TreeMap<K, V>::TreeMapNode* sampledFind(const K& key) const;
+
+	// modifies:
+	// map to have an arena for new nodes, if it had none
+	// throws:
+	// bad_alloc if the arena cannot be allocated
+	void ensureArena();
+
+	// parameters:
+	// key- key whose hash is to be placed
+	// returns:
+	// slot of the hash index at which a search for key begins
+	size_t homeSlot(const K& key) const;
+
+	// parameters:
+	// count- number of keys the hash index must hold
+	// modifies:
+	// hash index to have room for count keys, rehashing if it grows
 	// throws:
-	// out of range excpetion if no key match is found
-	V& atHelper(TreeMapNode* current, const K& key) const;
+	// bad_alloc if a larger table cannot be allocated
+	void reserveHashIndex(unsigned int count);
+
+	// parameters:
+	// node- node not yet in the hash index, which has room for it
+	// modifies:
+	// hash index to map node's key to node
+	void indexNode(TreeMapNode* node);
+
+	// parameters:
+	// key- key which is to be dropped from the hash index
+	// modifies:
+	// hash index to no longer hold key, if it did
+	void unindexKey(const K& key);
+
+	// parameters:
+	// visit- callable as visit(TreeMapNode*)
+	// modifies:
+	// nothing once it returns or throws. calls visit on every node in
+	// order by Morris traversal, finishing the walk without visit if it
+	// throws so that every temporary link is undone
+	template<class Visit>
+	void morrisWalk(Visit visit) const;
+
+	// parameters:
+	// node- node which will soon be read, or nullptr
+	// modifies:
+	// cache to start loading node, where the compiler allows
+	static void prefetchNode(const TreeMapNode* node) {
+#if defined(__GNUC__) || defined(__clang__)
+		__builtin_prefetch(node);
+#else
+		(void)node;
+#endif
+	};
+
+	// parameters:
+	// key- key which is to be hashed
+	// returns:
+	// hash of key under Hash
+	template<class Hash>
+	static size_t hashWith(const K& key) { return Hash()(key); };
 };  // end class TreeMap
 
+template<class K, class V>
+TreeMap<K, V>::TreeMap(NodeArena::Backing backing, BalancePolicy policy)
+	: size_(0), maxSize_(0), root_(nullptr), maximum_(nullptr),
+	arena_(new NodeArena(sizeof(TreeMapNode), alignof(TreeMapNode), backing)),
+	heapNodes_(0), policy_(policy), hashIndex_(nullptr), samplePeriod_(0),
+	lookupsUntilSample_(0), iteratorBytes_(std::make_shared<std::atomic<size_t>>(0)) {}
+
+template<class K, class V>
+TreeMap<K, V>::TreeMap(void* storage, size_t bytes, BalancePolicy policy)
+	: size_(0), maxSize_(0), root_(nullptr), maximum_(nullptr),
+	arena_(new NodeArena(sizeof(TreeMapNode), alignof(TreeMapNode),
+		storage, bytes)),
+	heapNodes_(0), policy_(policy), hashIndex_(nullptr), samplePeriod_(0),
+	lookupsUntilSample_(0), iteratorBytes_(std::make_shared<std::atomic<size_t>>(0)) {}
+
+template<class K, class V>
+void TreeMap<K, V>::reserve(unsigned int count) {
+	ensureArena();
+	arena_->reserve(count);
+}
+
+template<class K, class V>
+void TreeMap<K, V>::ensureArena() {
+	if (arena_ == nullptr) {
+		arena_ = new NodeArena(sizeof(TreeMapNode), alignof(TreeMapNode),
+			NodeArena::Heap);
+	}
+}
+
 template<class K, class V>
 TreeMap<K, V>::~TreeMap() {
+	delete hashIndex_;
 	deleteTreeHelper(root_);
+	delete arena_;
 };
 
 template<class K, class V>
@@ -183,117 +858,701 @@ void TreeMap<K, V>::deleteTreeHelper(TreeMapNode* current) {
 	if (current != nullptr) {
 		deleteTreeHelper(current->left);
 		deleteTreeHelper(current->right);
-		delete current;
+		deleteNode(current);
 	}
 };
 
+template<class K, class V>
+typename TreeMap<K, V>::TreeMapNode*
+TreeMap<K, V>::newNode(const K& key, const V& value) {
+	if (arena_ == nullptr) {
+		TreeMapNode* node = new TreeMapNode{ pair<K, V>(key, value),
+			nullptr, nullptr, 1, 0, nullptr };
+		heapNodes_++;
+		return node;
+	}
+	void* slot = arena_->allocate();
+	try {
+		return new (slot) TreeMapNode{ pair<K, V>(key, value), nullptr, nullptr,
+			1, 0, nullptr };
+	}
+	catch (...) {
+		arena_->release(slot);
+		throw;
+	}
+}
+
+template<class K, class V>
+void TreeMap<K, V>::deleteNode(TreeMapNode* node) {
+	// nodes from before a reserve() may still be heap allocated
+	if (arena_ == nullptr || (heapNodes_ > 0 && !arena_->owns(node))) {
+		delete node;
+		heapNodes_--;
+	}
+	else {
+		node->~TreeMapNode();
+		arena_->release(node);
+	}
+}
+
 template<class K, class V>
 bool TreeMap<K, V>::add(const K& key, const V& value) {
 	// safely attempt to construct new node
 	TreeMapNode* newElement;
 	try {
-		newElement = new TreeMapNode{ pair<K, V>(key, value), nullptr, nullptr };
+		newElement = newNode(key, value);
 	}
 	catch (std::bad_alloc&) {
 		return false;
 	}
+	if (hashIndex_ != nullptr) {
+		// make room first, so the tree is never left ahead of the index
+		try {
+			reserveHashIndex(size_ + 1);
+		}
+		catch (std::bad_alloc&) {
+			deleteNode(newElement);
+			return false;
+		}
+	}
 
 	bool success;
-	root_ = addHelper(root_, newElement, &success);
+	if (root_ != nullptr && maximum_ == nullptr) {
+		maximum_ = rightmost(root_);
+	}
+	if (maximum_ != nullptr && maximum_->payload.first < key) {
+		appendNode(newElement);
+		success = true;
+	}
+	else {
+		bool tooDeep = false;
+		root_ = addHelper(root_, newElement, 0, &success, &tooDeep);
+		root_->parent = nullptr;
+		if (maximum_ == nullptr) {  // the map was empty
+			maximum_ = root_;
+		}
+	}
 	if (success) {  // only increment size if no key collision occured
+		if (hashIndex_ != nullptr) {
+			indexNode(newElement);
+		}
 		size_++;
+		if (size_ > maxSize_) {
+			maxSize_ = size_;
+		}
 	}
 	return success;
 };
 
-// function takes a TMN instead of a key, value pair because that allows for
-// nice re-use within removeHelper
 template<class K, class V>
 typename TreeMap<K, V>::TreeMapNode* TreeMap<K, V>::addHelper
-(TreeMapNode* current, TreeMapNode* newElement, bool* success) {
+(TreeMapNode* current, TreeMapNode* newElement, unsigned int depth,
+	bool* success, bool* tooDeep) {
 	if (current == nullptr) {  // reached location where new element belongs
 		*success = true;
+		*tooDeep = policy_ == PartialRebuild && depth > depthLimit(size_ + 1);
 		return newElement;
 	}
-	else if (current->payload.first < newElement->payload.first) {
-		current->right = addHelper(current->right, newElement, success);
+	TreeMapNode* searchedChild;
+	if (current->payload.first < newElement->payload.first) {
+		current->right = addHelper(current->right, newElement, depth + 1,
+			success, tooDeep);
+		searchedChild = current->right;
 	}
 	else if (current->payload.first > newElement->payload.first) {
-		current->left = addHelper(current->left, newElement, success);
+		current->left = addHelper(current->left, newElement, depth + 1,
+			success, tooDeep);
+		searchedChild = current->left;
 	}
 	else {  // key collision, tree will not be altered
 		*success = false;
-		delete newElement;
+		deleteNode(newElement);
+		return current;
 	}
-	return current;
+	if (!*success) {
+		return current;
+	}
+	adoptChildren(current);
+	current->weight++;
+	return restoreBalance(current, searchedChild, tooDeep);
 };
 
+template<class K, class V>
+void TreeMap<K, V>::appendNode(TreeMapNode* newElement) {
+	maximum_->right = newElement;
+	newElement->parent = maximum_;
+	maximum_ = newElement;
+	if (policy_ == WeightBalanced) {
+		// the same rotations addHelper makes on its way back up, but
+		// climbing the parent links of the right spine
+		for (TreeMapNode* current = newElement->parent; current != nullptr; ) {
+			TreeMapNode* above = current->parent;
+			current->weight++;
+			TreeMapNode* balanced = rotateIntoBalance(current);
+			if (balanced != current) {
+				replaceChild(above, current, balanced);
+			}
+			current = above;
+		}
+		return;
+	}
+	unsigned int depth = 0;
+	for (TreeMapNode* current = newElement->parent; current != nullptr;
+		current = current->parent) {
+		current->weight++;
+		depth++;
+	}
+	if (depth <= depthLimit(size_ + 1)) {
+		return;
+	}
+	// rarely, climb again to rebuild the lowest scapegoat
+	bool tooDeep = true;
+	TreeMapNode* searchedChild = newElement;
+	for (TreeMapNode* current = newElement->parent; current != nullptr && tooDeep; ) {
+		TreeMapNode* above = current->parent;
+		TreeMapNode* balanced = restoreBalance(current, searchedChild, &tooDeep);
+		if (balanced != current) {
+			replaceChild(above, current, balanced);
+		}
+		searchedChild = balanced;
+		current = above;
+	}
+}
+
 template<class K, class V>
 V TreeMap<K, V>::remove(const K& key) {
-	V retVal;
-	root_ = removeHelper(root_, key, &retVal);
-	size_--;
+	TreeMapNode* node = locate(key);
+	if (node == nullptr) {  // given key was bad
+		throw std::out_of_range("No such key exists in this tree.");
+	}
+	V retVal = node->payload.second;
+	eraseNode(node);
 	return retVal;
 };
 
 template<class K, class V>
-typename TreeMap<K, V>::TreeMapNode*
-TreeMap<K, V>::removeHelper(TreeMapNode* current, const K& key, V* retVal) {
-	if (current == nullptr) {  // given key was bad
-		throw std::out_of_range("No such key exists in this tree.");
+typename TreeMap<K, V>::TreeIterator
+TreeMap<K, V>::erase(TreeIterator position) {
+	if (!position.isLegal()) {
+		throw std::out_of_range("This iterator is past its end.");
 	}
-	else if (current->payload.first < key) {
-		current->right = removeHelper(current->right, key, retVal);
+	TreeMapNode* node = position.current_;
+	// the next node survives the removal where it is, since nodes
+	// are relinked rather than copied
+	++position;
+	eraseNode(node);
+	return position;
+}
+
+template<class K, class V>
+void TreeMap<K, V>::eraseNode(TreeMapNode* node) {
+	if (hashIndex_ != nullptr) {
+		// while the node still exists to compare keys against
+		unindexKey(node->payload.first);
+	}
+	if (node == maximum_) {
+		// its predecessor, which neither relinking nor rebalancing moves
+		maximum_ = node->left != nullptr ? rightmost(node->left) : node->parent;
+	}
+	TreeMapNode* parent = node->parent;
+	// deepest node whose subtree has lost a node, from which the
+	// path is repaired upwards
+	TreeMapNode* lowest = parent;
+	TreeMapNode* replacement;
+	if (node->left == nullptr) {
+		replacement = node->right;
 	}
-	else if (current->payload.first > key) {
-		current->left = removeHelper(current->left, key, retVal);
+	else if (node->right == nullptr) {
+		replacement = node->left;
 	}
 	else {
-		*retVal = current->payload.second;
-		// connect right subtree to left subtree in manner which
-		// upholds BST properties
-		// this can lead to some pretty poor tree balancing 
-		// but this class makes no balance guarantees.
-
-		// I experimented with a solution that added the left
-		// and right subtrees individually to the root rather than stacking one
-		// on to the other, and surprisingly saw no tree balance
-		// improvements, so I reverted to this simpler solution.
-		bool unused;
-		TreeMapNode* remainingSubtree;
-		if (current->right != nullptr) {  // we can't insert a null node into
-			// tree so we first must check current->right is not null
-			remainingSubtree = addHelper(current->left, current->right, &unused);
+		// replace node with its in-order successor, which unlike
+		// stacking one subtree onto the other never deepens any node.
+		// the successor is relinked rather than copied so that nodes
+		// keep their addresses
+		replacement = leftmost(node->right);
+		if (replacement == node->right) {
+			lowest = replacement;
 		}
 		else {
-			remainingSubtree = current->left;
+			lowest = replacement->parent;
+			lowest->left = replacement->right;
+			if (lowest->left != nullptr) {
+				lowest->left->parent = lowest;
+			}
+			replacement->right = node->right;
 		}
-		// clean up removed node
-		delete current;
-		return remainingSubtree;
+		replacement->left = node->left;
+		// one more than it ends with, as the repair passes through it
+		replacement->weight = node->weight;
+		adoptChildren(replacement);
+	}
+	replaceChild(parent, node, replacement);
+	// clean up removed node
+	deleteNode(node);
+	size_--;
+
+	// the node now where it was may be too deep for the smaller tree
+	bool tooDeep = false;
+	if (policy_ == PartialRebuild && size_ > 0) {
+		unsigned int depth = 0;
+		for (TreeMapNode* ancestor = parent; ancestor != nullptr;
+			ancestor = ancestor->parent) {
+			depth++;
+		}
+		tooDeep = depth > depthLimit(size_);
+	}
+	// only the removed node's ancestors can be scapegoats for it
+	bool aboveRemoved = lowest == parent;
+	TreeMapNode* searchedChild = aboveRemoved ? replacement : nullptr;
+	for (TreeMapNode* current = lowest; current != nullptr; ) {
+		TreeMapNode* above = current->parent;
+		current->weight--;
+		bool searching = aboveRemoved && tooDeep;
+		TreeMapNode* balanced = restoreBalance(current, searchedChild, &searching);
+		if (aboveRemoved) {
+			tooDeep = searching;
+		}
+		if (balanced != current) {
+			replaceChild(above, current, balanced);
+		}
+		aboveRemoved = aboveRemoved || current == replacement;
+		searchedChild = balanced;
+		current = above;
+	}
+
+	// paths the removal didn't walk can also outgrow the shrinking
+	// depth limit, so once enough of the tree has gone rebuild all of it
+	if (policy_ == PartialRebuild && 2 * (unsigned long long)size_ * size_
+		< (unsigned long long)maxSize_ * maxSize_) {
+		rebalance();
+	}
+}
+
+template<class K, class V>
+typename TreeMap<K, V>::TreeMapNode*
+TreeMap<K, V>::successor(TreeMapNode* current) {
+	if (current->right != nullptr) {
+		// the least key of the right subtree comes next
+		return leftmost(current->right);
+	}
+	// else climb past every ancestor of which this is a right
+	// descendant, to the first of which it is a left one
+	TreeMapNode* child = current;
+	current = current->parent;
+	while (current != nullptr && current->right == child) {
+		child = current;
+		current = current->parent;
 	}
 	return current;
-};
+}
 
 template<class K, class V>
-V& TreeMap<K, V>::at(const K& key) const {
-	return atHelper(root_, key);
+void TreeMap<K, V>::replaceChild(TreeMapNode* parent, TreeMapNode* child,
+	TreeMapNode* replacement) {
+	if (parent == nullptr) {
+		root_ = replacement;
+	}
+	else if (parent->left == child) {
+		parent->left = replacement;
+	}
+	else {
+		parent->right = replacement;
+	}
+	if (replacement != nullptr) {
+		replacement->parent = parent;
+	}
 }
 
 template<class K, class V>
-V& TreeMap<K, V>::atHelper(TreeMapNode* current, const K& key) const {
-	if (current == nullptr) {
+typename TreeMap<K, V>::TreeMapNode*
+TreeMap<K, V>::restoreBalance(TreeMapNode* current, TreeMapNode* searchedChild,
+	bool* tooDeep) const {
+	if (policy_ == WeightBalanced) {
+		return rotateIntoBalance(current);
+	}
+	if (!*tooDeep) {
+		return current;
+	}
+	unsigned long long childSize = weightOf(searchedChild);
+	unsigned long long size = current->weight;
+	// weight-unbalanced with alpha = 1 / sqrt(2), which is what makes
+	// the depth limit 2 * log2(size)
+	if (2 * childSize * childSize > size * size) {
+		*tooDeep = false;
+		return rebuildSubtree(current, current->weight);
+	}
+	return current;
+}
+
+template<class K, class V>
+typename TreeMap<K, V>::TreeMapNode*
+TreeMap<K, V>::rotateIntoBalance(TreeMapNode* current) {
+	unsigned long long left = weightOf(current->left) + 1;
+	unsigned long long right = weightOf(current->right) + 1;
+	if (right > BALANCE_DELTA * left) {
+		TreeMapNode* child = current->right;
+		if (weightOf(child->left) + 1
+			>= BALANCE_GAMMA * (weightOf(child->right) + 1ull)) {
+			current->right = rotateRight(child);
+		}
+		return rotateLeft(current);
+	}
+	if (left > BALANCE_DELTA * right) {
+		TreeMapNode* child = current->left;
+		if (weightOf(child->right) + 1
+			>= BALANCE_GAMMA * (weightOf(child->left) + 1ull)) {
+			current->left = rotateLeft(child);
+		}
+		return rotateRight(current);
+	}
+	return current;
+}
+
+template<class K, class V>
+typename TreeMap<K, V>::TreeMapNode*
+TreeMap<K, V>::rotateLeft(TreeMapNode* current) {
+	TreeMapNode* rightChild = current->right;
+	current->right = rightChild->left;
+	rightChild->left = current;
+	rightChild->weight = current->weight;
+	current->weight = 1 + weightOf(current->left) + weightOf(current->right);
+	adoptChildren(current);
+	adoptChildren(rightChild);
+	return rightChild;
+}
+
+template<class K, class V>
+typename TreeMap<K, V>::TreeMapNode*
+TreeMap<K, V>::rotateRight(TreeMapNode* current) {
+	TreeMapNode* leftChild = current->left;
+	current->left = leftChild->right;
+	leftChild->right = current;
+	leftChild->weight = current->weight;
+	current->weight = 1 + weightOf(current->left) + weightOf(current->right);
+	adoptChildren(current);
+	adoptChildren(leftChild);
+	return leftChild;
+}
+
+template<class K, class V>
+unsigned int TreeMap<K, V>::depthLimit(unsigned int size) {
+	// floor(2 * log2(size)) is floor(log2(size * size))
+	unsigned long long squared = (unsigned long long)size * size;
+	unsigned int limit = 0;
+	while (squared > 1) {
+		squared >>= 1;
+		limit++;
+	}
+	return limit;
+}
+
+template<class K, class V>
+V& TreeMap<K, V>::at(const K& key) const {
+	TreeMapNode* found = findHelper(key);
+	if (found == nullptr) {
 		throw std::out_of_range("No such key exists in this tree.");
 	}
-	else if (current->payload.first < key) {
-		return atHelper(current->right, key);
+	return found->payload.second;
+}
+
+template<class K, class V>
+V* TreeMap<K, V>::find(const K& key) const {
+	TreeMapNode* found = findHelper(key);
+	return found == nullptr ? nullptr : &found->payload.second;
+}
+
+template<class K, class V>
+typename TreeMap<K, V>::TreeMapNode*
+TreeMap<K, V>::findHelper(const K& key) const {
+	if (samplePeriod_ != 0 && --lookupsUntilSample_ == 0) {
+		lookupsUntilSample_ = samplePeriod_;
+		return sampledFind(key);
 	}
-	else if (current->payload.first > key) {
-		return atHelper(current->left, key);
+	return locate(key);
+}
+
+template<class K, class V>
+typename TreeMap<K, V>::TreeMapNode*
+TreeMap<K, V>::locate(const K& key) const {
+	if (hashIndex_ != nullptr) {
+		size_t mask = hashIndex_->slots.size() - 1;
+		for (size_t slot = homeSlot(key); ; slot = (slot + 1) & mask) {
+			TreeMapNode* candidate = hashIndex_->slots[slot];
+			if (candidate == nullptr || candidate->payload.first == key) {
+				return candidate;
+			}
+		}
 	}
-	else {
-		return  current->payload.second;
+	TreeMapNode* current = root_;
+	while (current != nullptr) {
+		if (current->payload.first < key) {
+			current = current->right;
+		}
+		else if (current->payload.first > key) {
+			current = current->left;
+		}
+		else {
+			return current;
+		}
+	}
+	return nullptr;
+}
+
+template<class K, class V>
+typename TreeMap<K, V>::TreeMapNode*
+TreeMap<K, V>::sampledFind(const K& key) const {
+	TreeMapNode* current = root_;
+	while (current != nullptr) {
+		if (current->hits != UINT_MAX) {
+			current->hits++;
+		}
+		if (current->payload.first < key) {
+			current = current->right;
+		}
+		else if (current->payload.first > key) {
+			current = current->left;
+		}
+		else {
+			return current;
+		}
+	}
+	return nullptr;
+}
+
+template<class K, class V>
+void TreeMap<K, V>::sampleAccesses(unsigned int period) {
+	samplePeriod_ = period;
+	lookupsUntilSample_ = period;
+}
+
+template<class K, class V>
+unsigned int TreeMap<K, V>::relocateHot(unsigned int count) {
+	if (count > size_) {
+		count = size_;
+	}
+	if (count == 0) {
+		return 0;
+	}
+	vector<TreeMapNode*> nodes;
+	nodes.reserve(size_);
+	nodes.push_back(root_);
+	for (size_t i = 0; i < nodes.size(); i++) {
+		if (nodes[i]->left != nullptr) {
+			nodes.push_back(nodes[i]->left);
+		}
+		if (nodes[i]->right != nullptr) {
+			nodes.push_back(nodes[i]->right);
+		}
+	}
+
+	// the count-th highest hit count, below which nothing moves
+	vector<unsigned int> hits(nodes.size());
+	for (size_t i = 0; i < nodes.size(); i++) {
+		hits[i] = nodes[i]->hits;
+	}
+	std::nth_element(hits.begin(), hits.begin() + (count - 1), hits.end(),
+		[](unsigned int a, unsigned int b) { return a > b; });
+	unsigned int threshold = hits[count - 1] > 0 ? hits[count - 1] : 1;
+
+	// hot nodes breadth-first, taken from every node rather than by
+	// walking down from the root, since rotations and rebuilds re-parent
+	// nodes and can leave a hot node below a colder one
+	vector<TreeMapNode*> hot;
+	hot.reserve(count);
+	for (size_t i = 0; i < nodes.size() && hot.size() < count; i++) {
+		if (nodes[i]->hits >= threshold) {
+			hot.push_back(nodes[i]);
+		}
+	}
+	if (hot.empty()) {
+		return 0;
+	}
+
+	ensureArena();
+	TreeMapNode* run = static_cast<TreeMapNode*>(
+		arena_->allocateContiguous(hot.size()));
+	for (size_t i = 0; i < hot.size(); i++) {
+		TreeMapNode* from = hot[i];
+		TreeMapNode* to = new (run + i) TreeMapNode{ std::move(from->payload),
+			from->right, from->left, from->weight, from->hits, nullptr };
+		// a parent moved earlier has already claimed from
+		replaceChild(from->parent, from, to);
+		adoptChildren(to);
+		if (from == maximum_) {
+			maximum_ = to;
+		}
+		if (hashIndex_ != nullptr) {
+			size_t mask = hashIndex_->slots.size() - 1;
+			size_t slot = homeSlot(to->payload.first);
+			while (hashIndex_->slots[slot] != from) {
+				slot = (slot + 1) & mask;
+			}
+			hashIndex_->slots[slot] = to;
+		}
+		deleteNode(from);
+	}
+
+	// age every count, moved or not
+	nodes.clear();
+	nodes.push_back(root_);
+	while (!nodes.empty()) {
+		TreeMapNode* current = nodes.back();
+		nodes.pop_back();
+		current->hits /= 2;
+		if (current->left != nullptr) {
+			nodes.push_back(current->left);
+		}
+		if (current->right != nullptr) {
+			nodes.push_back(current->right);
+		}
+	}
+	return static_cast<unsigned int>(hot.size());
+}
+
+template<class K, class V>
+template<class Hash>
+void TreeMap<K, V>::enableHashIndex() {
+	TreeMapHashIndex* index = new TreeMapHashIndex{ vector<TreeMapNode*>(), 0,
+		&TreeMap<K, V>::template hashWith<Hash> };
+	TreeMapHashIndex* previous = hashIndex_;
+	hashIndex_ = index;
+	try {
+		reserveHashIndex(size_);
+	}
+	catch (std::bad_alloc&) {
+		hashIndex_ = previous;
+		delete index;
+		throw;
+	}
+	delete previous;
+	morrisWalk([this](TreeMapNode* node) { indexNode(node); });
+}
+
+template<class K, class V>
+template<class Visit>
+void TreeMap<K, V>::forEachInOrder(Visit visit) const {
+	morrisWalk([&visit](TreeMapNode* node) {
+		visit(static_cast<const pair<K, V>&>(node->payload));
+	});
+}
+
+template<class K, class V>
+template<class Visit>
+void TreeMap<K, V>::morrisWalk(Visit visit) const {
+	TreeMapNode* current = root_;
+	// what visit threw, if it has. the threads still in place must be
+	// undone, so the walk carries on to the end without visiting
+	std::exception_ptr failure;
+	while (current != nullptr) {
+		TreeMapNode* visited = nullptr;
+		if (current->left == nullptr) {
+			visited = current;
+			current = current->right;
+		}
+		else {
+			TreeMapNode* predecessor = current->left;
+			while (predecessor->right != nullptr && predecessor->right != current) {
+				predecessor = predecessor->right;
+			}
+			if (predecessor->right == nullptr) {
+				// thread the predecessor back up so the walk can return
+				predecessor->right = current;
+				current = current->left;
+			}
+			else {
+				// back from the left subtree, so the thread has served
+				predecessor->right = nullptr;
+				visited = current;
+				current = current->right;
+			}
+		}
+		if (visited != nullptr && !failure) {
+			try {
+				visit(visited);
+			}
+			catch (...) {
+				failure = std::current_exception();
+			}
+		}
+	}
+	if (failure) {
+		std::rethrow_exception(failure);
+	}
+}
+
+template<class K, class V>
+void TreeMap<K, V>::disableHashIndex() {
+	delete hashIndex_;
+	hashIndex_ = nullptr;
+}
+
+template<class K, class V>
+size_t TreeMap<K, V>::homeSlot(const K& key) const {
+	// scramble the hash (Fibonacci hashing), since std::hash is the
+	// identity for integers and linear probing clusters badly on that
+	uint64_t mixed = uint64_t(hashIndex_->hashKey(key)) * 0x9E3779B97F4A7C15ull;
+	return size_t(mixed >> 32) & (hashIndex_->slots.size() - 1);
+}
+
+template<class K, class V>
+void TreeMap<K, V>::reserveHashIndex(unsigned int count) {
+	// kept at most three quarters full so probes stay short
+	size_t capacity = hashIndex_->slots.size();
+	if (capacity != 0 && (unsigned long long)count * 4 <= capacity * 3) {
+		return;
+	}
+	if (capacity == 0) {
+		capacity = 16;
+	}
+	while ((unsigned long long)count * 4 > capacity * 3) {
+		capacity *= 2;
+	}
+	vector<TreeMapNode*> previous(capacity, nullptr);
+	previous.swap(hashIndex_->slots);
+	hashIndex_->count = 0;
+	for (TreeMapNode* node : previous) {
+		if (node != nullptr) {
+			indexNode(node);
+		}
+	}
+}
+
+template<class K, class V>
+void TreeMap<K, V>::indexNode(TreeMapNode* node) {
+	size_t mask = hashIndex_->slots.size() - 1;
+	size_t slot = homeSlot(node->payload.first);
+	while (hashIndex_->slots[slot] != nullptr) {
+		slot = (slot + 1) & mask;
 	}
+	hashIndex_->slots[slot] = node;
+	hashIndex_->count++;
+}
+
+template<class K, class V>
+void TreeMap<K, V>::unindexKey(const K& key) {
+	vector<TreeMapNode*>& slots = hashIndex_->slots;
+	size_t mask = slots.size() - 1;
+	size_t hole = homeSlot(key);
+	while (slots[hole] != nullptr && !(slots[hole]->payload.first == key)) {
+		hole = (hole + 1) & mask;
+	}
+	if (slots[hole] == nullptr) {
+		return;
+	}
+	hashIndex_->count--;
+	// shift back any later node of the run which may no longer be
+	// found past the hole, so that no tombstones are needed
+	for (size_t next = (hole + 1) & mask; slots[next] != nullptr;
+		next = (next + 1) & mask) {
+		size_t home = homeSlot(slots[next]->payload.first);
+		// distance from home to next, against from home to hole
+		if (((next - home) & mask) >= ((next - hole) & mask)) {
+			slots[hole] = slots[next];
+			hole = next;
+		}
+	}
+	slots[hole] = nullptr;
 }
 
 template<class K, class V>
@@ -302,31 +1561,353 @@ unsigned int TreeMap<K, V>::size() const {
 }
 
 template<class K, class V>
-TreeMap<K, V>::TreeIterator::TreeIterator(TreeMapNode* root)
-	: toBeProcessed_(new stack<TreeMapNode*>()) {
-	while (root != nullptr) {
-		// to perform in-order traversal we must start
-		// in the most left ancestor of the root
-		// but remember those seen along the way
-		toBeProcessed_->push(root);
-		root = root->left;
+MemoryUsage TreeMap<K, V>::memoryUsage() const {
+	MemoryUsage usage = MemoryUsage();
+	usage.nodeBytes = size_ * sizeof(TreeMapNode);
+	usage.slackBytes = heapNodes_ * (MemoryUsage::heapBlockSize(sizeof(TreeMapNode))
+		- sizeof(TreeMapNode));
+	if (arena_ != nullptr) {
+		// free slots, slot padding, and the uncarved end of the
+		// newest region are all slack
+		usage.slackBytes += arena_->bytesReserved()
+			- arena_->slotsInUse() * sizeof(TreeMapNode);
+		usage.auxiliaryBytes += MemoryUsage::heapBlockSize(sizeof(NodeArena));
 	}
-};
+	if (hashIndex_ != nullptr) {
+		usage.auxiliaryBytes += MemoryUsage::heapBlockSize(sizeof(TreeMapHashIndex))
+			+ MemoryUsage::heapBlockSize(
+				hashIndex_->slots.size() * sizeof(TreeMapNode*));
+	}
+	usage.iteratorBytes = iteratorBytes_->load(std::memory_order_relaxed);
+	usage.nodeTypes.push_back(
+		MemoryUsage::NodeTypeUsage{ "TreeMapNode", size_, usage.nodeBytes });
+	return usage;
+}
 
 template<class K, class V>
-TreeMap<K, V>::TreeIterator::TreeIterator(const TreeIterator& tit)
-	: toBeProcessed_(new stack<TreeMapNode*>()) {
-	*toBeProcessed_ = *tit.toBeProcessed_;
+unsigned int TreeMap<K, V>::height() const {
+	unsigned int tallest = 0;
+	// unbalanced trees can be very deep, so walk them without recursion
+	vector<pair<TreeMapNode*, unsigned int>> pending;
+	if (root_ != nullptr) {
+		pending.push_back(pair<TreeMapNode*, unsigned int>(root_, 1));
+	}
+	while (!pending.empty()) {
+		TreeMapNode* current = pending.back().first;
+		unsigned int depth = pending.back().second;
+		pending.pop_back();
+		if (depth > tallest) {
+			tallest = depth;
+		}
+		if (current->left != nullptr) {
+			pending.push_back(pair<TreeMapNode*, unsigned int>(current->left, depth + 1));
+		}
+		if (current->right != nullptr) {
+			pending.push_back(pair<TreeMapNode*, unsigned int>(current->right, depth + 1));
+		}
+	}
+	return tallest;
+}
+
+template<class K, class V>
+unsigned int TreeMap<K, V>::depthOf(const K& key) const {
+	unsigned int depth = 1;
+	TreeMapNode* current = root_;
+	while (current != nullptr) {
+		if (current->payload.first < key) {
+			current = current->right;
+		}
+		else if (current->payload.first > key) {
+			current = current->left;
+		}
+		else {
+			return depth;
+		}
+		depth++;
+	}
+	throw std::out_of_range("No such key exists in this tree.");
+}
+
+template<class K, class V>
+void TreeMap<K, V>::buildWeighted(
+	const vector<std::tuple<K, V, double>>& entries) {
+	vector<size_t> order(entries.size());
+	for (size_t i = 0; i < order.size(); i++) {
+		order[i] = i;
+	}
+	// stable so that the first of any equivalent keys comes first
+	std::stable_sort(order.begin(), order.end(), [&entries](size_t a, size_t b) {
+		return std::get<0>(entries[a]) < std::get<0>(entries[b]);
+	});
+
+	// allocate every node before touching the tree, so a failure
+	// leaves the map as it was
+	vector<TreeMapNode*> nodes;
+	vector<double> prefixWeights(1, 0.0);
+	try {
+		nodes.reserve(order.size());
+		prefixWeights.reserve(order.size() + 1);
+		for (size_t index : order) {
+			const std::tuple<K, V, double>& entry = entries[index];
+			if (!nodes.empty() && nodes.back()->payload.first == std::get<0>(entry)) {
+				continue;
+			}
+			nodes.push_back(newNode(std::get<0>(entry), std::get<1>(entry)));
+			double weight = std::get<2>(entry) > 0 ? std::get<2>(entry) : 0;
+			prefixWeights.push_back(prefixWeights.back() + weight);
+		}
+		if (hashIndex_ != nullptr) {
+			reserveHashIndex(static_cast<unsigned int>(nodes.size()));
+		}
+	}
+	catch (std::bad_alloc&) {
+		for (TreeMapNode* node : nodes) {
+			deleteNode(node);
+		}
+		throw;
+	}
+
+	replaceContents(nodes, buildWeightedHelper(nodes, prefixWeights, 0,
+		nodes.size()));
+}
+
+template<class K, class V>
+void TreeMap<K, V>::importColumns(const K* keys, const V* values,
+	size_t count) {
+	for (size_t i = 1; i < count; i++) {
+		if (!(keys[i - 1] < keys[i])) {
+			throw std::invalid_argument("Keys must be in strictly ascending order.");
+		}
+	}
+	// allocate every node before touching the tree, so a failure
+	// leaves the map as it was
+	vector<TreeMapNode*> nodes;
+	try {
+		nodes.reserve(count);
+		for (size_t i = 0; i < count; i++) {
+			nodes.push_back(newNode(keys[i], values[i]));
+		}
+		if (hashIndex_ != nullptr) {
+			reserveHashIndex(static_cast<unsigned int>(count));
+		}
+	}
+	catch (std::bad_alloc&) {
+		for (TreeMapNode* node : nodes) {
+			deleteNode(node);
+		}
+		throw;
+	}
+	replaceContents(nodes, buildBalanced(nodes, 0, nodes.size()));
+}
+
+template<class K, class V>
+void TreeMap<K, V>::importColumns(const vector<K>& keys,
+	const vector<V>& values) {
+	if (keys.size() != values.size()) {
+		throw std::invalid_argument("There must be as many values as keys.");
+	}
+	importColumns(keys.data(), values.data(), keys.size());
+}
+
+template<class K, class V>
+void TreeMap<K, V>::replaceContents(const vector<TreeMapNode*>& nodes,
+	TreeMapNode* root) {
+	if (hashIndex_ != nullptr) {
+		std::fill(hashIndex_->slots.begin(), hashIndex_->slots.end(), nullptr);
+		hashIndex_->count = 0;
+		for (TreeMapNode* node : nodes) {
+			indexNode(node);
+		}
+	}
+	deleteTreeHelper(root_);
+	root_ = root;
+	if (root_ != nullptr) {
+		root_->parent = nullptr;
+	}
+	maximum_ = nodes.empty() ? nullptr : nodes.back();
+	size_ = static_cast<unsigned int>(nodes.size());
+	maxSize_ = size_;
+}
+
+template<class K, class V>
+typename TreeMap<K, V>::TreeMapNode*
+TreeMap<K, V>::buildBalanced(const vector<TreeMapNode*>& nodes, size_t low,
+	size_t high) {
+	if (low >= high) {
+		return nullptr;
+	}
+	size_t root = low + (high - low) / 2;
+	TreeMapNode* node = nodes[root];
+	node->left = buildBalanced(nodes, low, root);
+	node->right = buildBalanced(nodes, root + 1, high);
+	node->weight = static_cast<unsigned int>(high - low);
+	adoptChildren(node);
+	return node;
+}
+
+template<class K, class V>
+void TreeMap<K, V>::exportColumns(K* keys, V* values) const {
+	// enough splits to give every hardware thread a subtree
+	unsigned int splits = 0;
+	for (unsigned int threads = 1; threads < std::thread::hardware_concurrency();
+		threads *= 2) {
+		splits++;
+	}
+	exportSubtree(root_, keys, values, splits);
+}
+
+template<class K, class V>
+void TreeMap<K, V>::exportColumns(vector<K>* keys, vector<V>* values) const {
+	keys->resize(size_);
+	values->resize(size_);
+	exportColumns(keys->data(), values->data());
+}
+
+template<class K, class V>
+void TreeMap<K, V>::exportSubtree(TreeMapNode* root, K* keys, V* values,
+	unsigned int splits) {
+	if (root == nullptr) {
+		return;
+	}
+	if (splits > 0 && root->weight >= EXPORT_GRAIN) {
+		// root's place follows its left subtree's span
+		size_t position = weightOf(root->left);
+		keys[position] = root->payload.first;
+		values[position] = root->payload.second;
+		std::future<void> left;
+		try {
+			left = std::async(std::launch::async, &TreeMap<K, V>::exportSubtree,
+				root->left, keys, values, splits - 1);
+		}
+		catch (std::system_error&) {
+			// no thread to be had, so do without
+			exportSubtree(root->left, keys, values, 0);
+		}
+		exportSubtree(root->right, keys + position + 1, values + position + 1,
+			splits - 1);
+		if (left.valid()) {
+			left.get();
+		}
+		return;
+	}
+	TreeMapNode* current = leftmost(root);
+	for (unsigned int i = 0; i < root->weight; i++) {
+		keys[i] = current->payload.first;
+		values[i] = current->payload.second;
+		current = successor(current);
+	}
+}
+
+template<class K, class V>
+typename TreeMap<K, V>::TreeMapNode*
+TreeMap<K, V>::buildWeightedHelper(const vector<TreeMapNode*>& nodes,
+	const vector<double>& prefixWeights, size_t low, size_t high) {
+	if (low >= high) {
+		return nullptr;
+	}
+	size_t root;
+	double total = prefixWeights[high] - prefixWeights[low];
+	if (total <= 0) {
+		// nothing to go on, so fall back to a balanced split
+		root = low + (high - low) / 2;
+	}
+	else {
+		// the node whose weight interval [prefix[i], prefix[i + 1])
+		// holds the subtree's midpoint
+		double midpoint = prefixWeights[low] + total / 2;
+		root = std::upper_bound(prefixWeights.begin() + low + 1,
+			prefixWeights.begin() + high + 1, midpoint)
+			- prefixWeights.begin() - 1;
+		if (root >= high) {
+			root = high - 1;
+		}
+	}
+	TreeMapNode* node = nodes[root];
+	node->left = buildWeightedHelper(nodes, prefixWeights, low, root);
+	node->right = buildWeightedHelper(nodes, prefixWeights, root + 1, high);
+	node->weight = static_cast<unsigned int>(high - low);
+	adoptChildren(node);
+	return node;
+}
+
+template<class K, class V>
+void TreeMap<K, V>::rebalance() {
+	root_ = rebuildSubtree(root_, size_);
+	if (root_ != nullptr) {
+		root_->parent = nullptr;
+	}
+	maxSize_ = size_;
+}
+
+template<class K, class V>
+typename TreeMap<K, V>::TreeMapNode*
+TreeMap<K, V>::rebuildSubtree(TreeMapNode* root, unsigned int count) {
+	// first flatten the tree into a vine by rotating right
+	// at every node which still has a left child. a node is in its final
+	// place on the vine once it has none, so it gets its weight and parent
+	// then
+	TreeMapNode* head = root;
+	TreeMapNode** link = &head;
+	TreeMapNode* previous = root == nullptr ? nullptr : root->parent;
+	unsigned int remaining = count;
+	while (*link != nullptr) {
+		TreeMapNode* current = *link;
+		if (current->left == nullptr) {
+			current->weight = remaining--;
+			current->parent = previous;
+			previous = current;
+			link = &current->right;
+		}
+		else {
+			TreeMapNode* leftChild = current->left;
+			current->left = leftChild->right;
+			leftChild->right = current;
+			*link = leftChild;
+		}
+	}
+
+	// then fold the vine back up. the first pass hangs the nodes which
+	// don't fit in a complete tree off as its bottom level, after which
+	// each pass halves the length of the vine
+	unsigned int complete = 1;
+	while (complete <= count + 1) {
+		complete *= 2;
+	}
+	complete = complete / 2 - 1;  // largest 2^k - 1 not exceeding count
+	compressVine(&head, count - complete);
+	while (complete > 1) {
+		complete /= 2;
+		compressVine(&head, complete);
+	}
+	return head;
+}
+
+template<class K, class V>
+void TreeMap<K, V>::compressVine(TreeMapNode** link, unsigned int count) {
+	for (unsigned int i = 0; i < count; i++) {
+		TreeMapNode* child = *link;
+		TreeMapNode* next = child->right;
+		*link = next;
+		next->parent = child->parent;
+		child->right = next->left;
+		next->left = child;
+		adoptChildren(child);
+		adoptChildren(next);
+		// next now holds exactly the nodes child held
+		next->weight = child->weight;
+		child->weight = 1 + weightOf(child->left) + weightOf(child->right);
+		link = &next->right;
+	}
 }
 
 template<class K, class V>
 bool TreeMap<K, V>::TreeIterator::operator==(const TreeIterator& rhs) const {
-	return *toBeProcessed_ == *rhs.toBeProcessed_;
+	return current_ == rhs.current_;
 }
 
 template<class K, class V>
 bool TreeMap<K, V>::TreeIterator::operator!=(const TreeIterator& rhs) const {
-	return *toBeProcessed_ != *rhs.toBeProcessed_;
+	return current_ != rhs.current_;
 }
 
 template<class K, class V>
@@ -335,17 +1916,7 @@ TreeMap<K, V>::TreeIterator::operator++() {
 	if (!isLegal()) {
 		throw std::out_of_range("This iterator is past its end.");
 	}
-	TreeMapNode* current = toBeProcessed_->top();
-	toBeProcessed_->pop();
-	// if possible move to right child once
-	// then move left as many times as possible
-	if (current->right != nullptr) {
-		current = current->right;
-		while (current != nullptr) {
-			toBeProcessed_->push(current);
-			current = current->left;
-		}
-	}
+	current_ = successor(current_);
 	return *this;
 }
 
@@ -362,7 +1933,7 @@ const pair<K, V>& TreeMap<K, V>::TreeIterator::operator*() const {
 	if (!isLegal()) {
 		throw std::out_of_range("This iterator is past its end.");
 	}
-	return toBeProcessed_->top()->payload;
+	return current_->payload;
 }
 
 template<class K, class V>
@@ -370,20 +1941,247 @@ pair<K, V> const* TreeMap<K, V>::TreeIterator::operator->() const {
 	if (!isLegal()) {
 		throw std::out_of_range("This iterator is past its end.");
 	}
-	TreeMapNode* current = toBeProcessed_->top();
-	return &(current->payload);
+	return &current_->payload;
+}
+
+template<class K, class V>
+TreeMap<K, V>::ScanIterator::ScanIterator(TreeMapNode* root,
+	const K* lowerBound, const shared_ptr<std::atomic<size_t>>& tally)
+	: path_(CountingAllocator<TreeMapNode*>(tally)) {
+	// room for the path of any tree balanced by add and remove
+	path_.reserve(64);
+	if (lowerBound == nullptr) {
+		descend(root);
+		return;
+	}
+	// keep only the nodes at or after lowerBound on the search path,
+	// which are exactly the ones still to be visited
+	while (root != nullptr) {
+		if (root->payload.first < *lowerBound) {
+			root = root->right;
+		}
+		else {
+			prefetchNode(root->right);
+			path_.push_back(root);
+			root = root->left;
+		}
+	}
+}
+
+template<class K, class V>
+void TreeMap<K, V>::ScanIterator::descend(TreeMapNode* current) {
+	while (current != nullptr) {
+		prefetchNode(current->right);
+		path_.push_back(current);
+		current = current->left;
+	}
+}
+
+template<class K, class V>
+bool TreeMap<K, V>::ScanIterator::operator==(const ScanIterator& rhs) const {
+	// the current node determines the rest of the path
+	if (path_.empty() || rhs.path_.empty()) {
+		return path_.empty() == rhs.path_.empty();
+	}
+	return path_.back() == rhs.path_.back();
+}
+
+template<class K, class V>
+bool TreeMap<K, V>::ScanIterator::operator!=(const ScanIterator& rhs) const {
+	return !(*this == rhs);
+}
+
+template<class K, class V>
+typename TreeMap<K, V>::ScanIterator&
+TreeMap<K, V>::ScanIterator::operator++() {
+	if (!isLegal()) {
+		throw std::out_of_range("This iterator is past its end.");
+	}
+	TreeMapNode* current = path_.back();
+	path_.pop_back();
+	descend(current->right);
+	return *this;
+}
+
+template<class K, class V>
+typename TreeMap<K, V>::ScanIterator
+TreeMap<K, V>::ScanIterator::operator++(int) {
+	ScanIterator tmp(*this);
+	operator++();
+	return tmp;
+}
+
+template<class K, class V>
+const pair<K, V>& TreeMap<K, V>::ScanIterator::operator*() const {
+	if (!isLegal()) {
+		throw std::out_of_range("This iterator is past its end.");
+	}
+	return path_.back()->payload;
+}
+
+template<class K, class V>
+pair<K, V> const* TreeMap<K, V>::ScanIterator::operator->() const {
+	if (!isLegal()) {
+		throw std::out_of_range("This iterator is past its end.");
+	}
+	return &path_.back()->payload;
 }
 
 // writes in-order traversal of tm's nodes to given ostream
 template<class K, class V>
 ostream& operator<<(ostream& os, const TreeMap<K, V>& tm) {
-	auto it = tm.begin();
-	if (tm.size() > 0) {
-		for (unsigned int i = 0; i < tm.size() - 1; i++) {
-			os << "{" << it->first << "=" << it->second << "}, ";
-			++it;
+	for (auto it = tm.begin(); it != tm.end(); ++it) {
+		if (it != tm.begin()) {
+			os << ", ";
 		}
 		os << "{" << it->first << "=" << it->second << "}";
 	}
 	return os;
+}
+
+// bytes of text writeText and readText handle at a time
+const size_t TREE_TEXT_BLOCK = 1 << 20;
+
+// true for the types writeText and readText can handle: the arithmetic
+// types, save bool and the character types which operator<< doesn't
+// write as numbers
+template<class T> struct IsTextNumber : std::integral_constant<bool,
+	std::is_arithmetic<T>::value && !std::is_same<T, bool>::value
+	&& !std::is_same<T, char>::value && !std::is_same<T, signed char>::value
+	&& !std::is_same<T, unsigned char>::value> {};
+
+// writes the same text as operator<< to given ostream, for maps whose
+// keys and values are numbers, but several times faster: each number
+// is formatted by std::to_chars straight into a large buffer, which
+// goes to os in a single write per TREE_TEXT_BLOCK bytes. floating
+// point numbers are written in the shortest form that reads back
+// exactly, rather than rounded to six digits
+template<class K, class V>
+void writeText(ostream& os, const TreeMap<K, V>& tm) {
+	static_assert(IsTextNumber<K>::value && IsTextNumber<V>::value,
+		"writeText needs numeric keys and values");
+	// longest any two numbers and their punctuation can be
+	const size_t ENTRY_ROOM = 2 * 64 + 8;
+	vector<char> buffer(TREE_TEXT_BLOCK);
+	char* const end = buffer.data() + buffer.size();
+	char* out = buffer.data();
+	for (auto it = tm.begin(); it != tm.end(); ++it) {
+		if (size_t(end - out) < ENTRY_ROOM) {
+			os.write(buffer.data(), out - buffer.data());
+			out = buffer.data();
+		}
+		if (it != tm.begin()) {
+			*out++ = ',';
+			*out++ = ' ';
+		}
+		*out++ = '{';
+		out = std::to_chars(out, end, it->first).ptr;
+		*out++ = '=';
+		out = std::to_chars(out, end, it->second).ptr;
+		*out++ = '}';
+	}
+	os.write(buffer.data(), out - buffer.data());
+}
+
+// returns:
+// true iff c may come between the pairs of a map's text
+inline bool isTextSeparator(char c) {
+	return c == ',' || c == ' ' || c == '\n' || c == '\r' || c == '\t';
+}
+
+// parameters:
+// first- start of the text of one pair, which may be preceded by
+// separators
+// last- the closing brace of that pair
+// returns:
+// the pair
+// throws:
+// invalid argument exception if the text isn't a pair
+template<class K, class V>
+pair<K, V> parseTextEntry(const char* first, const char* last) {
+	while (first != last && isTextSeparator(*first)) {
+		first++;
+	}
+	pair<K, V> entry;
+	if (first == last || *first != '{') {
+		throw std::invalid_argument("Malformed map text.");
+	}
+	std::from_chars_result key = std::from_chars(first + 1, last, entry.first);
+	if (key.ec != std::errc() || key.ptr == last || *key.ptr != '=') {
+		throw std::invalid_argument("Malformed map text.");
+	}
+	std::from_chars_result value = std::from_chars(key.ptr + 1, last, entry.second);
+	if (value.ec != std::errc() || value.ptr != last) {
+		throw std::invalid_argument("Malformed map text.");
+	}
+	return entry;
+}
+
+// parameters:
+// is- stream of text in the form written by operator<< and writeText,
+// whose pairs may come in any order
+// tm- map which is to be loaded
+// modifies:
+// tm to hold exactly the pairs read, of which only the first is kept
+// where keys repeat. the text is read TREE_TEXT_BLOCK bytes at a time
+// and its numbers parsed by std::from_chars, after which the map is
+// bulk built by importColumns
+// throws:
+// invalid argument exception if the text is malformed, or bad_alloc
+// if memory runs out, either leaving tm unchanged
+template<class K, class V>
+void readText(istream& is, TreeMap<K, V>* tm) {
+	static_assert(IsTextNumber<K>::value && IsTextNumber<V>::value,
+		"readText needs numeric keys and values");
+	vector<pair<K, V>> entries;
+	vector<char> buffer(TREE_TEXT_BLOCK);
+	// bytes at the start of buffer left over from the last block
+	size_t held = 0;
+	bool ascending = true;
+	while (true) {
+		is.read(buffer.data() + held, buffer.size() - held);
+		size_t got = static_cast<size_t>(is.gcount());
+		const char* next = buffer.data();
+		const char* end = buffer.data() + held + got;
+		while (const char* close = static_cast<const char*>(
+			std::memchr(next, '}', end - next))) {
+			entries.push_back(parseTextEntry<K, V>(next, close));
+			if (entries.size() > 1 && !(entries[entries.size() - 2].first
+				< entries.back().first)) {
+				ascending = false;
+			}
+			next = close + 1;
+		}
+		held = end - next;
+		std::memmove(buffer.data(), next, held);
+		if (got == 0) {
+			break;
+		}
+		if (held == buffer.size()) {
+			// no single pair is this long
+			throw std::invalid_argument("Malformed map text.");
+		}
+	}
+	for (size_t i = 0; i < held; i++) {
+		if (!isTextSeparator(buffer[i])) {
+			throw std::invalid_argument("Malformed map text.");
+		}
+	}
+
+	if (!ascending) {
+		// stable so that the first of any equivalent keys comes first
+		std::stable_sort(entries.begin(), entries.end(),
+			[](const pair<K, V>& a, const pair<K, V>& b) { return a.first < b.first; });
+	}
+	vector<K> keys;
+	vector<V> values;
+	keys.reserve(entries.size());
+	values.reserve(entries.size());
+	for (const pair<K, V>& entry : entries) {
+		if (keys.empty() || keys.back() < entry.first) {
+			keys.push_back(entry.first);
+			values.push_back(entry.second);
+		}
+	}
+	tm->importColumns(keys, values);
 }
\ No newline at end of file
@@ -0,0 +1,502 @@
+#pragma once
+#include "TreeMap.h"	// TreeMap
+
+#include <iterator>		// std::iterator, std::input_iterator_tag
+#include <stdexcept>	// std::out_of_range, std::invalid_argument
+#include <new>			// std::bad_alloc
+#include <utility>		// std::pair
+
+// TreeSequence represents a sequence of values indexed by position, like
+// a vector, which can insert and remove at any position, split in two,
+// and concatenate with another in O(log n) (a rope). It is TreeMap's
+// WeightBalanced tree with the keys left out: every node already knows
+// the size of its subtree, so the position of a node is the number of
+// nodes before it in order, and a descent steers by subtree sizes
+// rather than by comparing keys. The nodes, rotations, and parent links
+// are TreeMap's own. Splits and concatenations join trees of unequal
+// sizes by walking down the spine of the larger one (Adams' concat3),
+// repairing each node on the way back up with the same single or
+// double rotation TreeMap uses after an add.
+
+// Usage Notes Concerning TreeSequence and SequenceIterator:
+
+// 1. V must be copy constructible
+
+// 2. positions count from 0. insert accepts any position up to size(),
+// inserting at size() appending; every other position must be less
+// than size()
+
+// 3. a SequenceIterator stays valid across inserts and removes of
+// other values, and across split and concat, after which it walks the
+// sequence its value ended up in. removing its own value invalidates it
+
+template<class V> class TreeSequence {
+	// stands in for the key of TreeMap's nodes, which a sequence has none of
+	struct Unkeyed {};
+	typedef TreeMap<Unkeyed, V> Engine;
+	typedef typename Engine::TreeMapNode SequenceNode;
+
+	// a lazy input_iterator for TreeSequence which visits values in
+	// order of position through the parent links, like TreeIterator
+	class SequenceIterator : public std::iterator<std::input_iterator_tag, V> {
+	public:
+		// constructs iterator positioned at node, or past-the-end
+		// if node is nullptr
+		explicit SequenceIterator(SequenceNode* node) : current_(node) {};
+
+		// constructor for past-the-end iterator
+		SequenceIterator() : current_(nullptr) {};
+
+		// comparison operators.
+		// two iterators are equal if they are at the same value
+		// or if they are both past-the-end
+		bool operator==(const SequenceIterator& rhs) const {
+			return current_ == rhs.current_;
+		};
+		bool operator!=(const SequenceIterator& rhs) const {
+			return current_ != rhs.current_;
+		};
+
+		// basic accessors, through which the value may be changed
+		// each throws out of range exception if
+		// called when iterator is past-the-end
+		V& operator*() const;
+		V* operator->() const { return &**this; };
+
+		// pre and postfix incrementers
+		// each throws out of range exception if
+		// called when iterator is past-the-end
+		SequenceIterator& operator++();
+		SequenceIterator operator++(int);
+
+		// returns:
+		// true iff iterator is in legal state to be dereferenced
+		bool isLegal() const { return current_ != nullptr; };
+
+	private:
+		// node of the current value, or nullptr past the end
+		SequenceNode* current_;
+	};  // end class SequenceIterator
+
+public:
+	// constructs empty sequence
+	TreeSequence() : root_(nullptr) {};
+	~TreeSequence() { deleteTree(root_); };
+	TreeSequence(const TreeSequence&) = delete;
+	TreeSequence& operator=(const TreeSequence&) = delete;
+
+	// parameters:
+	// position- number of values which are to come before the new one
+	// value- value which is to be inserted
+	// returns:
+	// true if there was enough space to allocate another node,
+	// else false
+	// modifies:
+	// sequence to hold value at position, each later value moving
+	// one position on
+	// throws:
+	// out of range exception if position is greater than size()
+	bool insert(unsigned int position, const V& value);
+
+	// parameters:
+	// value- value which is to be appended
+	// returns:
+	// true if there was enough space to allocate another node,
+	// else false
+	// modifies:
+	// sequence to hold value after every other
+	bool pushBack(const V& value) { return insert(size(), value); };
+
+	// parameters:
+	// position- position of the value which is to be removed
+	// returns:
+	// the value which was at position
+	// modifies:
+	// sequence to no longer hold it, each later value moving back one
+	// throws:
+	// out of range exception if position is not less than size()
+	V remove(unsigned int position);
+
+	// parameters:
+	// position- position of the value which is to be retrieved
+	// returns:
+	// value at position
+	// throws:
+	// out of range exception if position is not less than size()
+	V& at(unsigned int position) { return nodeAt(position)->payload.second; };
+	const V& at(unsigned int position) const {
+		return nodeAt(position)->payload.second;
+	};
+
+	// parameters:
+	// position- number of values which are to stay in this sequence
+	// back- empty sequence which is to receive the rest
+	// modifies:
+	// this sequence to hold only its first position values, and back
+	// to hold the ones after them, in the same order. nodes are
+	// relinked, never copied or allocated
+	// throws:
+	// out of range exception if position is greater than size()
+	// invalid argument exception if back is this sequence or not empty
+	void split(unsigned int position, TreeSequence* back);
+
+	// parameters:
+	// back- sequence whose values are to follow this one's
+	// modifies:
+	// this sequence to hold its own values followed by back's, and
+	// back to be empty. nodes are relinked, never copied or allocated
+	// throws:
+	// invalid argument exception if back is this sequence
+	void concat(TreeSequence* back);
+
+	// returns:
+	// number of values in sequence
+	unsigned int size() const { return Engine::weightOf(root_); };
+
+	// returns:
+	// number of nodes on the longest path from the root down,
+	// 0 if sequence is empty
+	unsigned int height() const { return heightOf(root_); };
+
+	// returns:
+	// iterator to the value at position 0
+	SequenceIterator begin() const {
+		return SequenceIterator(root_ == nullptr ? nullptr : Engine::leftmost(root_));
+	};
+
+	// parameters:
+	// position- position at which iteration is to start
+	// returns:
+	// iterator to the value at position, or past-the-end if position
+	// is size()
+	// throws:
+	// out of range exception if position is greater than size()
+	SequenceIterator iteratorAt(unsigned int position) const {
+		return position == size() ? end() : SequenceIterator(nodeAt(position));
+	};
+
+	// returns:
+	// past-the-end iterator for use in comparison
+	SequenceIterator end() const { return SequenceIterator(); };
+
+private:
+	SequenceNode* root_;
+
+	// parameters:
+	// position- position of a value
+	// returns:
+	// node holding that value
+	// throws:
+	// out of range exception if position is not less than size()
+	SequenceNode* nodeAt(unsigned int position) const;
+
+	// parameters:
+	// current- root of subtree which is being inserted into
+	// position- position within subtree for newElement
+	// newElement- childless node which is to be inserted
+	// returns:
+	// root of the subtree after inserting newElement and rotating the
+	// path down to it back into balance
+	static SequenceNode* insertHelper(SequenceNode* current, unsigned int position,
+		SequenceNode* newElement);
+
+	// parameters:
+	// current- root of subtree which holds position
+	// position- position within subtree of the node which is to go
+	// removed- return parameter for the node taken out
+	// returns:
+	// root of the subtree without that node, rebalanced
+	static SequenceNode* removeHelper(SequenceNode* current, unsigned int position,
+		SequenceNode** removed);
+
+	// parameters:
+	// current- root of nonempty subtree
+	// last- return parameter for the node taken out
+	// returns:
+	// root of the subtree without its last node, rebalanced
+	static SequenceNode* removeLast(SequenceNode* current, SequenceNode** last);
+
+	// parameters:
+	// front- root of a balanced subtree, or nullptr
+	// back- root of a balanced subtree, or nullptr
+	// returns:
+	// root of a balanced tree holding front's nodes followed by back's
+	static SequenceNode* merge(SequenceNode* front, SequenceNode* back);
+
+	// parameters:
+	// front- root of a balanced subtree, or nullptr
+	// middle- node which is to come between front and back
+	// back- root of a balanced subtree, or nullptr
+	// returns:
+	// root of a balanced tree holding front's nodes, then middle, then
+	// back's, whatever the sizes of front and back
+	static SequenceNode* join(SequenceNode* front, SequenceNode* middle,
+		SequenceNode* back);
+
+	// parameters:
+	// current- root of subtree which is to be split
+	// position- number of nodes which are to go to front
+	// front- return parameter for the root of the first position nodes
+	// back- return parameter for the root of the rest
+	static void splitHelper(SequenceNode* current, unsigned int position,
+		SequenceNode** front, SequenceNode** back);
+
+	// parameters:
+	// current- root of subtree which is to be deleted
+	// modifies:
+	// frees every node in subtree
+	static void deleteTree(SequenceNode* current);
+
+	// parameters:
+	// current- root of subtree, or nullptr
+	// returns:
+	// number of nodes on the longest path down from current
+	static unsigned int heightOf(const SequenceNode* current);
+};  // end class TreeSequence
+
+template<class V>
+bool TreeSequence<V>::insert(unsigned int position, const V& value) {
+	if (position > size()) {
+		throw std::out_of_range("No such position exists in this sequence.");
+	}
+	SequenceNode* newElement;
+	try {
+		newElement = new SequenceNode{ std::pair<Unkeyed, V>(Unkeyed(), value),
+			nullptr, nullptr, 1, 0, nullptr };
+	}
+	catch (std::bad_alloc&) {
+		return false;
+	}
+	root_ = insertHelper(root_, position, newElement);
+	root_->parent = nullptr;
+	return true;
+}
+
+template<class V>
+V TreeSequence<V>::remove(unsigned int position) {
+	if (position >= size()) {
+		throw std::out_of_range("No such position exists in this sequence.");
+	}
+	SequenceNode* removed;
+	root_ = removeHelper(root_, position, &removed);
+	if (root_ != nullptr) {
+		root_->parent = nullptr;
+	}
+	V retVal = removed->payload.second;
+	delete removed;
+	return retVal;
+}
+
+template<class V>
+void TreeSequence<V>::split(unsigned int position, TreeSequence* back) {
+	if (back == this || back->root_ != nullptr) {
+		throw std::invalid_argument("A sequence must be split into another, empty one.");
+	}
+	if (position > size()) {
+		throw std::out_of_range("No such position exists in this sequence.");
+	}
+	splitHelper(root_, position, &root_, &back->root_);
+	if (root_ != nullptr) {
+		root_->parent = nullptr;
+	}
+	if (back->root_ != nullptr) {
+		back->root_->parent = nullptr;
+	}
+}
+
+template<class V>
+void TreeSequence<V>::concat(TreeSequence* back) {
+	if (back == this) {
+		throw std::invalid_argument("A sequence cannot be concatenated with itself.");
+	}
+	root_ = merge(root_, back->root_);
+	back->root_ = nullptr;
+	if (root_ != nullptr) {
+		root_->parent = nullptr;
+	}
+}
+
+template<class V>
+typename TreeSequence<V>::SequenceNode*
+TreeSequence<V>::nodeAt(unsigned int position) const {
+	if (position >= size()) {
+		throw std::out_of_range("No such position exists in this sequence.");
+	}
+	SequenceNode* current = root_;
+	while (true) {
+		unsigned int leftWeight = Engine::weightOf(current->left);
+		if (position < leftWeight) {
+			current = current->left;
+		}
+		else if (position > leftWeight) {
+			position -= leftWeight + 1;
+			current = current->right;
+		}
+		else {
+			return current;
+		}
+	}
+}
+
+template<class V>
+typename TreeSequence<V>::SequenceNode*
+TreeSequence<V>::insertHelper(SequenceNode* current, unsigned int position,
+	SequenceNode* newElement) {
+	if (current == nullptr) {
+		return newElement;
+	}
+	unsigned int leftWeight = Engine::weightOf(current->left);
+	if (position <= leftWeight) {
+		current->left = insertHelper(current->left, position, newElement);
+	}
+	else {
+		current->right = insertHelper(current->right, position - leftWeight - 1,
+			newElement);
+	}
+	Engine::adoptChildren(current);
+	current->weight++;
+	return Engine::rotateIntoBalance(current);
+}
+
+template<class V>
+typename TreeSequence<V>::SequenceNode*
+TreeSequence<V>::removeHelper(SequenceNode* current, unsigned int position,
+	SequenceNode** removed) {
+	unsigned int leftWeight = Engine::weightOf(current->left);
+	if (position < leftWeight) {
+		current->left = removeHelper(current->left, position, removed);
+	}
+	else if (position > leftWeight) {
+		current->right = removeHelper(current->right, position - leftWeight - 1,
+			removed);
+	}
+	else {
+		*removed = current;
+		return merge(current->left, current->right);
+	}
+	Engine::adoptChildren(current);
+	current->weight--;
+	return Engine::rotateIntoBalance(current);
+}
+
+template<class V>
+typename TreeSequence<V>::SequenceNode*
+TreeSequence<V>::removeLast(SequenceNode* current, SequenceNode** last) {
+	if (current->right == nullptr) {
+		*last = current;
+		return current->left;
+	}
+	current->right = removeLast(current->right, last);
+	Engine::adoptChildren(current);
+	current->weight--;
+	return Engine::rotateIntoBalance(current);
+}
+
+template<class V>
+typename TreeSequence<V>::SequenceNode*
+TreeSequence<V>::merge(SequenceNode* front, SequenceNode* back) {
+	if (front == nullptr) {
+		return back;
+	}
+	if (back == nullptr) {
+		return front;
+	}
+	SequenceNode* middle;
+	front = removeLast(front, &middle);
+	return join(front, middle, back);
+}
+
+template<class V>
+typename TreeSequence<V>::SequenceNode*
+TreeSequence<V>::join(SequenceNode* front, SequenceNode* middle,
+	SequenceNode* back) {
+	unsigned long long frontWeight = Engine::weightOf(front) + 1;
+	unsigned long long backWeight = Engine::weightOf(back) + 1;
+	if (frontWeight > Engine::BALANCE_DELTA * backWeight) {
+		// hang the rest off front's right spine, as far down as it
+		// takes for the two to balance
+		front->right = join(front->right, middle, back);
+		Engine::adoptChildren(front);
+		front->weight = 1 + Engine::weightOf(front->left) + Engine::weightOf(front->right);
+		return Engine::rotateIntoBalance(front);
+	}
+	if (backWeight > Engine::BALANCE_DELTA * frontWeight) {
+		back->left = join(front, middle, back->left);
+		Engine::adoptChildren(back);
+		back->weight = 1 + Engine::weightOf(back->left) + Engine::weightOf(back->right);
+		return Engine::rotateIntoBalance(back);
+	}
+	middle->left = front;
+	middle->right = back;
+	middle->weight = 1 + Engine::weightOf(front) + Engine::weightOf(back);
+	Engine::adoptChildren(middle);
+	return middle;
+}
+
+template<class V>
+void TreeSequence<V>::splitHelper(SequenceNode* current, unsigned int position,
+	SequenceNode** front, SequenceNode** back) {
+	if (current == nullptr) {
+		*front = nullptr;
+		*back = nullptr;
+		return;
+	}
+	SequenceNode* left = current->left;
+	SequenceNode* right = current->right;
+	unsigned int leftWeight = Engine::weightOf(left);
+	if (position <= leftWeight) {
+		SequenceNode* rest;
+		splitHelper(left, position, front, &rest);
+		*back = join(rest, current, right);
+	}
+	else {
+		SequenceNode* rest;
+		splitHelper(right, position - leftWeight - 1, &rest, back);
+		*front = join(left, current, rest);
+	}
+}
+
+template<class V>
+void TreeSequence<V>::deleteTree(SequenceNode* current) {
+	if (current != nullptr) {
+		deleteTree(current->left);
+		deleteTree(current->right);
+		delete current;
+	}
+}
+
+template<class V>
+unsigned int TreeSequence<V>::heightOf(const SequenceNode* current) {
+	if (current == nullptr) {
+		return 0;
+	}
+	unsigned int left = heightOf(current->left);
+	unsigned int right = heightOf(current->right);
+	return 1 + (left > right ? left : right);
+}
+
+template<class V>
+V& TreeSequence<V>::SequenceIterator::operator*() const {
+	if (!isLegal()) {
+		throw std::out_of_range("This iterator is past its end.");
+	}
+	return current_->payload.second;
+}
+
+template<class V>
+typename TreeSequence<V>::SequenceIterator&
+TreeSequence<V>::SequenceIterator::operator++() {
+	if (!isLegal()) {
+		throw std::out_of_range("This iterator is past its end.");
+	}
+	current_ = Engine::successor(current_);
+	return *this;
+}
+
+template<class V>
+typename TreeSequence<V>::SequenceIterator
+TreeSequence<V>::SequenceIterator::operator++(int) {
+	SequenceIterator tmp(*this);
+	operator++();
+	return tmp;
+}
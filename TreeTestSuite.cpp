@@ -1,17 +1,87 @@
 #include "TreeMap.h"	// TreeMap, TreeIterator
+#include "BufferedTreeMap.h"	// BufferedTreeMap
+#include "TieredTreeMap.h"	// TieredTreeMap
+#include "SpillingTreeMap.h"	// SpillingTreeMap
+#include "IntrusiveTreeMap.h"	// IntrusiveTreeMap, TreeHook
+#include "LearnedIndexMap.h"	// LearnedIndexMap
+#include "StaticTreeMap.h"	// StaticTreeMap, makeStaticTreeMap
+#include "CompressedSnapshot.h"	// CompressedSnapshot
+#include "AsyncSnapshotWriter.h"	// AsyncSnapshotWriter, readSnapshot
+#include "LeftRightTreeMap.h"	// LeftRightTreeMap
+#include "TreeSequence.h"	// TreeSequence
 
 #include <utility>		// std::pair
 #include <stdexcept>    // std::out_of_range
 #include <iostream>     // std::cout, std::endl
-#include <algorithm>    // std::random_shuffle
+#include <algorithm>    // std::random_shuffle, std::sort
 #include <vector>       // std::vector
 #include <cassert>		// assert
+#include <map>			// std::map
+#include <cstdlib>		// std::rand
+#include <random>		// std::mt19937_64
+#include <cstdint>		// uint64_t, UINT64_MAX
+#include <tuple>		// std::tuple, std::make_tuple
+#include <cmath>		// std::log2
+#include <sstream>		// std::ostringstream, std::istringstream, std::stringstream
+#include <fstream>		// std::ifstream
+#include <cstdio>		// std::remove
+#include <thread>		// std::thread
+#include <atomic>		// std::atomic
 
 using std::cout;
 using std::endl;
 using std::vector;
 using std::pair;
 
+// sums a StaticTreeMap's values by iterating it, to show that iteration
+// works in constant expressions
+template<class Map>
+constexpr int sumOfValues(const Map& map) {
+	int sum = 0;
+	for (auto sit = map.begin(); sit != map.end(); ++sit) {
+		sum += sit->second;
+	}
+	return sum;
+}
+
+// drives random adds and removes through a map and a std::map, checking
+// that they agree and that the map's height stays within heightBound
+template<class HeightBound>
+void checkMixedAgainstReference(TreeMap<int, int>& mixed, unsigned int seed,
+	HeightBound heightBound) {
+	std::map<int, int> reference;
+	std::srand(seed);
+	for (int i = 0; i < 200000; i++) {
+		int key = std::rand() % 5000;
+		if (std::rand() % 3 == 0) {
+			if (reference.count(key)) {
+				assert(mixed.remove(key) == reference[key]);
+				reference.erase(key);
+			}
+			else {
+				assert(mixed.find(key) == nullptr);
+				try {
+					mixed.remove(key);
+					assert(false);
+				}
+				catch (std::out_of_range&) {}
+			}
+		}
+		else {
+			assert(mixed.add(key, i) == reference.emplace(key, i).second);
+		}
+		if (i % 1000 == 0) {
+			assert(mixed.size() == reference.size());
+			assert(mixed.height() <= heightBound(mixed.size()));
+		}
+	}
+	auto rit = reference.begin();
+	for (auto mit = mixed.begin(); mit != mixed.end(); ++mit, ++rit) {
+		assert(mit->first == rit->first && mit->second == rit->second);
+	}
+	assert(rit == reference.end());
+}
+
 int main(int argv, char** argc) {
 	cout << "PLEASE ENSURE THAT ASSERT STATEMENTS ARE ENABLED." << endl;
 	cout << "IF THEY AREN'T, NOT MUCH WILL BE TESTED HERE." << endl << endl;
@@ -34,6 +104,10 @@ int main(int argv, char** argc) {
 	assert(bst1.at(0) == 'a');
 	assert(bst1.size() == 1);
 
+	// test that find agrees with at without throwing
+	assert(*bst1.find(0) == 'a');
+	assert(bst1.find(1) == nullptr);
+
 	// test remove works on size 1 TreeMap
 	assert(bst1.remove(0) == 'a');
 	assert(bst1.size() == 0);
@@ -284,6 +358,1826 @@ int main(int argv, char** argc) {
 	assert(bst6.size() == 0);
 	cout << "RANDOMIZED TREE STRESS TESTS: COMPLETE" << endl << endl;
 
+	cout << "COMMENCING BUFFERED TREE TESTS..." << endl;
+	BufferedTreeMap<int, int> buffered;
+	std::map<int, int> reference;
+	// enough writes to grow several levels of buffered internal nodes
+	const int NUM_BUFFERED_OPERATIONS = 60000;
+	for (int i = 0; i < NUM_BUFFERED_OPERATIONS; i++) {
+		int key = std::rand() % (NUM_BUFFERED_OPERATIONS / 4);
+		if (i % 3 == 2) {
+			buffered.erase(key);
+			reference.erase(key);
+		}
+		else {
+			buffered.put(key, i);
+			reference[key] = i;
+		}
+	}
+	assert(buffered.size() == reference.size());
+
+	// lookups must see messages still sitting in buffers
+	for (int key = 0; key < NUM_BUFFERED_OPERATIONS / 4; key++) {
+		auto expected = reference.find(key);
+		try {
+			int found = buffered.at(key);
+			assert(expected != reference.end());
+			assert(found == expected->second);
+		}
+		catch (std::out_of_range&) {
+			assert(expected == reference.end());
+		}
+	}
+
+	// iteration must merge buffered messages into the leaves
+	auto refIt = reference.begin();
+	for (auto bit = buffered.begin(); bit != buffered.end(); ++bit) {
+		assert(bit->first == refIt->first);
+		assert(bit->second == refIt->second);
+		++refIt;
+	}
+	assert(refIt == reference.end());
+
+	// checked add and remove keep TreeMap's semantics
+	int absentKey = NUM_BUFFERED_OPERATIONS;
+	unsigned int bufferedSize = buffered.size();
+	assert(buffered.add(absentKey, 7));
+	assert(!buffered.add(absentKey, 8));
+	assert(buffered.at(absentKey) == 7);
+	assert(buffered.size() == bufferedSize + 1);
+	assert(buffered.remove(absentKey) == 7);
+	assert(buffered.size() == bufferedSize);
+	try {
+		buffered.remove(absentKey);
+		assert(false);
+	}
+	catch (std::out_of_range&) {
+
+	}
+	cout << "BUFFERED TREE TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING TIERED TREE TESTS..." << endl;
+	{
+		// a tiny memtable forces many freezes, runs, and tier merges
+		TieredTreeMap<int, int> tiered(64);
+		std::map<int, int> tieredReference;
+		const int NUM_TIERED_OPERATIONS = 20000;
+		for (int i = 0; i < NUM_TIERED_OPERATIONS; i++) {
+			int key = std::rand() % (NUM_TIERED_OPERATIONS / 4);
+			if (i % 4 == 3) {
+				tiered.erase(key);
+				tieredReference.erase(key);
+			}
+			else {
+				tiered.put(key, i);
+				tieredReference[key] = i;
+			}
+		}
+
+		// lookups must agree whether or not merging has caught up
+		for (int key = 0; key < NUM_TIERED_OPERATIONS / 4; key++) {
+			auto expected = tieredReference.find(key);
+			try {
+				int found = tiered.at(key);
+				assert(expected != tieredReference.end());
+				assert(found == expected->second);
+			}
+			catch (std::out_of_range&) {
+				assert(expected == tieredReference.end());
+			}
+		}
+		tiered.waitForMerges();
+		// tiering keeps the run count logarithmic in the data size
+		assert((tiered.runCount() < 4 * TieredTreeMap<int, int>::TIER_WIDTH));
+		assert(tiered.size() == tieredReference.size());
+
+		auto tieredRefIt = tieredReference.begin();
+		for (auto tit = tiered.begin(); tit != tiered.end(); ++tit) {
+			assert(tit->first == tieredRefIt->first);
+			assert(tit->second == tieredRefIt->second);
+			++tieredRefIt;
+		}
+		assert(tieredRefIt == tieredReference.end());
+
+		// checked add and remove keep TreeMap's semantics
+		int absentKey = NUM_TIERED_OPERATIONS;
+		assert(tiered.add(absentKey, 7));
+		assert(!tiered.add(absentKey, 8));
+		assert(tiered.at(absentKey) == 7);
+		assert(tiered.remove(absentKey) == 7);
+		assert(tiered.size() == tieredReference.size());
+		try {
+			tiered.at(absentKey);
+			assert(false);
+		}
+		catch (std::out_of_range&) {
+
+		}
+	}
+	cout << "TIERED TREE TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING SPILLING TREE TESTS..." << endl;
+	{
+		// a budget of a few hundred nodes forces most of the tree to disk
+		const size_t SPILL_BUDGET = 256 * (sizeof(pair<int, int>) + 48);
+		SpillingTreeMap<int, int> spilling("spill_test.bin", SPILL_BUDGET);
+		const int NUM_SPILLED_ELEMENTS = 20000;
+		vector<int> spillKeys;
+		for (int i = 0; i < NUM_SPILLED_ELEMENTS; i++) {
+			spillKeys.push_back(i);
+		}
+		std::random_shuffle(spillKeys.begin(), spillKeys.end());
+		for (int key : spillKeys) {
+			assert(spilling.add(key, -key));
+		}
+		assert(!spilling.add(spillKeys[0], 0));
+		assert(spilling.size() == NUM_SPILLED_ELEMENTS);
+		assert(spilling.residentCount() < NUM_SPILLED_ELEMENTS / 10);
+
+		// lookups read spilled subtrees back in transparently
+		std::random_shuffle(spillKeys.begin(), spillKeys.end());
+		for (int key : spillKeys) {
+			assert(spilling.at(key) == -key);
+		}
+		assert(spilling.residentCount() < NUM_SPILLED_ELEMENTS / 10);
+
+		// a full scan stays within budget by spilling what it has passed
+		int expectedKey = 0;
+		size_t peakResident = 0;
+		for (auto sit = spilling.begin(); sit != spilling.end(); ++sit) {
+			assert(sit->first == expectedKey);
+			assert(sit->second == -expectedKey);
+			expectedKey++;
+			peakResident = std::max(peakResident, spilling.residentCount());
+		}
+		assert(expectedKey == NUM_SPILLED_ELEMENTS);
+		assert(peakResident < NUM_SPILLED_ELEMENTS / 10);
+
+		for (int i = 0; i < NUM_SPILLED_ELEMENTS; i += 2) {
+			assert(spilling.remove(i) == -i);
+		}
+		assert(spilling.size() == NUM_SPILLED_ELEMENTS / 2);
+		for (int i = 0; i < NUM_SPILLED_ELEMENTS; i++) {
+			try {
+				assert(spilling.at(i) == -i);
+				assert(i % 2 == 1);
+			}
+			catch (std::out_of_range&) {
+				assert(i % 2 == 0);
+			}
+		}
+	}
+	{
+		// keys added in order, or in reverse, stay within the same budget
+		// of about 256 nodes, as does scanning them. a scan may overshoot
+		// by the subtrees it reads in ahead of itself
+		const size_t SPILL_BUDGET = 256 * (sizeof(pair<int, int>) + 48);
+		const size_t SCAN_SLACK = 64;
+		const int NUM_SORTED_ELEMENTS = 5000;
+		for (int direction = 1; direction >= -1; direction -= 2) {
+			SpillingTreeMap<int, int> sorted("spill_sorted_test.bin", SPILL_BUDGET);
+			size_t peakResident = 0;
+			for (int i = 0; i < NUM_SORTED_ELEMENTS; i++) {
+				assert(sorted.add(direction * i, i));
+				peakResident = std::max(peakResident, sorted.residentCount());
+			}
+			assert(sorted.size() == NUM_SORTED_ELEMENTS);
+			assert(peakResident <= 256);
+			int expectedKey = direction == 1 ? 0 : -(NUM_SORTED_ELEMENTS - 1);
+			peakResident = 0;
+			for (auto sit = sorted.begin(); sit != sorted.end(); ++sit) {
+				assert(sit->first == expectedKey);
+				assert(sit->second == direction * expectedKey);
+				expectedKey++;
+				peakResident = std::max(peakResident, sorted.residentCount());
+			}
+			assert(expectedKey == (direction == 1 ? NUM_SORTED_ELEMENTS : 1));
+			assert(peakResident <= 256 + SCAN_SLACK);
+			for (int i = 0; i < NUM_SORTED_ELEMENTS; i += 7) {
+				assert(sorted.at(direction * i) == i);
+			}
+			assert(sorted.residentCount() <= 256);
+		}
+
+		// a prefetch which cannot read the spill file, here because it was
+		// removed mid-scan, fails the scan rather than silently skipping
+		// what was spilled. the map's own stream keeps the file readable
+		SpillingTreeMap<int, int> unlinked("spill_unlinked_test.bin", SPILL_BUDGET);
+		for (int i = 0; i < NUM_SORTED_ELEMENTS; i++) {
+			assert(unlinked.add(i, i));
+		}
+		int scanned = 0;
+		try {
+			for (auto uit = unlinked.begin(); uit != unlinked.end(); ++uit) {
+				assert(uit->first == scanned);
+				scanned++;
+				if (scanned == 100) {
+					std::remove("spill_unlinked_test.bin");
+				}
+			}
+			assert(false);
+		}
+		catch (std::runtime_error&) {
+			assert(scanned >= 100 && scanned < NUM_SORTED_ELEMENTS);
+		}
+	}
+	cout << "SPILLING TREE TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING NODE ARENA TESTS..." << endl;
+	{
+		NodeArena::Backing backings[] = { NodeArena::HugePages, NodeArena::Heap };
+		for (NodeArena::Backing backing : backings) {
+			TreeMap<int, int> arenaBacked(backing);
+			std::random_shuffle(ints.begin(), ints.end());
+			for (int key : ints) {
+				assert(arenaBacked.add(key, -key));
+			}
+			assert(!arenaBacked.add(ints[0], 0));
+			assert(arenaBacked.size() == ints.size());
+			for (int key : ints) {
+				assert(arenaBacked.at(key) == -key);
+			}
+			int expectedKey = 0;
+			for (auto ait = arenaBacked.begin(); ait != arenaBacked.end(); ++ait) {
+				assert(ait->first == expectedKey++);
+			}
+			std::random_shuffle(ints.begin(), ints.end());
+			for (int key : ints) {
+				assert(arenaBacked.remove(key) == -key);
+			}
+			assert(arenaBacked.size() == 0);
+		}
+
+		// slots released to an arena are handed out again first
+		NodeArena arena(24, 8, NodeArena::Heap);
+		void* first = arena.allocate();
+		void* second = arena.allocate();
+		assert(first != second);
+		assert(arena.slotsInUse() == 2);
+		arena.release(first);
+		assert(arena.allocate() == first);
+		assert(arena.bytesReserved() >= NodeArena::HUGE_PAGE_SIZE);
+	}
+	cout << "NODE ARENA TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING MEMORY USAGE TESTS..." << endl;
+	{
+		TreeMap<int, int> measured;
+		MemoryUsage usage = measured.memoryUsage();
+		assert(usage.total() == 0);
+		for (int i = 0; i < 100; i++) {
+			assert(measured.add((i * 37) % 100, i));
+		}
+		usage = measured.memoryUsage();
+		assert(usage.nodeTypes.size() == 1);
+		assert(usage.nodeTypes[0].count == 100);
+		assert(usage.nodeBytes == usage.nodeTypes[0].bytes);
+		assert(usage.nodeBytes >= 100 * sizeof(pair<int, int>));
+		assert(usage.slackBytes > 0);
+		assert(usage.iteratorBytes == 0);
+
+		// scan paths are charged while scan iterators are alive, and
+		// tree iterators hold nothing beyond themselves
+		{
+			auto mit = measured.begin();
+			auto copy = mit;
+			assert(copy == mit);
+			assert(measured.memoryUsage().iteratorBytes == 0);
+			auto sit = measured.scan();
+			assert(measured.memoryUsage().iteratorBytes > 0);
+		}
+		assert(measured.memoryUsage().iteratorBytes == 0);
+
+		measured.remove(0);
+		assert(measured.memoryUsage().nodeTypes[0].count == 99);
+
+		// an arena's unused space is slack, and everything it
+		// reserved is accounted for
+		TreeMap<int, int> arenaMeasured(NodeArena::Heap);
+		assert(arenaMeasured.add(1, 1));
+		usage = arenaMeasured.memoryUsage();
+		assert(usage.nodeBytes + usage.slackBytes >= NodeArena::HUGE_PAGE_SIZE);
+		assert(usage.auxiliaryBytes > 0);
+
+		// tiered maps report memtable nodes and run entries separately,
+		// with Bloom filters as auxiliary bytes
+		TieredTreeMap<int, int> tieredMeasured(64);
+		for (int i = 0; i < 1000; i++) {
+			tieredMeasured.put(i, i);
+		}
+		tieredMeasured.waitForMerges();
+		usage = tieredMeasured.memoryUsage();
+		assert(usage.nodeTypes.size() == 2);
+		assert(usage.nodeTypes[0].count + usage.nodeTypes[1].count >= 1000);
+		assert(usage.auxiliaryBytes > 0);
+		assert(usage.nodeBytes == usage.nodeTypes[0].bytes + usage.nodeTypes[1].bytes);
+
+		// buffered maps report their nodes, pivots, child links, leaf
+		// entries and buffered messages, and charge merging iterators
+		BufferedTreeMap<int, int> bufferedMeasured;
+		usage = bufferedMeasured.memoryUsage();
+		assert(usage.nodeTypes.size() == 5);
+		assert(usage.nodeTypes[0].count == 1 && usage.nodeTypes[3].count == 0);
+		for (int i = 0; i < 5000; i++) {
+			bufferedMeasured.put((i * 37) % 5000, i);
+		}
+		usage = bufferedMeasured.memoryUsage();
+		assert(usage.nodeTypes[0].count > 1 && usage.nodeTypes[1].count > 0);
+		assert(usage.nodeTypes[2].count == usage.nodeTypes[0].count - 1);
+		assert(usage.nodeTypes[3].count + usage.nodeTypes[4].count >= 5000);
+		assert(usage.nodeTypes[4].count > 0);
+		size_t typeBytes = 0;
+		for (const MemoryUsage::NodeTypeUsage& type : usage.nodeTypes) {
+			typeBytes += type.bytes;
+		}
+		assert(usage.nodeBytes == typeBytes);
+		assert(usage.slackBytes > 0 && usage.iteratorBytes == 0);
+		{
+			auto bit = bufferedMeasured.begin();
+			assert(bufferedMeasured.memoryUsage().iteratorBytes > 0);
+		}
+		assert(bufferedMeasured.memoryUsage().iteratorBytes == 0);
+		for (int i = 0; i < 5000; i++) {
+			bufferedMeasured.erase(i);
+		}
+		assert(bufferedMeasured.size() == 0);
+
+		// spilling maps report resident nodes and stubs separately,
+		// with prefetch buffers as auxiliary bytes
+		SpillingTreeMap<int, int> spillMeasured("spill_measured_test.bin",
+			256 * (sizeof(pair<int, int>) + 48));
+		usage = spillMeasured.memoryUsage();
+		assert(usage.total() == 0 && usage.nodeTypes.size() == 2);
+		for (int i = 0; i < 5000; i++) {
+			assert(spillMeasured.add(i, i));
+		}
+		usage = spillMeasured.memoryUsage();
+		assert(usage.nodeTypes[0].count == spillMeasured.residentCount());
+		assert(usage.nodeTypes[1].count > 0);
+		assert(usage.nodeBytes == usage.nodeTypes[0].bytes + usage.nodeTypes[1].bytes);
+		assert(usage.slackBytes > 0 && usage.iteratorBytes == 0);
+		{
+			bool prefetched = false;
+			for (auto mit = spillMeasured.begin(); mit != spillMeasured.end(); ++mit) {
+				assert(spillMeasured.memoryUsage().iteratorBytes > 0);
+				prefetched = prefetched || spillMeasured.memoryUsage().auxiliaryBytes > 0;
+			}
+			assert(prefetched);
+		}
+		usage = spillMeasured.memoryUsage();
+		assert(usage.iteratorBytes == 0);
+		assert(usage.nodeTypes[0].count == spillMeasured.residentCount());
+	}
+	cout << "MEMORY USAGE TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING REBALANCE TESTS..." << endl;
+	{
+		// sorted insertion is kept within the partial rebuilding bound
+		// but is not left perfectly balanced
+		TreeMap<int, int> chained;
+		for (int i = 0; i < BULK_SIZE; i++) {
+			assert(chained.add(i, -i));
+		}
+		assert(chained.height() > 10 && chained.height() <= 20);
+		MemoryUsage beforeRebalance = chained.memoryUsage();
+
+		chained.rebalance();
+		// 1000 nodes fit in a tree of height 10 and no less
+		assert(chained.height() == 10);
+		assert(chained.size() == BULK_SIZE);
+		assert(chained.memoryUsage().total() == beforeRebalance.total());
+		int expectedKey = 0;
+		for (auto cit = chained.begin(); cit != chained.end(); ++cit) {
+			assert(cit->first == expectedKey);
+			assert(cit->second == -expectedKey);
+			expectedKey++;
+		}
+
+		// every size from empty up to a few complete trees comes
+		// out at the minimum possible height
+		TreeMap<int, int> growing;
+		growing.rebalance();
+		assert(growing.height() == 0);
+		for (int i = 1; i <= 64; i++) {
+			assert(growing.add(i, i));
+			growing.rebalance();
+			unsigned int minimumHeight = 0;
+			while ((1 << minimumHeight) - 1 < i) {
+				minimumHeight++;
+			}
+			assert(growing.height() == minimumHeight);
+			assert(growing.at(i) == i);
+		}
+
+		// the rebuilt tree's parent links and weights are what erasing
+		// through an iterator and weight balancing go on to rely on
+		TreeMap<int, int> reweighed(TreeMap<int, int>::WeightBalanced);
+		for (int i = 0; i < BULK_SIZE; i++) {
+			assert(reweighed.add(i, i));
+		}
+		reweighed.rebalance();
+		for (auto wit = reweighed.begin(); wit != reweighed.end(); ) {
+			wit = wit->first % 2 == 0 ? reweighed.erase(wit) : ++wit;
+		}
+		assert(reweighed.size() == BULK_SIZE / 2);
+		assert(reweighed.height() <= 10);
+		expectedKey = 1;
+		for (auto wit = reweighed.begin(); wit != reweighed.end(); ++wit) {
+			assert(wit->first == expectedKey);
+			expectedKey += 2;
+		}
+		assert(expectedKey == BULK_SIZE + 1);
+	}
+	cout << "REBALANCE TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING PARTIAL REBUILDING TESTS..." << endl;
+	{
+		// 2 * log2(n) edges below the root, plus the root itself
+		auto heightBound = [](unsigned int n) {
+			unsigned int bound = 1;
+			for (unsigned long long squared = (unsigned long long)n * n;
+				squared > 1; squared >>= 1) {
+				bound++;
+			}
+			return bound;
+		};
+
+		// ascending and descending inserts stay logarithmic throughout
+		TreeMap<int, int> ascending;
+		TreeMap<int, int> descending;
+		for (int i = 1; i <= (int)ints.size(); i++) {
+			assert(ascending.add(i, i));
+			assert(descending.add(-i, i));
+			if (i % 997 == 0) {
+				assert(ascending.height() <= heightBound(i));
+				assert(descending.height() <= heightBound(i));
+			}
+		}
+		assert(ascending.height() <= heightBound(ascending.size()));
+		assert(ascending.at(1) == 1 && ascending.at((int)ints.size()) == (int)ints.size());
+
+		// removing from one end keeps the bound too
+		for (int i = 1; i <= (int)ints.size() / 2; i++) {
+			assert(ascending.remove(i) == i);
+			if (i % 997 == 0) {
+				assert(ascending.height() <= heightBound(ascending.size()));
+			}
+		}
+		assert(ascending.size() == ints.size() - ints.size() / 2);
+		int expectedKey = (int)ints.size() / 2 + 1;
+		for (auto ait = ascending.begin(); ait != ascending.end(); ++ait) {
+			assert(ait->first == expectedKey);
+			expectedKey++;
+		}
+		assert(expectedKey == (int)ints.size() + 1);
+
+		// random adds and removes agree with std::map and stay in bounds
+		TreeMap<int, int> mixed;
+		checkMixedAgainstReference(mixed, 82, heightBound);
+	}
+	cout << "PARTIAL REBUILDING TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING WEIGHT BALANCED TESTS..." << endl;
+	{
+		// no subtree holds more than 3/4 of its parent's weight plus one,
+		// so no path is longer than log base 4/3 of n + 1
+		auto heightBound = [](unsigned int n) {
+			unsigned int bound = 0;
+			for (double reach = 1; reach < n + 1.0; reach *= 4.0 / 3.0) {
+				bound++;
+			}
+			return bound;
+		};
+
+		TreeMap<int, int> ascending(TreeMap<int, int>::WeightBalanced);
+		TreeMap<int, int> descending(NodeArena::Heap,
+			TreeMap<int, int>::WeightBalanced);
+		for (int i = 1; i <= (int)ints.size(); i++) {
+			assert(ascending.add(i, i));
+			assert(descending.add(-i, i));
+			assert(!ascending.add(i, -i));
+			if (i % 997 == 0) {
+				assert(ascending.height() <= heightBound(i));
+				assert(descending.height() <= heightBound(i));
+			}
+		}
+		for (int i = 1; i <= (int)ints.size() / 2; i++) {
+			assert(ascending.remove(i) == i);
+			assert(descending.remove(-(int)ints.size() - 1 + i) == (int)ints.size() + 1 - i);
+			if (i % 997 == 0) {
+				assert(ascending.height() <= heightBound(ascending.size()));
+				assert(descending.height() <= heightBound(descending.size()));
+			}
+		}
+		int expectedKey = (int)ints.size() / 2 + 1;
+		for (auto ait = ascending.begin(); ait != ascending.end(); ++ait) {
+			assert(ait->first == expectedKey && ait->second == expectedKey);
+			expectedKey++;
+		}
+		assert(expectedKey == (int)ints.size() + 1);
+		ascending.rebalance();
+		assert(ascending.size() == ints.size() - ints.size() / 2);
+		assert(ascending.add(0, 0));
+		assert(ascending.remove((int)ints.size()) == (int)ints.size());
+
+		// random adds and removes agree with std::map and stay in bounds
+		TreeMap<int, int> mixed(TreeMap<int, int>::WeightBalanced);
+		checkMixedAgainstReference(mixed, 83, heightBound);
+	}
+	cout << "WEIGHT BALANCED TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING RESERVE TESTS..." << endl;
+	{
+		// heap nodes from before the reserve live alongside arena ones
+		TreeMap<int, int> reserved;
+		for (int i = 0; i < BULK_SIZE; i++) {
+			assert(reserved.add(ints[i], i));
+		}
+		reserved.reserve(BULK_SIZE);
+		MemoryUsage afterReserve = reserved.memoryUsage();
+		for (int i = BULK_SIZE; i < 2 * BULK_SIZE; i++) {
+			assert(reserved.add(ints[i], i));
+		}
+		// every new node fit in memory the map already held
+		MemoryUsage afterAdds = reserved.memoryUsage();
+		assert(afterAdds.nodeBytes + afterAdds.slackBytes
+			== afterReserve.nodeBytes + afterReserve.slackBytes);
+		assert(reserved.size() == 2 * BULK_SIZE);
+		for (int i = 0; i < 2 * BULK_SIZE; i++) {
+			assert(reserved.remove(ints[i]) == i);
+		}
+		assert(reserved.size() == 0);
+
+		// caller storage, deliberately misaligned, holds exactly its capacity
+		const unsigned int CAPACITY = 100;
+		vector<char> storage(TreeMap<int, int>::storageFor(CAPACITY) + 1);
+		TreeMap<int, int> fixed(storage.data() + 1, storage.size() - 1);
+		fixed.reserve(CAPACITY);
+		for (unsigned int i = 0; i < CAPACITY; i++) {
+			assert(fixed.add(i, -(int)i));
+		}
+		assert(!fixed.add(CAPACITY, 0));
+		assert(fixed.size() == CAPACITY);
+		try {
+			fixed.reserve(1);
+			assert(false);
+		}
+		catch (std::bad_alloc&) {}
+		assert(fixed.remove(7) == -7);
+		assert(fixed.add(CAPACITY, -(int)CAPACITY));
+		assert(!fixed.add(CAPACITY + 1, 0));
+		unsigned int seen = 0;
+		for (auto fit = fixed.begin(); fit != fixed.end(); ++fit) {
+			assert(fit->second == -fit->first);
+			seen++;
+		}
+		assert(seen == CAPACITY);
+		assert(fixed.memoryUsage().nodeBytes + fixed.memoryUsage().slackBytes
+			== storage.size() - 1);
+
+		// too little storage for even one node
+		char tiny[1];
+		TreeMap<int, int> empty(tiny, sizeof(tiny), TreeMap<int, int>::WeightBalanced);
+		assert(!empty.add(1, 1));
+		assert(empty.size() == 0);
+	}
+	cout << "RESERVE TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING INTRUSIVE TREE TESTS..." << endl;
+	{
+		// objects which live in the caller's own pool
+		struct Widget {
+			int id;
+			int payload;
+			TreeHook<Widget> hook;
+		};
+		struct WidgetId {
+			const int& operator()(const Widget& widget) const { return widget.id; }
+		};
+		vector<Widget> pool(ints.size());
+		for (unsigned int i = 0; i < ints.size(); i++) {
+			pool[i].id = ints[i];
+			pool[i].payload = -ints[i];
+		}
+
+		IntrusiveTreeMap<int, Widget, WidgetId> widgets;
+		assert(widgets.size() == 0);
+		assert(widgets.begin() == widgets.end());
+		assert(widgets.find(ints[0]) == nullptr);
+		for (Widget& widget : pool) {
+			assert(widgets.link(widget));
+		}
+		assert(widgets.size() == ints.size());
+		// 50000 objects fit within the AVL bound of 1.44 * log2(n)
+		assert(widgets.height() <= 22);
+
+		// lookups hand back the caller's own objects, not copies
+		for (unsigned int i = 0; i < ints.size(); i += 97) {
+			assert(&widgets.at(ints[i]) == &pool[i]);
+			assert(widgets.find(ints[i])->payload == -ints[i]);
+		}
+		Widget duplicate = pool[0];
+		assert(!widgets.link(duplicate));
+		assert(widgets.size() == ints.size());
+
+		int expectedId = 0;
+		for (auto wit = widgets.begin(); wit != widgets.end(); ++wit) {
+			assert(wit->id == expectedId);
+			assert((*wit).payload == -expectedId);
+			expectedId++;
+		}
+		assert(expectedId == (int)ints.size());
+
+		// unlink every other object, then link them back in sorted order
+		for (unsigned int i = 0; i < ints.size(); i += 2) {
+			assert(&widgets.unlink(ints[i]) == &pool[i]);
+			assert(pool[i].hook.left == nullptr && pool[i].hook.right == nullptr);
+		}
+		assert(widgets.size() == ints.size() / 2);
+		assert(widgets.find(ints[0]) == nullptr);
+		try {
+			widgets.unlink(ints[0]);
+			assert(false);
+		}
+		catch (std::out_of_range&) {}
+		vector<Widget*> unlinked;
+		for (unsigned int i = 0; i < ints.size(); i += 2) {
+			unlinked.push_back(&pool[i]);
+		}
+		std::sort(unlinked.begin(), unlinked.end(),
+			[](Widget* a, Widget* b) { return a->id < b->id; });
+		for (Widget* widget : unlinked) {
+			assert(widgets.link(*widget));
+		}
+		assert(widgets.size() == ints.size());
+		assert(widgets.height() <= 22);
+		expectedId = 0;
+		for (Widget& widget : widgets) {
+			assert(widget.id == expectedId);
+			expectedId++;
+		}
+		assert(expectedId == (int)ints.size());
+
+		widgets.clear();
+		assert(widgets.size() == 0 && widgets.height() == 0);
+		assert(widgets.link(pool[0]));
+		assert(widgets.at(pool[0].id).payload == pool[0].payload);
+		widgets.clear();
+	}
+	cout << "INTRUSIVE TREE TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING HASH INDEX TESTS..." << endl;
+	{
+		// an index enabled on a populated map covers what is already there
+		TreeMap<int, int> indexed;
+		for (int i = 0; i < BULK_SIZE; i++) {
+			assert(indexed.add(ints[i], i));
+		}
+		assert(!indexed.hasHashIndex());
+		MemoryUsage unindexed = indexed.memoryUsage();
+		indexed.enableHashIndex();
+		assert(indexed.hasHashIndex());
+		assert(indexed.memoryUsage().auxiliaryBytes > unindexed.auxiliaryBytes);
+		for (int i = 0; i < BULK_SIZE; i++) {
+			assert(indexed.at(ints[i]) == i);
+			assert(indexed.contains(ints[i]));
+		}
+
+		// adds and removes keep it up to date through many rehashes
+		for (int i = BULK_SIZE; i < (int)ints.size(); i++) {
+			assert(indexed.add(ints[i], i));
+			assert(!indexed.add(ints[i], -i));
+		}
+		for (unsigned int i = 0; i < ints.size(); i += 3) {
+			assert(indexed.remove(ints[i]) == (int)i);
+			assert(!indexed.contains(ints[i]));
+			assert(indexed.find(ints[i]) == nullptr);
+		}
+		for (unsigned int i = 0; i < ints.size(); i++) {
+			int* found = indexed.find(ints[i]);
+			assert((i % 3 == 0) == (found == nullptr));
+			assert(found == nullptr || *found == (int)i);
+		}
+		try {
+			indexed.at(ints[0]);
+			assert(false);
+		}
+		catch (std::out_of_range&) {}
+
+		// ordered iteration is unaffected
+		int previousKey = -1;
+		unsigned int seen = 0;
+		for (auto iit = indexed.begin(); iit != indexed.end(); ++iit) {
+			assert(iit->first > previousKey);
+			previousKey = iit->first;
+			seen++;
+		}
+		assert(seen == indexed.size());
+
+		// a hash which sends every key to one slot still answers correctly
+		struct Collide {
+			size_t operator()(int) const { return 7; }
+		};
+		TreeMap<int, int> colliding(TreeMap<int, int>::WeightBalanced);
+		colliding.enableHashIndex<Collide>();
+		for (int i = 0; i < 200; i++) {
+			assert(colliding.add(i, -i));
+		}
+		for (int i = 0; i < 200; i += 2) {
+			assert(colliding.remove(i) == -i);
+		}
+		for (int i = 0; i < 200; i++) {
+			assert(colliding.contains(i) == (i % 2 == 1));
+		}
+		colliding.disableHashIndex();
+		assert(!colliding.hasHashIndex());
+		assert(colliding.at(199) == -199 && !colliding.contains(0));
+	}
+	cout << "HASH INDEX TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING LEARNED INDEX TESTS..." << endl;
+	{
+		TreeMap<uint64_t, int> empty;
+		LearnedIndexMap<int> frozenEmpty(empty);
+		assert(frozenEmpty.size() == 0 && frozenEmpty.segmentCount() == 0);
+		assert(frozenEmpty.find(0) == nullptr);
+
+		// dense runs, uniform noise across the whole key space, and
+		// both extremes, each of which the model must handle
+		TreeMap<uint64_t, int> source;
+		std::mt19937_64 random(87);
+		int value = 0;
+		for (uint64_t key = 1000; key < 21000; key++) {
+			source.add(key, value++);
+		}
+		for (int i = 0; i < 20000; i++) {
+			source.add(random(), value++);
+		}
+		for (uint64_t key = 1ull << 40; key < (1ull << 40) + (1ull << 30);
+			key += 1ull << 16) {
+			source.add(key, value++);
+		}
+		source.add(0, value++);
+		source.add(UINT64_MAX, value++);
+
+		LearnedIndexMap<int> frozen(source);
+		assert(frozen.size() == source.size());
+		assert(frozen.segmentCount() > 0 && frozen.segmentCount() < frozen.size() / 8);
+		for (auto sit = source.begin(); sit != source.end(); ++sit) {
+			assert(frozen.at(sit->first) == sit->second);
+		}
+		for (int i = 0; i < 20000; i++) {
+			uint64_t key = random();
+			assert((frozen.find(key) == nullptr) == !source.contains(key));
+		}
+		assert(frozen.find(999) == nullptr && frozen.find(21000) == nullptr);
+		assert(frozen.find((1ull << 40) + 1) == nullptr);
+		try {
+			frozen.at(1);
+			assert(false);
+		}
+		catch (std::out_of_range&) {}
+
+		// misses above the greatest key, and inside wide gaps whose
+		// predictions fall far outside their segment, find nothing
+		TreeMap<uint64_t, int> dense;
+		for (uint64_t key = 0; key < 1000; key++) {
+			dense.add(key, (int)key);
+		}
+		LearnedIndexMap<int> frozenDense(dense);
+		assert(frozenDense.find(1000) == nullptr);
+		assert(frozenDense.find(1000000) == nullptr);
+		assert(frozenDense.find(UINT64_MAX) == nullptr);
+		assert(frozenDense.at(999) == 999);
+		TreeMap<uint64_t, int> gapped;
+		for (uint64_t key = 0; key < 1000; key++) {
+			gapped.add(key, (int)key);
+			gapped.add(key * 3 + (1ull << 50), (int)key);
+			gapped.add(key + (1ull << 62), (int)key);
+		}
+		LearnedIndexMap<int> frozenGapped(gapped);
+		uint64_t misses[6] = { 1000, 1ull << 40, (1ull << 50) - 1, (1ull << 50) + 1,
+			(1ull << 50) + 3000, (1ull << 62) - 1 };
+		for (uint64_t key : misses) {
+			assert(frozenGapped.find(key) == nullptr);
+		}
+		for (auto git = gapped.begin(); git != gapped.end(); ++git) {
+			assert(frozenGapped.at(git->first) == git->second);
+		}
+		assert(frozenGapped.find((1ull << 62) + 1000) == nullptr);
+
+		// later changes to the source don't reach the snapshot
+		source.add(1, -1);
+		assert(frozen.find(1) == nullptr);
+
+		// the model is a small fraction of the keys it indexes
+		MemoryUsage usage = frozen.memoryUsage();
+		assert(usage.auxiliaryBytes * 8 < usage.nodeBytes);
+	}
+	cout << "LEARNED INDEX TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING WEIGHTED BUILD TESTS..." << endl;
+	{
+		// Zipf-distributed lookups over keys in no particular order
+		vector<std::tuple<int, int, double>> entries;
+		double totalWeight = 0;
+		for (int i = 0; i < BULK_SIZE; i++) {
+			double weight = 1.0 / (i + 1);
+			entries.push_back(std::make_tuple(ints[i], i, weight));
+			totalWeight += weight;
+		}
+		entries.push_back(std::make_tuple(ints[0], -1, 100.0));  // dropped
+
+		TreeMap<int, int> weighted;
+		assert(weighted.add(-5, 5));
+		weighted.buildWeighted(entries);
+		assert(weighted.size() == BULK_SIZE);
+		assert(!weighted.contains(-5));
+		assert(weighted.depthOf(ints[0]) == 1);
+		assert(weighted.at(ints[0]) == 0);
+
+		TreeMap<int, int> balanced;
+		for (int i = 0; i < BULK_SIZE; i++) {
+			assert(balanced.add(ints[i], i));
+		}
+		balanced.rebalance();
+
+		// expected comparisons per lookup, against the entropy bound
+		double weightedDepth = 0;
+		double balancedDepth = 0;
+		double entropy = 0;
+		for (int i = 0; i < BULK_SIZE; i++) {
+			double probability = 1.0 / (i + 1) / totalWeight;
+			weightedDepth += probability * weighted.depthOf(ints[i]);
+			balancedDepth += probability * balanced.depthOf(ints[i]);
+			entropy -= probability * std::log2(probability);
+		}
+		assert(weightedDepth < balancedDepth - 2);
+		assert(weightedDepth <= entropy + 2);
+
+		int previousKey = -1;
+		int seen = 0;
+		for (auto wit = weighted.begin(); wit != weighted.end(); ++wit) {
+			assert(wit->first > previousKey);
+			previousKey = wit->first;
+			seen++;
+		}
+		assert(seen == BULK_SIZE);
+
+		// the result is an ordinary map which adds and removes still work on
+		assert(weighted.add(-1, 1));
+		assert(weighted.remove(ints[0]) == 0);
+		assert(weighted.size() == BULK_SIZE);
+
+		// weightless entries, and an index which must follow the new nodes
+		vector<std::tuple<int, int, double>> unweighted;
+		for (int i = 0; i < 127; i++) {
+			unweighted.push_back(std::make_tuple(i, -i, 0.0));
+		}
+		weighted.enableHashIndex();
+		weighted.buildWeighted(unweighted);
+		assert(weighted.height() == 7);
+		assert(weighted.at(126) == -126 && !weighted.contains(-1));
+		weighted.buildWeighted(vector<std::tuple<int, int, double>>());
+		assert(weighted.size() == 0 && weighted.begin() == weighted.end());
+	}
+	cout << "WEIGHTED BUILD TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING HOT NODE RELOCATION TESTS..." << endl;
+	{
+		const int HOT_KEYS = 64;
+		TreeMap<int, int> heapMap;
+		TreeMap<int, int> arenaMap(NodeArena::Heap);
+		for (int i = 0; i < (int)ints.size(); i++) {
+			assert(heapMap.add(ints[i], i));
+			assert(arenaMap.add(ints[i], i));
+		}
+		arenaMap.enableHashIndex();
+
+		// nothing has been sampled yet, so nothing is hot
+		assert(heapMap.relocateHot(HOT_KEYS) == 0);
+
+		TreeMap<int, int>* maps[2] = { &heapMap, &arenaMap };
+		for (TreeMap<int, int>* map : maps) {
+			map->sampleAccesses(1);
+			for (int round = 0; round < 10; round++) {
+				for (int i = 0; i < HOT_KEYS; i++) {
+					assert(map->at(ints[i]) == i);
+				}
+			}
+			map->sampleAccesses(0);
+			vector<unsigned int> depths;
+			for (int i = 0; i < BULK_SIZE; i++) {
+				depths.push_back(map->depthOf(ints[i]));
+			}
+			unsigned int height = map->height();
+
+			unsigned int moved = map->relocateHot(4 * HOT_KEYS);
+			assert(moved >= HOT_KEYS && moved <= 4 * HOT_KEYS);
+
+			// the hot keys now share one compact run of memory
+			const char* lowest = reinterpret_cast<const char*>(&map->at(ints[0]));
+			const char* highest = lowest;
+			for (int i = 0; i < HOT_KEYS; i++) {
+				const char* address = reinterpret_cast<const char*>(&map->at(ints[i]));
+				lowest = address < lowest ? address : lowest;
+				highest = address > highest ? address : highest;
+			}
+			assert((size_t(highest - lowest) < TreeMap<int, int>::storageFor(moved)));
+
+			// in the same shape, with the same contents
+			assert(map->height() == height);
+			for (int i = 0; i < BULK_SIZE; i++) {
+				assert(map->depthOf(ints[i]) == depths[i]);
+			}
+			int expectedKey = 0;
+			for (auto hit = map->begin(); hit != map->end(); ++hit) {
+				assert(hit->first == expectedKey);
+				expectedKey++;
+			}
+			assert(expectedKey == (int)ints.size());
+			for (int i = 0; i < (int)ints.size(); i += 2) {
+				assert(map->remove(ints[i]) == i);
+			}
+			for (int i = 1; i < (int)ints.size(); i += 2) {
+				assert(map->at(ints[i]) == i);
+			}
+		}
+
+		// rebuilding re-parents nodes, so hot ones may end up below cold
+		// ones, where relocation must still find them all
+		TreeMap<int, int> reshaped(TreeMap<int, int>::WeightBalanced);
+		for (int i = 0; i < BULK_SIZE; i++) {
+			assert(reshaped.add(i, i));
+		}
+		reshaped.sampleAccesses(1);
+		for (int round = 0; round < 10; round++) {
+			for (int i = 0; i < HOT_KEYS; i++) {
+				assert(reshaped.at(BULK_SIZE - 1 - 3 * i) == BULK_SIZE - 1 - 3 * i);
+			}
+		}
+		reshaped.sampleAccesses(0);
+		reshaped.rebalance();
+		unsigned int reshapedMoved = reshaped.relocateHot(4 * HOT_KEYS);
+		assert(reshapedMoved >= HOT_KEYS);
+		const char* lowest = reinterpret_cast<const char*>(&reshaped.at(BULK_SIZE - 1));
+		const char* highest = lowest;
+		for (int i = 0; i < HOT_KEYS; i++) {
+			const char* address = reinterpret_cast<const char*>(
+				&reshaped.at(BULK_SIZE - 1 - 3 * i));
+			lowest = address < lowest ? address : lowest;
+			highest = address > highest ? address : highest;
+		}
+		assert((size_t(highest - lowest) < TreeMap<int, int>::storageFor(reshapedMoved)));
+		int expectedKey = 0;
+		for (auto rit = reshaped.begin(); rit != reshaped.end(); ++rit) {
+			assert(rit->first == expectedKey && rit->second == expectedKey);
+			expectedKey++;
+		}
+		assert(expectedKey == BULK_SIZE);
+	}
+	cout << "HOT NODE RELOCATION TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING STATIC TREE TESTS..." << endl;
+	{
+		// built, searched, and iterated entirely by the compiler
+		constexpr StaticEntry<int, int> squares[] = {
+			{ 7, 49 }, { 3, 9 }, { 11, 121 }, { 1, 1 }, { 5, 25 },
+			{ 9, 81 }, { 2, 4 }, { 10, 100 }, { 4, 16 }, { 8, 64 },
+		};
+		constexpr auto squareMap = makeStaticTreeMap(squares);
+		static_assert(squareMap.size() == 10, "every entry is kept");
+		static_assert(squareMap.at(7) == 49 && squareMap.at(1) == 1,
+			"lookups run at compile time");
+		static_assert(squareMap.find(6) == nullptr && !squareMap.contains(0),
+			"misses are found at compile time");
+		static_assert(squareMap.begin()->first == 1, "the least key comes first");
+		static_assert(sumOfValues(squareMap) == 470, "iteration runs at compile time");
+
+		// and the same map behaves identically at run time
+		int expectedKey = 0;
+		for (const auto& entry : squareMap) {
+			expectedKey += expectedKey == 5 ? 2 : 1;
+			assert(entry.first == expectedKey);
+			assert(entry.second == expectedKey * expectedKey);
+		}
+		assert(expectedKey == 11);
+		try {
+			squareMap.at(6);
+			assert(false);
+		}
+		catch (std::out_of_range&) {}
+
+		// a larger, incomplete tree built at run time
+		StaticEntry<int, int> shuffled[40] = {};
+		for (int i = 0; i < 40; i++) {
+			shuffled[i] = StaticEntry<int, int>{ (i * 17) % 40, i };
+		}
+		StaticTreeMap<int, int, 40> permuted(shuffled);
+		for (int i = 0; i < 40; i++) {
+			assert(permuted.at((i * 17) % 40) == i);
+		}
+		assert(!permuted.contains(40) && !permuted.contains(-1));
+		expectedKey = 0;
+		for (auto pit = permuted.begin(); pit != permuted.end(); pit++) {
+			assert(pit->first == expectedKey);
+			expectedKey++;
+		}
+		assert(expectedKey == 40);
+
+		constexpr StaticEntry<const char*, int> lone[1] = { { "only", 1 } };
+		constexpr auto single = makeStaticTreeMap(lone);
+		static_assert(single.size() == 1, "a single entry is its own root");
+		assert(std::distance(single.begin(), single.end()) == 1);
+
+		// a repeated key is rejected at run time as it would be at
+		// compile time
+		StaticEntry<int, int> repeated[] = { { 1, 1 }, { 2, 2 }, { 1, 3 } };
+		try {
+			StaticTreeMap<int, int, 3> rejected(repeated);
+			assert(false);
+		}
+		catch (std::invalid_argument&) {}
+	}
+	cout << "STATIC TREE TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING SCAN ITERATOR TESTS..." << endl;
+	{
+		TreeMap<int, int> scanned;
+		assert(scanned.scan() == scanned.scanEnd());
+		assert(scanned.scanFrom(0) == scanned.scanEnd());
+		for (int i = 0; i < (int)ints.size(); i++) {
+			assert(scanned.add(2 * ints[i], i));
+		}
+
+		// a full scan visits what TreeIterator does, in the same order
+		auto tit = scanned.begin();
+		unsigned int visited = 0;
+		for (auto sit = scanned.scan(); sit != scanned.scanEnd(); ++sit) {
+			assert(sit->first == tit->first && (*sit).second == tit->second);
+			++tit;
+			visited++;
+		}
+		assert(visited == scanned.size() && tit == scanned.end());
+
+		// range scans start at the least key not below their bound
+		assert(scanned.scanFrom(-5)->first == 0);
+		assert(scanned.scanFrom(0)->first == 0);
+		assert(scanned.scanFrom(1)->first == 2);
+		assert(scanned.scanFrom(2 * (int)ints.size() - 2)->first
+			== 2 * (int)ints.size() - 2);
+		assert(scanned.scanFrom(2 * (int)ints.size() - 1) == scanned.scanEnd());
+		int expectedKey = 1000;
+		auto rangeEnd = scanned.scanFrom(2000);
+		for (auto sit = scanned.scanFrom(999); sit != rangeEnd; sit++) {
+			assert(sit->first == expectedKey);
+			expectedKey += 2;
+		}
+		assert(expectedKey == 2000);
+
+		// the path is charged to the map while the iterator lives
+		size_t before = scanned.memoryUsage().iteratorBytes;
+		{
+			auto live = scanned.scan();
+			assert(scanned.memoryUsage().iteratorBytes > before);
+		}
+		assert(scanned.memoryUsage().iteratorBytes == before);
+
+		// scans of the same map on several threads at once all charge
+		// it, and leave nothing charged once they finish
+		vector<std::thread> scanners;
+		for (int t = 0; t < 4; t++) {
+			scanners.push_back(std::thread([&scanned]() {
+				const TreeMap<int, int>& shared = scanned;
+				for (int round = 0; round < 20; round++) {
+					unsigned int count = 0;
+					for (auto sit = shared.scanFrom(round * 100); sit != shared.scanEnd(); ++sit) {
+						count++;
+					}
+					assert(count > 0);
+				}
+			}));
+		}
+		for (std::thread& scanner : scanners) {
+			scanner.join();
+		}
+		assert(scanned.memoryUsage().iteratorBytes == before);
+
+		auto finished = scanned.scanFrom(2 * (int)ints.size() - 2);
+		finished++;
+		try {
+			++finished;
+			assert(false);
+		}
+		catch (std::out_of_range&) {}
+	}
+	cout << "SCAN ITERATOR TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING MORRIS TRAVERSAL TESTS..." << endl;
+	{
+		TreeMap<int, int> threaded;
+		int calls = 0;
+		threaded.forEachInOrder([&calls](const pair<int, int>&) { calls++; });
+		assert(calls == 0);
+		for (int i = 0; i < (int)ints.size(); i++) {
+			assert(threaded.add(ints[i], -ints[i]));
+		}
+		unsigned int height = threaded.height();
+		MemoryUsage before = threaded.memoryUsage();
+
+		int expectedKey = 0;
+		threaded.forEachInOrder([&expectedKey](const pair<int, int>& entry) {
+			assert(entry.first == expectedKey && entry.second == -expectedKey);
+			expectedKey++;
+		});
+		assert(expectedKey == (int)ints.size());
+		assert(threaded.memoryUsage().total() == before.total());
+
+		// a callback which throws partway still leaves the tree intact
+		int stopAt = (int)ints.size() / 3;
+		try {
+			threaded.forEachInOrder([stopAt](const pair<int, int>& entry) {
+				if (entry.first == stopAt) {
+					throw std::runtime_error("stop");
+				}
+			});
+			assert(false);
+		}
+		catch (std::runtime_error&) {}
+		assert(threaded.height() == height);
+		expectedKey = 0;
+		for (auto mit = threaded.begin(); mit != threaded.end(); ++mit) {
+			assert(mit->first == expectedKey);
+			expectedKey++;
+		}
+		assert(expectedKey == (int)ints.size());
+		for (int i = 0; i < (int)ints.size(); i += 2) {
+			assert(threaded.remove(ints[i]) == -ints[i]);
+		}
+		assert(threaded.size() == ints.size() / 2);
+	}
+	cout << "MORRIS TRAVERSAL TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING ERASE TESTS..." << endl;
+	{
+		TreeMap<int, int>::BalancePolicy policies[2] = {
+			TreeMap<int, int>::PartialRebuild, TreeMap<int, int>::WeightBalanced };
+		for (TreeMap<int, int>::BalancePolicy policy : policies) {
+			TreeMap<int, int> erased(policy);
+			for (int i = 0; i < (int)ints.size(); i++) {
+				assert(erased.add(ints[i], -ints[i]));
+			}
+			auto next = erased.erase(erased.begin());
+			assert(next == erased.begin());
+			assert(erased.begin()->first == 1);
+
+			// scan and delete every multiple of three in one pass
+			int expectedKey = 1;
+			for (auto mit = erased.begin(); mit != erased.end(); ) {
+				assert(mit->first == expectedKey);
+				if (mit->first % 3 == 0) {
+					mit = erased.erase(mit);
+				}
+				else {
+					++mit;
+				}
+				expectedKey++;
+			}
+			assert(expectedKey == (int)ints.size());
+			unsigned int remaining = (unsigned int)ints.size() - (unsigned int)ints.size() / 3 - 1;
+			assert(erased.size() == remaining);
+			for (int i = 1; i < (int)ints.size(); i++) {
+				assert(erased.contains(i) == (i % 3 != 0));
+			}
+			assert(erased.height() <= 2 * std::log2(erased.size()) + 2);
+
+			// iterators to surviving pairs outlast adds and removes of others
+			auto held = erased.begin();
+			for (int i = 0; i < 100; i++) {
+				++held;
+			}
+			int heldKey = held->first;
+			for (int i = 1; i < (int)ints.size(); i++) {
+				if (i != heldKey && i % 3 == 1) {
+					erased.remove(i);
+				}
+			}
+			for (int i = (int)ints.size(); i < 2 * (int)ints.size(); i++) {
+				assert(erased.add(i, -i));
+			}
+			assert(held->first == heldKey && held->second == -heldKey);
+			int previous = heldKey;
+			unsigned int after = 0;
+			for (++held; held != erased.end(); ++held) {
+				assert(held->first > previous);
+				previous = held->first;
+				after++;
+			}
+			unsigned int before = 0;
+			for (auto mit = erased.begin(); mit->first != heldKey; ++mit) {
+				before++;
+			}
+			assert(before + 1 + after == erased.size());
+
+			// erasing everything from the front leaves an empty map
+			while (erased.size() > 0) {
+				next = erased.erase(erased.begin());
+				assert(next == erased.begin());
+			}
+			assert(erased.begin() == erased.end());
+			try {
+				erased.erase(erased.end());
+				assert(false);
+			}
+			catch (std::out_of_range&) {}
+		}
+
+		// erase keeps a hash index in step
+		TreeMap<int, int> indexed;
+		for (int i = 0; i < 1000; i++) {
+			assert(indexed.add(i, i));
+		}
+		indexed.enableHashIndex();
+		for (auto mit = indexed.begin(); mit != indexed.end(); ) {
+			mit = mit->first % 2 == 0 ? indexed.erase(mit) : std::next(mit);
+		}
+		for (int i = 0; i < 1000; i++) {
+			assert(indexed.contains(i) == (i % 2 == 1));
+		}
+	}
+	cout << "ERASE TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING COLUMNAR EXPORT TESTS..." << endl;
+	{
+		// large enough to be exported by several threads
+		const unsigned int COLUMN_SIZE = 300000;
+		TreeMap<uint64_t, uint64_t> columnar;
+		std::mt19937_64 random(7);
+		for (unsigned int i = 0; i < COLUMN_SIZE; i++) {
+			uint64_t key = random() % (4ull * COLUMN_SIZE);
+			columnar.add(key, key * 3);
+		}
+		vector<uint64_t> keys;
+		vector<uint64_t> values;
+		columnar.exportColumns(&keys, &values);
+		assert(keys.size() == columnar.size() && values.size() == columnar.size());
+		size_t i = 0;
+		for (auto mit = columnar.begin(); mit != columnar.end(); ++mit, i++) {
+			assert(keys[i] == mit->first && values[i] == mit->second);
+		}
+
+		// importing the columns rebuilds the same map, perfectly balanced
+		TreeMap<uint64_t, uint64_t> imported(TreeMap<uint64_t, uint64_t>::WeightBalanced);
+		assert(imported.add(1, 1));
+		imported.enableHashIndex();
+		imported.importColumns(keys, values);
+		assert(imported.size() == columnar.size());
+		assert(imported.height() == (unsigned int)std::ceil(std::log2(imported.size() + 1)));
+		for (size_t j = 0; j < keys.size(); j += 97) {
+			assert(imported.at(keys[j]) == values[j]);
+		}
+		vector<uint64_t> roundTripKeys(imported.size());
+		vector<uint64_t> roundTripValues(imported.size());
+		imported.exportColumns(roundTripKeys.data(), roundTripValues.data());
+		assert(roundTripKeys == keys && roundTripValues == values);
+		assert(imported.add(4 * COLUMN_SIZE, 0));
+		imported.remove(keys[0]);
+
+		// keys out of order, or columns of different lengths, are
+		// refused without touching the map
+		std::swap(keys[10], keys[11]);
+		try {
+			imported.importColumns(keys, values);
+			assert(false);
+		}
+		catch (std::invalid_argument&) {}
+		values.pop_back();
+		try {
+			imported.importColumns(keys, values);
+			assert(false);
+		}
+		catch (std::invalid_argument&) {}
+		assert(imported.size() == columnar.size());
+		assert(imported.contains(4 * COLUMN_SIZE));
+
+		// and nothing is exported from or imported into an empty map
+		imported.importColumns(nullptr, nullptr, 0);
+		assert(imported.size() == 0 && imported.begin() == imported.end());
+		imported.exportColumns(&keys, &values);
+		assert(keys.empty() && values.empty());
+	}
+	cout << "COLUMNAR EXPORT TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING TEXT EXPORT TESTS..." << endl;
+	{
+		// enough pairs to span several blocks of text
+		TreeMap<int, long long> written;
+		for (int i = -100000; i < 100000; i++) {
+			assert(written.add(i * 7, (long long)i * i * i));
+		}
+		std::ostringstream fast;
+		writeText(fast, written);
+		std::ostringstream slow;
+		slow << written;
+		assert(fast.str() == slow.str());
+		assert(fast.str().size() > 2 * TREE_TEXT_BLOCK);
+
+		TreeMap<int, long long> read;
+		assert(read.add(1, 1));
+		std::istringstream in(fast.str());
+		readText(in, &read);
+		assert(read.size() == written.size());
+		for (auto mit = written.begin(), rit = read.begin(); mit != written.end();
+			++mit, ++rit) {
+			assert(*mit == *rit);
+		}
+
+		// floating point values come back exactly
+		TreeMap<double, float> fractions;
+		for (int i = 1; i < 1000; i++) {
+			assert(fractions.add(1.0 / i, float(i) / 3));
+		}
+		std::ostringstream fractionText;
+		writeText(fractionText, fractions);
+		TreeMap<double, float> fractionsRead;
+		std::istringstream fractionIn(fractionText.str());
+		readText(fractionIn, &fractionsRead);
+		assert(fractionsRead.size() == fractions.size());
+		for (int i = 1; i < 1000; i++) {
+			assert(fractionsRead.at(1.0 / i) == float(i) / 3);
+		}
+
+		// pairs in any order, spread over lines, keeping the first of
+		// any repeated key
+		std::istringstream shuffled("{5=50}, {-2=-20},\n{9=90}, {5=55}\n");
+		TreeMap<int, int> unordered;
+		readText(shuffled, &unordered);
+		assert(unordered.size() == 3);
+		assert(unordered.at(-2) == -20 && unordered.at(5) == 50 && unordered.at(9) == 90);
+		std::istringstream empty("");
+		readText(empty, &unordered);
+		assert(unordered.size() == 0);
+
+		// malformed text leaves the map as it was
+		const char* malformed[] = { "{1=2}, {3=}", "{1=2} {3=4", "{1=2}x",
+			"1=2}", "{1-2}", "{1=2=3}" };
+		assert(unordered.add(1, 1));
+		for (const char* text : malformed) {
+			std::istringstream bad(text);
+			try {
+				readText(bad, &unordered);
+				assert(false);
+			}
+			catch (std::invalid_argument&) {}
+			assert(unordered.size() == 1 && unordered.at(1) == 1);
+		}
+	}
+	cout << "TEXT EXPORT TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING COMPRESSED SNAPSHOT TESTS..." << endl;
+	{
+		// runs of keys at every spacing, so blocks of every width
+		TreeMap<uint64_t, int> original;
+		uint64_t key = 5;
+		uint64_t gaps[5] = { 1, 300, 70000, 1ull << 33, 3 };
+		for (int i = 0; i < 5000; i++) {
+			assert(original.add(key, i));
+			key += gaps[(i / 700) % 5] + i % 2;
+		}
+		CompressedSnapshot<int> compressed(original);
+		assert(compressed.size() == original.size());
+		assert(compressed.blockCount() == (5000 + 127) / 128);
+		for (auto mit = original.begin(); mit != original.end(); ++mit) {
+			assert(compressed.at(mit->first) == mit->second);
+			assert(compressed.find(mit->first + 1) == nullptr
+				|| original.contains(mit->first + 1));
+		}
+		assert(compressed.find(0) == nullptr && compressed.find(UINT64_MAX) == nullptr);
+		try {
+			compressed.at(4);
+			assert(false);
+		}
+		catch (std::out_of_range&) {}
+		MemoryUsage usage = compressed.memoryUsage();
+		assert(usage.nodeTypes[0].bytes < 4 * original.size());
+
+		// saving and loading gives back the same snapshot and map
+		std::stringstream file;
+		compressed.save(file);
+		assert(file.str().size() < 5000 * (4 + sizeof(int)));
+		CompressedSnapshot<int> loaded(file);
+		TreeMap<uint64_t, int> restored;
+		loaded.restore(&restored);
+		assert(restored.size() == original.size());
+		for (auto mit = original.begin(), rit = restored.begin(); mit != original.end();
+			++mit, ++rit) {
+			assert(*mit == *rit && loaded.at(mit->first) == mit->second);
+		}
+
+		// truncated or foreign data is refused
+		std::string saved = file.str();
+		std::string damaged[3] = { saved.substr(0, saved.size() - 1),
+			"not a snapshot at all", saved };
+		damaged[2][0] = 'X';
+		for (const std::string& bytes : damaged) {
+			std::stringstream bad(bytes);
+			try {
+				CompressedSnapshot<int> refused(bad);
+				assert(false);
+			}
+			catch (std::runtime_error&) {}
+		}
+
+		// an empty map makes an empty snapshot
+		TreeMap<uint64_t, int> none;
+		CompressedSnapshot<int> empty(none);
+		std::stringstream emptyFile;
+		empty.save(emptyFile);
+		CompressedSnapshot<int> emptyLoaded(emptyFile);
+		assert(emptyLoaded.size() == 0 && emptyLoaded.find(5) == nullptr);
+		emptyLoaded.restore(&restored);
+		assert(restored.size() == 0);
+	}
+	cout << "COMPRESSED SNAPSHOT TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING ASYNC SNAPSHOT TESTS..." << endl;
+	{
+		// enough pairs to cycle through the ring of buffers several times
+		TreeMap<uint64_t, double> saved;
+		for (uint64_t i = 0; i < 1000000; i++) {
+			assert(saved.add(i * 3, i / 4.0));
+		}
+		{
+			AsyncSnapshotWriter<uint64_t, double> writer(saved, "snapshot_test.bin");
+			writer.wait();
+			assert(writer.isDone());
+			writer.wait();
+		}
+		TreeMap<uint64_t, double> loaded;
+		assert(loaded.add(1, 1));
+		readSnapshot("snapshot_test.bin", &loaded);
+		assert(loaded.size() == saved.size());
+		for (auto mit = saved.begin(), lit = loaded.begin(); mit != saved.end();
+			++mit, ++lit) {
+			assert(*mit == *lit);
+		}
+
+		// the destructor waits for a write nobody waited for
+		TreeMap<uint64_t, double> none;
+		{
+			AsyncSnapshotWriter<uint64_t, double> writer(none, "snapshot_test.bin");
+		}
+		readSnapshot("snapshot_test.bin", &loaded);
+		assert(loaded.size() == 0);
+
+		// a snapshot of other types, or no snapshot at all, is refused
+		try {
+			TreeMap<uint32_t, double> mismatched;
+			readSnapshot("snapshot_test.bin", &mismatched);
+			assert(false);
+		}
+		catch (std::runtime_error&) {}
+		try {
+			readSnapshot("no_such_snapshot.bin", &loaded);
+			assert(false);
+		}
+		catch (std::runtime_error&) {}
+		std::remove("snapshot_test.bin");
+
+		// failures to open or to write the file are reported
+		try {
+			AsyncSnapshotWriter<uint64_t, double> writer(saved, "no_such_directory/snapshot.bin");
+			assert(false);
+		}
+		catch (std::runtime_error&) {}
+		std::ifstream full("/dev/full");
+		if (full.good()) {
+			AsyncSnapshotWriter<uint64_t, double> writer(saved, "/dev/full");
+			try {
+				writer.wait();
+				assert(false);
+			}
+			catch (std::runtime_error&) {}
+		}
+	}
+	cout << "ASYNC SNAPSHOT TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING LEFT RIGHT TESTS..." << endl;
+	{
+		LeftRightTreeMap<int, int> shared(TreeMap<int, int>::WeightBalanced);
+		for (int i = 0; i < 1000; i++) {
+			assert(shared.add(i, -i));
+		}
+		assert(!shared.add(0, 0));
+		assert(shared.size() == 1000 && shared.at(7) == -7);
+		assert(shared.remove(7) == -7);
+		assert(!shared.contains(7));
+		try {
+			shared.remove(7);
+			assert(false);
+		}
+		catch (std::out_of_range&) {}
+		try {
+			shared.at(7);
+			assert(false);
+		}
+		catch (std::out_of_range&) {}
+		assert(shared.add(7, -7));
+		assert(shared.memoryUsage().nodeTypes[0].count == 2000);
+
+		// readers on other threads always find the keys that are never
+		// removed, and see each churned key either whole or not at all,
+		// while one thread adds and removes
+		std::atomic<bool> writing(true);
+		std::atomic<long> reads(0);
+		vector<std::thread> readers;
+		for (int r = 0; r < 3; r++) {
+			readers.push_back(std::thread([&shared, &writing, &reads, r]() {
+				std::mt19937_64 random(r);
+				while (writing) {
+					int key = int(random() % 1000);
+					assert(shared.at(key) == -key);
+					int churned = 1000 + key;
+					bool whole = shared.read([churned](const TreeMap<int, int>& map) {
+						return !map.contains(churned) || map.at(churned) == -churned;
+					});
+					assert(whole);
+					unsigned int size = shared.size();
+					assert(size >= 1000 && size <= 2000);
+					// scans run alongside other reads of the same replica
+					int scanned = shared.read([key](const TreeMap<int, int>& map) {
+						int count = 0;
+						for (auto sit = map.scanFrom(key); sit != map.scanEnd()
+							&& sit->first < key + 10; ++sit) {
+							count++;
+						}
+						return count;
+					});
+					assert(scanned >= 1 && scanned <= 10);
+					reads++;
+				}
+			}));
+		}
+		for (int round = 0; round < 20; round++) {
+			for (int i = 1000; i < 2000; i++) {
+				assert(shared.add(i, -i));
+			}
+			for (int i = 1000; i < 2000; i++) {
+				assert(shared.remove(i) == -i);
+			}
+		}
+		writing = false;
+		for (std::thread& reader : readers) {
+			reader.join();
+		}
+		assert(reads > 0);
+		assert(shared.size() == 1000);
+		assert(shared.memoryUsage().nodeTypes[0].count == 2000);
+	}
+	cout << "LEFT RIGHT TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING APPEND TESTS..." << endl;
+	{
+		// the looser of the two policies' height bounds
+		auto heightBound = [](unsigned int n) {
+			unsigned int bound = 1;
+			for (double reach = 1; reach < n + 1.0; reach *= 4.0 / 3.0) {
+				bound++;
+			}
+			return bound;
+		};
+		TreeMap<int, int>::BalancePolicy policies[2] = {
+			TreeMap<int, int>::PartialRebuild, TreeMap<int, int>::WeightBalanced };
+		for (TreeMap<int, int>::BalancePolicy policy : policies) {
+			TreeMap<int, int> series(NodeArena::Heap, policy);
+			std::map<int, int> reference;
+			auto agrees = [&series, &reference]() {
+				auto rit = reference.begin();
+				for (auto sit = series.begin(); sit != series.end(); ++sit, ++rit) {
+					if (rit == reference.end() || sit->first != rit->first
+						|| sit->second != rit->second) {
+						return false;
+					}
+				}
+				return rit == reference.end() && series.size() == reference.size();
+			};
+
+			// ascending keys, with the odd late one filling a gap below
+			// the greatest and the odd repeat of it
+			int next = 0;
+			for (int i = 0; i < 50000; i++) {
+				next += 2;
+				assert(series.add(next, i));
+				reference[next] = i;
+				if (i % 101 == 0) {
+					assert(series.add(next - 1, -i));
+					reference[next - 1] = -i;
+					assert(!series.add(next, 0));
+				}
+				if (i % 997 == 0) {
+					assert(series.height() <= heightBound(series.size()));
+				}
+			}
+			assert(agrees());
+
+			// removing the greatest key hands its place to the next one,
+			// whichever way it goes
+			for (int i = 0; i < 300; i++) {
+				int greatest = reference.rbegin()->first;
+				if (i % 3 == 0) {
+					auto last = series.begin();
+					for (auto sit = series.begin(); sit != series.end(); ++sit) {
+						last = sit;
+					}
+					assert(series.erase(last) == series.end());
+				}
+				else {
+					assert(series.remove(greatest) == reference[greatest]);
+				}
+				reference.erase(greatest);
+				if (i % 7 == 0) {
+					// between the new greatest key and the old one
+					int between = reference.rbegin()->first + 1;
+					assert(series.add(between, i));
+					reference[between] = i;
+				}
+			}
+			assert(agrees());
+
+			// and appends carry on after every operation that moves or
+			// replaces nodes
+			series.sampleAccesses(1);
+			for (int round = 0; round < 10; round++) {
+				assert(series.at(reference.rbegin()->first) == reference.rbegin()->second);
+			}
+			series.sampleAccesses(0);
+			series.relocateHot(16);
+			assert(series.add(++next, 1) && series.add(++next, 2));
+			reference[next - 1] = 1;
+			reference[next] = 2;
+			series.rebalance();
+			assert(series.add(++next, 3));
+			reference[next] = 3;
+			vector<int> keys;
+			vector<int> values;
+			series.exportColumns(&keys, &values);
+			TreeMap<int, int> imported(policy);
+			imported.importColumns(keys, values);
+			assert(imported.add(++next, 4) && !imported.add(next, 5));
+			assert(imported.at(next) == 4 && imported.size() == series.size() + 1);
+			series.enableHashIndex();
+			for (int i = 0; i < 1000; i++) {
+				assert(series.add(++next, i));
+				reference[next] = i;
+				assert(series.find(next) != nullptr && *series.find(next) == i);
+			}
+			assert(agrees());
+			assert(series.height() <= heightBound(series.size()));
+
+			// emptied, the map appends from scratch
+			while (!reference.empty()) {
+				assert(series.remove(reference.rbegin()->first) == reference.rbegin()->second);
+				reference.erase(reference.rbegin()->first);
+			}
+			assert(series.size() == 0 && series.add(1, 1) && series.add(2, 2));
+			assert(series.at(1) == 1 && series.at(2) == 2 && series.height() == 2);
+		}
+	}
+	cout << "APPEND TESTS: COMPLETE" << endl << endl;
+
+	cout << "COMMENCING TREE SEQUENCE TESTS..." << endl;
+	{
+		// the WeightBalanced bound, as the sequence shares its rotations
+		auto heightBound = [](unsigned int n) {
+			unsigned int bound = 0;
+			for (double reach = 1; reach < n + 1.0; reach *= 4.0 / 3.0) {
+				bound++;
+			}
+			return bound;
+		};
+		TreeSequence<int> sequence;
+		vector<int> reference;
+		auto agrees = [&sequence, &reference]() {
+			unsigned int position = 0;
+			for (auto sit = sequence.begin(); sit != sequence.end(); ++sit, ++position) {
+				if (position >= reference.size() || *sit != reference[position]) {
+					return false;
+				}
+			}
+			return position == reference.size() && sequence.size() == reference.size();
+		};
+		assert(sequence.size() == 0 && sequence.begin() == sequence.end());
+		try {
+			sequence.at(0);
+			assert(false);
+		}
+		catch (std::out_of_range&) {}
+		try {
+			sequence.insert(1, 0);
+			assert(false);
+		}
+		catch (std::out_of_range&) {}
+
+		// inserts and removes at random positions agree with a vector
+		std::mt19937_64 random(100);
+		for (int i = 0; i < 20000; i++) {
+			if (random() % 3 != 0 || reference.empty()) {
+				unsigned int position = (unsigned int)(random() % (reference.size() + 1));
+				assert(sequence.insert(position, i));
+				reference.insert(reference.begin() + position, i);
+			}
+			else {
+				unsigned int position = (unsigned int)(random() % reference.size());
+				assert(sequence.remove(position) == reference[position]);
+				reference.erase(reference.begin() + position);
+			}
+			if (i % 997 == 0) {
+				assert(sequence.height() <= heightBound(sequence.size()));
+				unsigned int position = (unsigned int)(random() % reference.size());
+				assert(sequence.at(position) == reference[position]);
+			}
+		}
+		assert(agrees());
+		try {
+			sequence.remove(sequence.size());
+			assert(false);
+		}
+		catch (std::out_of_range&) {}
+
+		// appending is inserting at size(), and values change in place
+		for (int i = 0; i < 1000; i++) {
+			assert(sequence.pushBack(-i));
+			reference.push_back(-i);
+		}
+		sequence.at(0) = 7;
+		reference[0] = 7;
+		*sequence.iteratorAt(5) += 1;
+		reference[5] += 1;
+		assert(sequence.iteratorAt(sequence.size()) == sequence.end());
+		assert(agrees());
+
+		// splitting anywhere and concatenating again restores the sequence,
+		// and an iterator follows its value into the back half
+		TreeSequence<int> back;
+		try {
+			sequence.split(0, &sequence);
+			assert(false);
+		}
+		catch (std::invalid_argument&) {}
+		try {
+			sequence.concat(&sequence);
+			assert(false);
+		}
+		catch (std::invalid_argument&) {}
+		unsigned int positions[4] = { 0, 1, sequence.size() / 3, sequence.size() };
+		for (unsigned int position : positions) {
+			unsigned int total = sequence.size();
+			auto followed = sequence.iteratorAt(total - 1);
+			sequence.split(position, &back);
+			assert(sequence.size() == position && back.size() == total - position);
+			assert(sequence.height() <= heightBound(sequence.size()));
+			assert(back.height() <= heightBound(back.size()));
+			if (position < total) {
+				assert(back.at(0) == reference[position]);
+				assert(*followed == reference.back() && ++followed == back.end());
+			}
+			if (back.size() > 0) {
+				try {
+					sequence.split(0, &back);
+					assert(false);
+				}
+				catch (std::invalid_argument&) {}
+			}
+			sequence.concat(&back);
+			assert(back.size() == 0 && agrees());
+		}
+
+		// sequences of very different sizes concatenate either way round
+		TreeSequence<int> small;
+		for (int i = 0; i < 3; i++) {
+			assert(small.pushBack(i));
+		}
+		small.concat(&sequence);
+		reference.insert(reference.begin(), { 0, 1, 2 });
+		sequence.concat(&small);
+		assert(small.size() == 0 && agrees());
+		assert(sequence.height() <= heightBound(sequence.size()));
+		for (int i = 3; i < 6; i++) {
+			assert(small.pushBack(i));
+			reference.push_back(i);
+		}
+		sequence.concat(&small);
+		assert(agrees());
+
+		// removing everything from the front leaves an empty sequence
+		while (!reference.empty()) {
+			assert(sequence.remove(0) == reference.front());
+			reference.erase(reference.begin());
+		}
+		assert(sequence.size() == 0 && sequence.height() == 0);
+	}
+	cout << "TREE SEQUENCE TESTS: COMPLETE" << endl << endl;
+
 	cout << "ALL TESTS SUCCESSFULLY COMPLETED" << endl;
 	return EXIT_SUCCESS;
 }
\ No newline at end of file